@@ -21,19 +21,25 @@ typedef std::string bytes;
 
 struct TaskDescription
 {
-  TaskDescription() {}
+  TaskDescription() : cpus(-1), mem(-1) {}
 
   TaskDescription(TaskID _taskId, SlaveID _slaveId, const std::string& _name,
                   const std::map<std::string, std::string>& _params,
                   const bytes& _arg)
     : taskId(_taskId), slaveId(_slaveId), name(_name),
-      params(_params), arg(_arg) {}
+      params(_params), arg(_arg), cpus(-1), mem(-1) {}
 
   TaskID taskId;
   SlaveID slaveId;
   std::string name;
   std::map<std::string, std::string> params;
   bytes arg;
+
+  // The "cpus" and "mem" params as numbers, so that the master doesn't
+  // have to parse them. These are -1 when unknown; the scheduler driver
+  // fills them in from params when replying to an offer.
+  int32_t cpus;
+  int32_t mem;
 };
 
 
@@ -52,16 +58,20 @@ struct TaskStatus
 
 struct SlaveOffer
 {
-  SlaveOffer() {}
+  SlaveOffer() : cpus(-1), mem(-1) {}
 
   SlaveOffer(SlaveID _slaveId,
              const std::string& _host,
              const std::map<std::string, std::string>& _params)
-    : slaveId(_slaveId), host(_host), params(_params) {}
+    : slaveId(_slaveId), host(_host), params(_params), cpus(-1), mem(-1) {}
 
   SlaveID slaveId;
   std::string host;
   std::map<std::string, std::string> params;
+
+  // The "cpus" and "mem" params as numbers (-1 if unknown).
+  int32_t cpus;
+  int32_t mem;
 };
 
 
@@ -0,0 +1,85 @@
+#ifndef __INTERNER_HPP__
+#define __INTERNER_HPP__
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <boost/unordered_map.hpp>
+
+
+namespace mesos { namespace internal {
+
+// Maps string IDs (e.g. framework and slave IDs) to compact integer
+// handles, so that an ID only has to be hashed once when a message
+// arrives and internal tables can be keyed by small integers. Handles
+// are assigned densely starting at 0. Once the entity an ID belongs to
+// is gone and nothing refers to its handle any more, release the handle
+// so that it gets reused (otherwise the table only ever grows).
+class Interner
+{
+public:
+  typedef uint32_t Handle;
+
+  // Return the handle for an ID, assigning a new one if necessary.
+  Handle intern(const std::string& id)
+  {
+    boost::unordered_map<std::string, Handle>::iterator it = handles.find(id);
+    if (it != handles.end())
+      return it->second;
+    Handle handle;
+    if (!released.empty()) {
+      handle = released.back();
+      released.pop_back();
+      ids[handle] = id;
+    } else {
+      handle = ids.size();
+      ids.push_back(id);
+    }
+    handles[id] = handle;
+    return handle;
+  }
+
+  // Forget the ID a handle was assigned to, making the handle available
+  // to the next ID that gets interned.
+  void release(Handle handle)
+  {
+    handles.erase(ids[handle]);
+    ids[handle].clear();
+    released.push_back(handle);
+  }
+
+  // Find the handle for an ID without assigning one; returns false if
+  // the ID has never been interned.
+  bool lookup(const std::string& id, Handle* handle) const
+  {
+    boost::unordered_map<std::string, Handle>::const_iterator it =
+      handles.find(id);
+    if (it == handles.end())
+      return false;
+    *handle = it->second;
+    return true;
+  }
+
+  // Return the ID a handle was assigned to.
+  const std::string& id(Handle handle) const
+  {
+    return ids[handle];
+  }
+
+  // Number of IDs that currently have a handle.
+  size_t size() const
+  {
+    return ids.size() - released.size();
+  }
+
+private:
+  boost::unordered_map<std::string, Handle> handles;
+  std::vector<std::string> ids;
+  std::vector<Handle> released; // Handles free for reuse
+};
+
+}} /* namespace */
+
+#endif /* __INTERNER_HPP__ */
@@ -0,0 +1,232 @@
+#ifndef __POOL_HPP__
+#define __POOL_HPP__
+
+#include <stddef.h>
+#include <stdlib.h>
+
+#include <map>
+#include <new>
+#include <vector>
+
+
+namespace mesos { namespace internal {
+
+// A pool of fixed-size blocks carved out of larger slabs. Freed blocks
+// go on a free list and are handed out again before any new slab is
+// allocated; slabs are only returned to the system when the pool is
+// destroyed. Pools are not thread-safe, they are meant to be owned by a
+// single process (e.g. the master).
+class SlabPool
+{
+public:
+  SlabPool(size_t _blockSize, size_t _blocksPerSlab = 256)
+    : blockSize(_blockSize < sizeof(FreeBlock) ? sizeof(FreeBlock) : _blockSize),
+      blocksPerSlab(_blocksPerSlab), freeList(NULL), used(0) {}
+
+  ~SlabPool()
+  {
+    for (size_t i = 0; i < slabs.size(); i++)
+      free(slabs[i]);
+  }
+
+  void * allocate()
+  {
+    if (freeList == NULL)
+      grow();
+    FreeBlock *block = freeList;
+    freeList = block->next;
+    used++;
+    return block;
+  }
+
+  void deallocate(void *p)
+  {
+    FreeBlock *block = static_cast<FreeBlock *>(p);
+    block->next = freeList;
+    freeList = block;
+    used--;
+  }
+
+  // Number of blocks currently handed out
+  size_t inUse() const { return used; }
+
+  // Number of blocks in all slabs (handed out or free)
+  size_t capacity() const { return slabs.size() * blocksPerSlab; }
+
+private:
+  struct FreeBlock
+  {
+    FreeBlock *next;
+  };
+
+  void grow()
+  {
+    // Round blocks up so that each one stays suitably aligned.
+    size_t stride = (blockSize + sizeof(double) - 1) & ~(sizeof(double) - 1);
+    char *slab = static_cast<char *>(malloc(stride * blocksPerSlab));
+    if (slab == NULL)
+      throw std::bad_alloc();
+    slabs.push_back(slab);
+    for (size_t i = blocksPerSlab; i > 0; i--) {
+      FreeBlock *block = reinterpret_cast<FreeBlock *>(slab + (i - 1) * stride);
+      block->next = freeList;
+      freeList = block;
+    }
+  }
+
+  const size_t blockSize;
+  const size_t blocksPerSlab;
+  FreeBlock *freeList;
+  size_t used;
+  std::vector<char *> slabs;
+
+  SlabPool(const SlabPool&);
+  SlabPool& operator = (const SlabPool&);
+};
+
+
+// A SlabPool sized for objects of type T. Objects are created with
+// placement new on allocate() and released with destroy(), e.g.
+//
+//   Task *task = new (taskPool.allocate()) Task(...);
+//   ...
+//   taskPool.destroy(task);
+template <typename T>
+class ObjectPool : public SlabPool
+{
+public:
+  ObjectPool(size_t blocksPerSlab = 256)
+    : SlabPool(sizeof(T), blocksPerSlab) {}
+
+  void destroy(T *t)
+  {
+    t->~T();
+    deallocate(t);
+  }
+};
+
+
+// A set of SlabPools keyed by block size, for containers whose node
+// types are only known to their allocators (see PoolAllocator).
+class SlabPools
+{
+public:
+  SlabPools() {}
+
+  ~SlabPools()
+  {
+    for (Map::iterator it = pools.begin(); it != pools.end(); ++it)
+      delete it->second;
+  }
+
+  SlabPool * get(size_t blockSize)
+  {
+    SlabPool *&pool = pools[blockSize];
+    if (pool == NULL)
+      pool = new SlabPool(blockSize);
+    return pool;
+  }
+
+  size_t inUse() const
+  {
+    size_t total = 0;
+    for (Map::const_iterator it = pools.begin(); it != pools.end(); ++it)
+      total += it->second->inUse();
+    return total;
+  }
+
+  size_t capacity() const
+  {
+    size_t total = 0;
+    for (Map::const_iterator it = pools.begin(); it != pools.end(); ++it)
+      total += it->second->capacity();
+    return total;
+  }
+
+private:
+  typedef std::map<size_t, SlabPool *> Map;
+  Map pools;
+
+  SlabPools(const SlabPools&);
+  SlabPools& operator = (const SlabPools&);
+};
+
+
+// An STL allocator that takes single objects (i.e. the nodes of
+// node-based containers) from a SlabPools and anything bigger (e.g.
+// bucket arrays) from the heap. A default-constructed PoolAllocator
+// just uses the heap.
+template <typename T>
+class PoolAllocator
+{
+public:
+  typedef T value_type;
+  typedef T *pointer;
+  typedef const T *const_pointer;
+  typedef T &reference;
+  typedef const T &const_reference;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+
+  template <typename U>
+  struct rebind
+  {
+    typedef PoolAllocator<U> other;
+  };
+
+  PoolAllocator(SlabPools *_pools = NULL) : pools(_pools), pool(NULL) {}
+
+  template <typename U>
+  PoolAllocator(const PoolAllocator<U>& that)
+    : pools(that.pools), pool(NULL) {}
+
+  pointer address(reference r) const { return &r; }
+  const_pointer address(const_reference r) const { return &r; }
+
+  pointer allocate(size_type n, const void * = 0)
+  {
+    if (n == 1 && pools != NULL) {
+      if (pool == NULL)
+        pool = pools->get(sizeof(T));
+      return static_cast<pointer>(pool->allocate());
+    }
+    return static_cast<pointer>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(pointer p, size_type n)
+  {
+    if (n == 1 && pools != NULL) {
+      if (pool == NULL)
+        pool = pools->get(sizeof(T));
+      pool->deallocate(p);
+    } else {
+      ::operator delete(p);
+    }
+  }
+
+  size_type max_size() const { return size_t(-1) / sizeof(T); }
+
+  void construct(pointer p, const T& t) { new (p) T(t); }
+  void destroy(pointer p) { p->~T(); }
+
+  template <typename U>
+  bool operator == (const PoolAllocator<U>& that) const
+  {
+    return pools == that.pools;
+  }
+
+  template <typename U>
+  bool operator != (const PoolAllocator<U>& that) const
+  {
+    return pools != that.pools;
+  }
+
+  SlabPools *pools;
+
+private:
+  SlabPool *pool; // Cached pools->get(sizeof(T))
+};
+
+}} /* namespace */
+
+#endif /* __POOL_HPP__ */
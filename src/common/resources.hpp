@@ -1,6 +1,19 @@
 #ifndef __RESOURCES_HPP__
 #define __RESOURCES_HPP__
 
+#include <stdint.h>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "params.hpp"
+#include "string_utils.hpp"
+
+
 namespace mesos { namespace internal {
 
 // Some memory unit constants.
@@ -8,44 +21,232 @@ const int32_t Megabyte = 1;
 const int32_t Gigabyte = 1024 * Megabyte;
 
 
-// A resource vector.
+// Resource dimensions. The ones below are always registered; others can
+// be registered by name at startup (see registerResourceDimensions), up
+// to MAX_RESOURCE_DIMENSIONS in total.
+const int MAX_RESOURCE_DIMENSIONS = 8;
+
+const int CPUS = 0;
+const int MEM = 1;  // Megabytes
+const int DISK = 2; // Megabytes
+const int NET = 3;  // Megabits per second of network bandwidth
+
+
+// Names of the registered resource dimensions, indexed by dimension.
+// These are also the names of the params that resources are sent in.
+inline std::vector<std::string> builtinResourceDimensions()
+{
+  std::vector<std::string> names;
+  names.push_back("cpus");
+  names.push_back("mem");
+  names.push_back("disk");
+  names.push_back("net");
+  return names;
+}
+
+
+// (Initialized by a function call so that the first processes to use it
+// from different threads can't race on filling it in.)
+inline std::vector<std::string>& resourceDimensions()
+{
+  static std::vector<std::string> names = builtinResourceDimensions();
+  return names;
+}
+
+
+// Register a resource dimension (if there isn't one with this name
+// already) and return its index. This must be done before any
+// processes that use resources are started.
+inline int registerResourceDimension(const std::string& name)
+{
+  std::vector<std::string>& names = resourceDimensions();
+  for (size_t i = 0; i < names.size(); i++)
+    if (names[i] == name)
+      return i;
+  CHECK(names.size() < (size_t) MAX_RESOURCE_DIMENSIONS)
+    << "Too many resource dimensions to register " << name;
+  names.push_back(name);
+  return names.size() - 1;
+}
+
+
+// Register every dimension in a comma-separated list of names (the
+// value of the resource_dimensions option). The master and its slaves
+// need to be given the same list.
+inline void registerResourceDimensions(const std::string& list)
+{
+  std::vector<std::string> names;
+  StringUtils::split(list, ",", &names);
+  for (size_t i = 0; i < names.size(); i++) {
+    std::string name = StringUtils::trim(names[i]);
+    if (name != "")
+      registerResourceDimension(name);
+  }
+}
+
+
+// A resource vector. Values are kept in a fixed-size array so that the
+// arithmetic below is a few straight-line loops the compiler can
+// vectorize; dimensions that aren't registered are always 0.
 struct Resources {
-  int32_t cpus;
-  int32_t mem;
+  int32_t values[MAX_RESOURCE_DIMENSIONS];
+
+  Resources()
+  {
+    for (int i = 0; i < MAX_RESOURCE_DIMENSIONS; i++)
+      values[i] = 0;
+  }
+
+  Resources(int32_t cpus, int32_t mem)
+  {
+    for (int i = 0; i < MAX_RESOURCE_DIMENSIONS; i++)
+      values[i] = 0;
+    values[CPUS] = cpus;
+    values[MEM] = mem;
+  }
+
+  int32_t& operator [] (int dimension)
+  {
+    return values[dimension];
+  }
+
+  const int32_t& operator [] (int dimension) const
+  {
+    return values[dimension];
+  }
 
-  Resources(): cpus(0), mem(0) {}
-  
-  Resources(int32_t _cpus, int32_t _mem): cpus(_cpus), mem(_mem) {}
-  
   Resources operator + (const Resources& r) const
   {
-    return Resources(cpus + r.cpus, mem + r.mem);
+    Resources sum(*this);
+    sum += r;
+    return sum;
   }
-  
+
   Resources operator - (const Resources& r) const
   {
-    return Resources(cpus - r.cpus, mem - r.mem);
+    Resources difference(*this);
+    difference -= r;
+    return difference;
   }
-  
+
   Resources& operator += (const Resources& r)
   {
-    cpus += r.cpus;
-    mem += r.mem;
+    for (int i = 0; i < MAX_RESOURCE_DIMENSIONS; i++)
+      values[i] += r.values[i];
     return *this;
   }
 
   Resources& operator -= (const Resources& r)
   {
-    cpus -= r.cpus;
-    mem -= r.mem;
+    for (int i = 0; i < MAX_RESOURCE_DIMENSIONS; i++)
+      values[i] -= r.values[i];
     return *this;
   }
+
+  bool operator == (const Resources& r) const
+  {
+    bool equal = true;
+    for (int i = 0; i < MAX_RESOURCE_DIMENSIONS; i++)
+      equal &= values[i] == r.values[i];
+    return equal;
+  }
+
+  bool operator != (const Resources& r) const
+  {
+    return !(*this == r);
+  }
+
+  // Whether every dimension is at most as large as in r
+  bool fitsIn(const Resources& r) const
+  {
+    bool fits = true;
+    for (int i = 0; i < MAX_RESOURCE_DIMENSIONS; i++)
+      fits &= values[i] <= r.values[i];
+    return fits;
+  }
+
+  // Whether some dimension is positive
+  bool anyPositive() const
+  {
+    bool positive = false;
+    for (int i = 0; i < MAX_RESOURCE_DIMENSIONS; i++)
+      positive |= values[i] > 0;
+    return positive;
+  }
+
+  // Whether some dimension is negative
+  bool anyNegative() const
+  {
+    bool negative = false;
+    for (int i = 0; i < MAX_RESOURCE_DIMENSIONS; i++)
+      negative |= values[i] < 0;
+    return negative;
+  }
+
+  // The largest share of any dimension of total that these resources
+  // make up (dimensions that total has none of count as having 1)
+  double dominantShare(const Resources& total) const
+  {
+    double share = 0;
+    for (int i = 0; i < MAX_RESOURCE_DIMENSIONS; i++) {
+      double dimensionShare =
+        values[i] / (double) (total.values[i] > 0 ? total.values[i] : 1);
+      share = dimensionShare > share ? dimensionShare : share;
+    }
+    return share;
+  }
 };
 
 
+// Read resources from params named after their dimensions. Missing cpus
+// and mem are -1 (so that they fail validation); other missing
+// dimensions are 0.
+inline Resources paramsToResources(const Params& params)
+{
+  const std::vector<std::string>& names = resourceDimensions();
+  Resources resources;
+  for (size_t i = 0; i < names.size(); i++) {
+    int32_t missing = (i == (size_t) CPUS || i == (size_t) MEM) ? -1 : 0;
+    resources[i] = params.getInt32(names[i], missing);
+  }
+  return resources;
+}
+
+
+// Set a param for every registered dimension of some resources.
+inline void resourcesToParams(const Resources& resources, Params *params)
+{
+  const std::vector<std::string>& names = resourceDimensions();
+  for (size_t i = 0; i < names.size(); i++)
+    params->set(names[i], resources[i]);
+}
+
+
+// Describe the dimensions other than cpus and mem that some resources
+// have any of, e.g. "200 disk, 10 net" (the web UIs show cpus and mem
+// on their own).
+inline std::string otherResourcesString(const Resources& res)
+{
+  std::ostringstream out;
+  const std::vector<std::string>& names = resourceDimensions();
+  for (size_t i = MEM + 1; i < names.size(); i++) {
+    if (res[i] != 0) {
+      if (out.tellp() > 0)
+        out << ", ";
+      out << res[i] << " " << names[i];
+    }
+  }
+  return out.str();
+}
+
+
 inline std::ostream& operator << (std::ostream& stream, const Resources& res)
 {
-  stream << "<" << res.cpus << " CPUs, " << res.mem << " MEM>";
+  stream << "<" << res[CPUS] << " CPUs, " << res[MEM] << " MEM";
+  std::string other = otherResourcesString(res);
+  if (other != "")
+    stream << ", " << other;
+  stream << ">";
   return stream;
 }
 
@@ -1,6 +1,7 @@
 #ifndef __EVENT_WRITER_HPP__
 #define __EVENT_WRITER_HPP__
 
+#include <sstream>
 #include <string>
 
 #include "configurator/configurator.hpp"
@@ -19,6 +20,23 @@ using mesos::FrameworkID;
 using mesos::TaskState;
 using mesos::internal::Resources;
 
+// Format each registered dimension of some resources as a name/value
+// pair for an event log, e.g. cpus:1,mem:1024,... for an empty quote
+// and a separator of ":".
+inline string resourcesString(const Resources& res, const string& quote,
+                              const string& separator)
+{
+  ostringstream out;
+  const vector<string>& names = resourceDimensions();
+  for (size_t i = 0; i < names.size(); i++) {
+    if (i > 0)
+      out << ",";
+    out << quote << names[i] << separator << res[i] << quote;
+  }
+  return out.str();
+}
+
+
 class EventWriter {
 public:
   virtual ~EventWriter() {}
@@ -37,7 +37,7 @@ int FileEventWriter::logTaskCreated(TaskID tid, FrameworkID fwid, SlaveID sid,
             << "taskid:" << tid << ","
             << "fwid:" << fwid << ","
             << "sid:" << sid << ","
-            << "resources:{cpus:" << resVec.cpus << ",mem:" << resVec.mem << "}"
+            << "resources:{" << resourcesString(resVec, "", ":") << "}"
           << "}" << endl;
 
   return 0;
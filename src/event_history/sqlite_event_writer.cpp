@@ -67,10 +67,7 @@ int SqlLiteEventWriter::logTaskCreated(TaskID tid, FrameworkID fwid,
      << "\"" << sid << "\"" << ","
      << "\"" << webuiUrl << "\"" << ","
      << DateUtils::currentDateInMicro() << ","
-     << "'{"
-       << "\"cpus\":\"" << resVec.cpus << "\","
-       << "\"mem\":\"" << resVec.mem << "\""
-     << "}'"
+     << "'{" << resourcesString(resVec, "\"", "\":\"") << "}'"
      << ")" << endl;
   DLOG(INFO) << "executing " << ss.str() << endl;
   char *errMsg = 0;
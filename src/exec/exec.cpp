@@ -60,7 +60,7 @@ protected:
   void operator() ()
   {
     link(slave);
-    send(slave, pack<E2S_REGISTER_EXECUTOR>(fid));
+    send(slave, pack<E2S_REGISTER_EXECUTOR>(fid, MESOS_CAPABILITIES));
     while(true) {
       // TODO(benh): Is there a better way to architect this code? In
       // particular, if the executor blocks in a callback, we can't
@@ -78,7 +78,10 @@ protected:
           string host;
           string fwName;
           string args;
-          tie(sid, host, fwName, args) = unpack<S2E_REGISTER_REPLY>(body());
+          int32_t capabilities;
+          tie(sid, host, fwName, args, capabilities) =
+            unpack<S2E_REGISTER_REPLY>(body());
+          recordCapabilities(slave, capabilities);
           ExecutorArgs execArg(sid, host, fid, fwName, args);
           invoke(bind(&Executor::init, executor, driver, ref(execArg)));
           break;
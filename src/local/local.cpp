@@ -52,6 +52,10 @@ static MasterDetector *detector = NULL;
 void registerOptions(Configurator* conf)
 {
   conf->addOption<int>("slaves", 's', "Number of slaves", 1);
+  conf->addOption<string>("resource_dimensions",
+                          "Comma-separated names of resources to offer\n"
+                          "besides cpus, mem, disk and net (e.g. gpus);\n"
+                          "slaves take their amounts as options too");
   EventLogger::registerOptions(conf);
   Logging::registerOptions(conf);
   Master::registerOptions(conf);
@@ -88,6 +92,8 @@ PID launch(const Params& conf, bool initLogging)
       google::SetStderrLogging(google::INFO);
   }
 
+  registerResourceDimensions(conf.get<string>("resource_dimensions", ""));
+
   evLogger = new EventLogger(conf);
 
   master = new Master(conf, evLogger);
@@ -27,7 +27,13 @@ public:
 
   virtual void offersRevived(Framework *framework) {}
 
+  virtual void filtersExpired(Framework *framework,
+                              const std::vector<Slave *>& slaves) {}
+
   virtual void timerTick() {}
+
+  // Add any allocator statistics to a snapshot of the master's state.
+  virtual void addStatistics(state::MasterState *state) {}
 };
 
 }}} /* namespace */
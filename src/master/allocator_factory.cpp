@@ -1,4 +1,5 @@
 #include "allocator_factory.hpp"
+#include "drf_allocator.hpp"
 #include "simple_allocator.hpp"
 
 using namespace mesos::internal::master;
@@ -6,4 +7,5 @@ using namespace mesos::internal::master;
 DEFINE_FACTORY(Allocator, Master *)
 {
   registerClass<SimpleAllocator>("simple");
+  registerClass<DrfAllocator>("drf");
 }
@@ -0,0 +1,110 @@
+#include <glog/logging.h>
+
+#include "drf_allocator.hpp"
+
+
+using namespace mesos;
+using namespace mesos::internal;
+using namespace mesos::internal::master;
+
+
+void DrfAllocator::frameworkAdded(Framework* framework)
+{
+  reindex(framework);
+  SimpleAllocator::frameworkAdded(framework);
+}
+
+
+void DrfAllocator::frameworkRemoved(Framework* framework)
+{
+  unindex(framework);
+  SimpleAllocator::frameworkRemoved(framework);
+}
+
+
+void DrfAllocator::taskAdded(Task* task)
+{
+  Framework* framework = master->lookupFramework(task->frameworkId);
+  if (framework != NULL)
+    reindex(framework);
+  SimpleAllocator::taskAdded(task);
+}
+
+
+void DrfAllocator::taskRemoved(Task* task, TaskRemovalReason reason)
+{
+  Framework* framework = master->lookupFramework(task->frameworkId);
+  if (framework != NULL)
+    reindex(framework);
+  SimpleAllocator::taskRemoved(task, reason);
+}
+
+
+void DrfAllocator::offerReturned(SlotOffer* offer,
+                                 OfferReturnReason reason,
+                                 const vector<SlaveResources>& resLeft)
+{
+  Framework* framework = master->lookupFramework(offer->frameworkId);
+  if (framework != NULL)
+    reindex(framework);
+  SimpleAllocator::offerReturned(offer, reason, resLeft);
+}
+
+
+void DrfAllocator::offerMade(Framework* framework)
+{
+  reindex(framework);
+}
+
+
+vector<Framework*> DrfAllocator::getAllocationOrdering()
+{
+  if (totalResources != indexedTotal)
+    rebuildIndex();
+
+  vector<Framework*> frameworks;
+  frameworks.reserve(index.size());
+  foreach (const ShareKey& key, index)
+    frameworks.push_back(key.framework);
+  return frameworks;
+}
+
+
+double DrfAllocator::dominantShare(Framework* framework)
+{
+  return framework->resources.dominantShare(indexedTotal);
+}
+
+
+void DrfAllocator::reindex(Framework* framework)
+{
+  unindex(framework);
+  if (framework->active) {
+    ShareIndex::iterator it =
+      index.insert(ShareKey(dominantShare(framework), framework)).first;
+    positions[framework] = it;
+  }
+}
+
+
+void DrfAllocator::unindex(Framework* framework)
+{
+  unordered_map<Framework*, ShareIndex::iterator>::iterator it =
+    positions.find(framework);
+  if (it != positions.end()) {
+    index.erase(it->second);
+    positions.erase(it);
+  }
+}
+
+
+void DrfAllocator::rebuildIndex()
+{
+  VLOG(1) << "Rebuilding share index for total resources " << totalResources;
+  indexedTotal = totalResources;
+  vector<Framework*> frameworks;
+  foreachpair (Framework* framework, _, positions)
+    frameworks.push_back(framework);
+  foreach (Framework* framework, frameworks)
+    reindex(framework);
+}
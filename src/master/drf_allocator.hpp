@@ -0,0 +1,94 @@
+#ifndef __DRF_ALLOCATOR_HPP__
+#define __DRF_ALLOCATOR_HPP__
+
+#include <set>
+#include <vector>
+
+#include <boost/unordered_map.hpp>
+
+#include "simple_allocator.hpp"
+
+#include "common/resources.hpp"
+
+
+namespace mesos { namespace internal { namespace master {
+
+using std::set;
+using std::vector;
+using boost::unordered_map;
+
+// An allocator that offers resources in the same way as SimpleAllocator
+// but keeps frameworks in an index ordered by dominant share, which is
+// updated as each framework's resources change (O(log F) per change)
+// instead of re-sorting every framework whenever offers are made.
+class DrfAllocator : public SimpleAllocator
+{
+  // A framework's position in the index: the dominant share it was
+  // indexed with, plus its ID to make the ordering deterministic.
+  struct ShareKey
+  {
+    double share;
+    FrameworkID id;
+    Framework* framework;
+
+    ShareKey(double _share, Framework* _framework)
+      : share(_share), id(_framework->id), framework(_framework) {}
+
+    bool operator < (const ShareKey& that) const
+    {
+      if (share == that.share)
+        return id < that.id;
+      else
+        return share < that.share;
+    }
+  };
+
+  typedef set<ShareKey> ShareIndex;
+
+  ShareIndex index;
+  unordered_map<Framework*, ShareIndex::iterator> positions;
+
+  // Total resources the current shares were computed against; when the
+  // cluster grows or shrinks every share changes and the index is rebuilt
+  Resources indexedTotal;
+
+public:
+  DrfAllocator(Master* _master): SimpleAllocator(_master) {}
+
+  ~DrfAllocator() {}
+
+  virtual void frameworkAdded(Framework* framework);
+
+  virtual void frameworkRemoved(Framework* framework);
+
+  virtual void taskAdded(Task* task);
+
+  virtual void taskRemoved(Task* task, TaskRemovalReason reason);
+
+  virtual void offerReturned(SlotOffer* offer,
+                             OfferReturnReason reason,
+                             const vector<SlaveResources>& resourcesLeft);
+
+protected:
+  virtual vector<Framework*> getAllocationOrdering();
+
+  virtual void offerMade(Framework* framework);
+
+private:
+  // Compute a framework's dominant share of the cluster's resources
+  double dominantShare(Framework* framework);
+
+  // Move a framework to its current position in the index (or drop it
+  // from the index if it's no longer active)
+  void reindex(Framework* framework);
+
+  // Remove a framework from the index, if it's in it
+  void unindex(Framework* framework);
+
+  // Recompute every framework's share against the current total resources
+  void rebuildIndex();
+};
+
+}}} /* namespace */
+
+#endif /* __DRF_ALLOCATOR_HPP__ */
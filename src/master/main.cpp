@@ -35,6 +35,10 @@ int main(int argc, char **argv)
   conf.addOption<string>("url", 'u', "URL used for leader election");
   conf.addOption<int>("port", 'p', "Port to listen on", 5050);
   conf.addOption<string>("ip", "IP address to listen on");
+  conf.addOption<string>("resource_dimensions",
+                         "Comma-separated names of resources to offer\n"
+                         "besides cpus, mem, disk and net (e.g. gpus);\n"
+                         "slaves take their amounts as options too");
 #ifdef MESOS_WEBUI
   conf.addOption<int>("webui_port", 'w', "Web UI port", 8080);
 #endif
@@ -57,6 +61,8 @@ int main(int argc, char **argv)
 
   Logging::init(argv[0], params);
 
+  registerResourceDimensions(params.get("resource_dimensions", ""));
+
   LOG(INFO) << "Creating event logger." << endl;
   EventLogger evLogger(params);
 
@@ -81,7 +87,7 @@ int main(int argc, char **argv)
   MasterDetector *detector = MasterDetector::create(url, pid, true, quiet);
 
 #ifdef MESOS_WEBUI
-  startMasterWebUI(pid, params);
+  startMasterWebUI(master, params);
 #endif
   
   Process::wait(pid);
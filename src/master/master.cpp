@@ -27,6 +27,8 @@ using boost::lexical_cast;
 using boost::unordered_map;
 using boost::unordered_set;
 
+using process::tuples::serializer;
+
 using namespace mesos;
 using namespace mesos::internal;
 using namespace mesos::internal::master;
@@ -122,18 +124,28 @@ public:
 
 
 Master::Master(EventLogger* evLogger_)
-  : evLogger(evLogger_), nextFrameworkId(0), nextSlaveId(0), 
-    nextSlotOfferId(0)
+  : evLogger(evLogger_), broadcastMessagesSaved(0), statusUpdateBatches(0),
+    batchedStatusUpdates(0), cachedExecutorInfos(0), executorInfoBytesSaved(0),
+    nextFrameworkId(0), nextSlaveId(0), nextSlotOfferId(0),
+    allocationDeadline(0), publishedState(NULL), publishDeadline(0),
+    publishInterval(DEFAULT_STATE_PUBLISH_INTERVAL)
 {
   allocatorType = "simple";
+  pthread_mutex_init(&publishedStateMutex, NULL);
 }
 
 
 Master::Master(const Params& conf_, EventLogger* evLogger_)
-  : conf(conf_), evLogger(evLogger_), nextFrameworkId(0), nextSlaveId(0), 
-    nextSlotOfferId(0)
+  : conf(conf_), evLogger(evLogger_), broadcastMessagesSaved(0),
+    statusUpdateBatches(0), batchedStatusUpdates(0), cachedExecutorInfos(0),
+    executorInfoBytesSaved(0), nextFrameworkId(0), nextSlaveId(0),
+    nextSlotOfferId(0), allocationDeadline(0), publishedState(NULL),
+    publishDeadline(0)
 {
   allocatorType = conf.get("allocator", "simple");
+  publishInterval = conf.get<double>("state_publish_interval",
+                                     DEFAULT_STATE_PUBLISH_INTERVAL);
+  pthread_mutex_init(&publishedStateMutex, NULL);
 }
                    
 
@@ -145,7 +157,7 @@ Master::~Master()
 
   foreachpair (_, Framework *framework, frameworks) {
     foreachpair(_, Task *task, framework->tasks)
-      delete task;
+      taskPool.destroy(task);
     delete framework;
   }
 
@@ -154,55 +166,115 @@ Master::~Master()
   }
 
   foreachpair (_, SlotOffer *offer, slotOffers) {
-    delete offer;
+    offerPool.destroy(offer);
   }
+
+  delete publishedState;
+  pthread_mutex_destroy(&publishedStateMutex);
 }
 
 
 void Master::registerOptions(Configurator* conf)
 {
-  conf->addOption<string>("allocator", 'a', "Allocation module name", "simple");
+  conf->addOption<string>("allocator", 'a',
+                          "Allocation module name (simple or drf)",
+                          "simple");
+  conf->addOption<double>("offer_batch_interval",
+                          "Seconds to collect freed resources for before\n"
+                          "offering them (0 to offer them right away)",
+                          0);
   conf->addOption<bool>("root_submissions",
                         "Can root submit frameworks?",
                         true);
+  conf->addOption<double>("state_publish_interval",
+                          "Most seconds the state shown by the web UI\n"
+                          "may be out of date by",
+                          DEFAULT_STATE_PUBLISH_INTERVAL);
 }
 
 
 state::MasterState * Master::getState()
+{
+  // The copy only takes references to the slaves and frameworks.
+  Lock lock(&publishedStateMutex);
+  if (publishedState == NULL)
+    return new state::MasterState();
+  return new state::MasterState(*publishedState);
+}
+
+
+void Master::publishState()
 {
   std::ostringstream oss;
   oss << self();
   state::MasterState *state =
     new state::MasterState(BUILD_DATE, BUILD_USER, oss.str());
 
+  // Slaves don't change once registered, and frameworks clear what was
+  // published about them whenever their tasks or offers change.
   foreachpair (_, Slave *s, slaves) {
-    state::Slave *slave = new state::Slave(s->id, s->hostname, s->webUIUrl,
-        s->resources.cpus, s->resources.mem, s->connectTime);
-    state->slaves.push_back(slave);
+    if (!s->published) {
+      state::Slave *slave = new state::Slave(s->id, s->hostname,
+          s->webUIUrl, s->resources[CPUS], s->resources[MEM], s->connectTime);
+      slave->other_resources = otherResourcesString(s->resources);
+      s->published.reset(slave);
+    }
+    state->addSlave(s->published);
   }
 
   foreachpair (_, Framework *f, frameworks) {
-    state::Framework *framework = new state::Framework(f->id, f->user,
-        f->name, f->executorInfo.uri, f->resources.cpus, f->resources.mem,
-        f->connectTime);
-    state->frameworks.push_back(framework);
-    foreachpair (_, Task *t, f->tasks) {
-      state::Task *task = new state::Task(t->id, t->name, t->frameworkId,
-          t->slaveId, t->state, t->resources.cpus, t->resources.mem);
-      framework->tasks.push_back(task);
-    }
-    foreach (SlotOffer *o, f->slotOffers) {
-      state::SlotOffer *offer = new state::SlotOffer(o->id, o->frameworkId);
-      foreach (SlaveResources &r, o->resources) {
-        state::SlaveResources *resources = new state::SlaveResources(
-            r.slave->id, r.resources.cpus, r.resources.mem);
-        offer->resources.push_back(resources);
+    if (!f->published) {
+      state::Framework *framework = new state::Framework(f->id, f->user,
+          f->name, f->executorInfo.uri, f->resources[CPUS], f->resources[MEM],
+          f->connectTime);
+      framework->other_resources = otherResourcesString(f->resources);
+      f->published.reset(framework);
+      foreachpair (_, Task *t, f->tasks) {
+        state::Task *task = new state::Task(t->id, t->name, t->frameworkId,
+            t->slaveId, t->state, t->resources[CPUS], t->resources[MEM]);
+        framework->tasks.push_back(task);
+      }
+      foreach (SlotOffer *o, f->slotOffers) {
+        state::SlotOffer *offer = new state::SlotOffer(o->id, o->frameworkId);
+        foreach (SlaveResources &r, o->resources) {
+          state::SlaveResources *resources = new state::SlaveResources(
+              r.slave->id, r.resources[CPUS], r.resources[MEM]);
+          offer->resources.push_back(resources);
+        }
+        framework->offers.push_back(offer);
       }
-      framework->offers.push_back(offer);
     }
+    state->addFramework(f->published);
   }
-  
-  return state;
+
+  allocator->addStatistics(state);
+
+  state->task_pool_in_use = taskPool.inUse();
+  state->task_pool_capacity = taskPool.capacity();
+  state->offer_pool_in_use = offerPool.inUse();
+  state->offer_pool_capacity = offerPool.capacity();
+  state->offer_set_node_pool_in_use = offerSetNodePools.inUse();
+  state->offer_set_node_pool_capacity = offerSetNodePools.capacity();
+  state->broadcast_messages_saved = broadcastMessagesSaved;
+  state->status_update_batches = statusUpdateBatches;
+  state->batched_status_updates = batchedStatusUpdates;
+  state->cached_executor_infos = cachedExecutorInfos;
+  state->executor_info_bytes_saved = executorInfoBytesSaved;
+  state->connections_made = Connections::made();
+  state->connections_reused = Connections::reused();
+  state->messages_written = Connections::messages();
+  state->bytes_written = Connections::bytes();
+  state->socket_writes = Connections::writes();
+
+  // Readers' copies of the old state keep what they share with it.
+  state::MasterState *old = publishedState;
+  {
+    Lock lock(&publishedStateMutex);
+    publishedState = state;
+  }
+  delete old;
+
+  publishDeadline = 0;
 }
 
 
@@ -230,8 +302,18 @@ vector<Slave *> Master::getActiveSlaves()
 
 Framework * Master::lookupFramework(FrameworkID fid)
 {
-  unordered_map<FrameworkID, Framework *>::iterator it =
-    frameworks.find(fid);
+  Interner::Handle handle;
+  if (frameworkIds.lookup(fid, &handle))
+    return lookupFramework(handle);
+  else
+    return NULL;
+}
+
+
+Framework * Master::lookupFramework(Interner::Handle handle)
+{
+  unordered_map<Interner::Handle, Framework *>::iterator it =
+    frameworks.find(handle);
   if (it != frameworks.end())
     return it->second;
   else
@@ -241,8 +323,18 @@ Framework * Master::lookupFramework(FrameworkID fid)
 
 Slave * Master::lookupSlave(SlaveID sid)
 {
-  unordered_map<SlaveID, Slave *>::iterator it =
-    slaves.find(sid);
+  Interner::Handle handle;
+  if (slaveIds.lookup(sid, &handle))
+    return lookupSlave(handle);
+  else
+    return NULL;
+}
+
+
+Slave * Master::lookupSlave(Interner::Handle handle)
+{
+  unordered_map<Interner::Handle, Slave *>::iterator it =
+    slaves.find(handle);
   if (it != slaves.end())
     return it->second;
   else
@@ -252,9 +344,20 @@ Slave * Master::lookupSlave(SlaveID sid)
 
 SlotOffer * Master::lookupSlotOffer(OfferID oid)
 {
-  unordered_map<OfferID, SlotOffer *>::iterator it =
-    slotOffers.find(oid);
-  if (it != slotOffers.end()) 
+  // Offer IDs are formatted as MASTERID-N (see makeOffer), so we look
+  // the offer up by N and then check that the rest of the ID matches.
+  size_t index = oid.rfind('-');
+  if (index == string::npos)
+    return NULL;
+
+  char *end;
+  int64_t number = strtoll(oid.c_str() + index + 1, &end, 10);
+  if (*end != '\0')
+    return NULL;
+
+  unordered_map<int64_t, SlotOffer *>::iterator it =
+    slotOffers.find(number);
+  if (it != slotOffers.end() && it->second->id == oid)
     return it->second;
   else
     return NULL;
@@ -284,8 +387,23 @@ void Master::operator () ()
   link(spawn(new AllocatorTimer(self())));
   //link(spawn(new SharesPrinter(self())));
 
+  publishState();
+
   while (true) {
-    switch (receive()) {
+    // Wait no longer than until the next allocation or publication of
+    // our state is due, if any.
+    double deadline = allocationDeadline;
+    if (publishDeadline != 0 && (deadline == 0 || publishDeadline < deadline))
+      deadline = publishDeadline;
+    double timeout = 0;
+    if (deadline != 0)
+      timeout = max(deadline - elapsed(), 0.0001);
+
+    switch (receive(timeout)) {
+
+    case PROCESS_TIMEOUT: {
+      break;
+    }
 
     case NEW_MASTER_DETECTED: {
       // TODO(benh): We might have been the master, but then got
@@ -302,10 +420,12 @@ void Master::operator () ()
 
     case F2M_REGISTER_FRAMEWORK: {
       FrameworkID fid = newFrameworkId();
-      Framework *framework = new Framework(from(), fid, elapsed());
+      Framework *framework =
+        new Framework(from(), fid, elapsed(), &offerSetNodePools);
+      int32_t capabilities;
 
-      tie(framework->name, framework->user, framework->executorInfo) =
-        unpack<F2M_REGISTER_FRAMEWORK>(body());
+      tie(framework->name, framework->user, framework->executorInfo,
+          capabilities) = unpack<F2M_REGISTER_FRAMEWORK>(body());
 
       LOG(INFO) << "Registering " << framework << " at " << framework->pid;
 
@@ -329,6 +449,7 @@ void Master::operator () ()
 
       evLogger->logFrameworkRegistered(fid, framework->user);
       LOG(INFO) << "Logged framework registered to event history" << endl;
+      recordCapabilities(framework->pid, capabilities);
       addFramework(framework);
       break;
     }
@@ -339,8 +460,9 @@ void Master::operator () ()
       string user;
       ExecutorInfo executorInfo;
       int32_t generation;
+      int32_t capabilities;
 
-      tie(fid, name, user, executorInfo, generation) =
+      tie(fid, name, user, executorInfo, generation, capabilities) =
         unpack<F2M_REREGISTER_FRAMEWORK>(body());
 
       if (executorInfo.uri == "") {
@@ -358,7 +480,7 @@ void Master::operator () ()
 
       LOG(INFO) << "Re-registering framework " << fid << " at " << from();
 
-      if (frameworks.count(fid) > 0) {
+      if (lookupFramework(fid) != NULL) {
         // Using the "generation" of the scheduler allows us to keep a
         // scheduler that got partitioned but didn't die (in ZooKeeper
         // speak this means didn't lose their session) and then
@@ -370,7 +492,8 @@ void Master::operator () ()
         // know which scheduler is the correct one.
         if (generation == 0) {
           LOG(INFO) << "Framework " << fid << " failed over";
-          failoverFramework(frameworks[fid], from());
+          recordCapabilities(from(), capabilities);
+          failoverFramework(lookupFramework(fid), from());
           // TODO: Should we check whether the new scheduler has given
           // us a different framework name, user name or executor info?
         } else {
@@ -384,30 +507,42 @@ void Master::operator () ()
         // elected Mesos master to which either an existing scheduler or a
         // failed-over one is connecting. Create a Framework object and add
         // any tasks it has that have been reported by reconnecting slaves.
-        Framework *framework = new Framework(from(), fid, elapsed());
+        Framework *framework =
+          new Framework(from(), fid, elapsed(), &offerSetNodePools);
         framework->name = name;
         framework->user = user;
         framework->executorInfo = executorInfo;
+        recordCapabilities(framework->pid, capabilities);
         addFramework(framework);
-        // Add any running tasks reported by slaves for this framework.
-        foreachpair (SlaveID slaveId, Slave *slave, slaves) {
+        // Add any running tasks reported by slaves for this framework
+        // (they can only be on slaves that reported its executor).
+        foreach (Interner::Handle sid, executorSlaves[framework->handle]) {
+          Slave *slave = lookupSlave(sid);
+          CHECK(slave != NULL);
           foreachpair (_, Task *task, slave->tasks) {
-            if (framework->id == task->frameworkId) {
+            if (task->frameworkId == framework->id) {
               framework->addTask(task);
+              allocator->taskAdded(task);
             }
           }
         }
       }
 
-      CHECK(frameworks.find(fid) != frameworks.end());
-
-      // Broadcast the new framework pid to all the slaves. We have to
-      // broadcast because an executor might be running on a slave but
-      // it currently isn't running any tasks. This could be a
-      // potential scalability issue ...
-      foreachpair (_, Slave *slave, slaves) {
-        send(slave->pid, pack<M2S_UPDATE_FRAMEWORK_PID>(fid, from()));
+      Framework *framework = lookupFramework(fid);
+      CHECK(framework != NULL);
+
+      // Send the new framework pid to every slave the framework's
+      // executor has run on, since an executor might be running on a
+      // slave even if it currently isn't running any tasks.
+      const unordered_set<Interner::Handle>& sids =
+        executorSlaves[framework->handle];
+      foreach (Interner::Handle sid, sids) {
+        Slave *slave = lookupSlave(sid);
+        CHECK(slave != NULL);
+        send(slave->pid, pack<M2S_UPDATE_FRAMEWORK_PID>(
+              fid, from(), MesosProcess::capabilities(from())));
       }
+      broadcastMessagesSaved += slaves.size() - sids.size();
 
       break;
     }
@@ -496,24 +631,39 @@ void Master::operator () ()
 
     case S2M_REGISTER_SLAVE: {
       string slaveId = masterId + "-" + lexical_cast<string>(nextSlaveId++);
-      Slave *slave = new Slave(from(), slaveId, elapsed());
-      tie(slave->hostname, slave->webUIUrl, slave->resources) =
-        unpack<S2M_REGISTER_SLAVE>(body());
+      Slave *slave = new Slave(from(), slaveId, elapsed(),
+                               &offerSetNodePools);
+      int32_t capabilities;
+      vector<int32_t> otherAmounts;
+      tie(slave->hostname, slave->webUIUrl, slave->resources,
+          capabilities, otherAmounts) = unpack<S2M_REGISTER_SLAVE>(body());
+      setOtherResourceAmounts(otherAmounts, &slave->resources);
       LOG(INFO) << "Registering " << slave << " at " << slave->pid;
-      slaves[slave->id] = slave;
-      pidToSid[slave->pid] = slave->id;
+      slave->handle = slaveIds.intern(slave->id);
+      slaves[slave->handle] = slave;
+      pidToSid[slave->pid] = slave->handle;
       link(slave->pid);
+      recordCapabilities(slave->pid, capabilities);
       send(slave->pid,
-	   pack<M2S_REGISTER_REPLY>(slave->id, HEARTBEAT_INTERVAL));
+	   pack<M2S_REGISTER_REPLY>(slave->id, HEARTBEAT_INTERVAL,
+                                    MESOS_CAPABILITIES));
       allocator->slaveAdded(slave);
       break;
     }
 
     case S2M_REREGISTER_SLAVE: {
-      Slave *slave = new Slave(from(), "", elapsed());
+      Slave *slave = new Slave(from(), "", elapsed(), &offerSetNodePools);
       vector<Task> tasks;
-      tie(slave->id, slave->hostname, slave->webUIUrl,
-          slave->resources, tasks) = unpack<S2M_REREGISTER_SLAVE>(body());
+      vector<FrameworkID> executorFrameworkIds;
+      int32_t capabilities;
+      vector<int32_t> otherAmounts;
+      vector<vector<int32_t> > taskOtherAmounts;
+      tie(slave->id, slave->hostname, slave->webUIUrl, slave->resources,
+          tasks, executorFrameworkIds, capabilities, otherAmounts,
+          taskOtherAmounts) = unpack<S2M_REREGISTER_SLAVE>(body());
+      setOtherResourceAmounts(otherAmounts, &slave->resources);
+      for (size_t i = 0; i < tasks.size() && i < taskOtherAmounts.size(); i++)
+        setOtherResourceAmounts(taskOtherAmounts[i], &tasks[i].resources);
 
       if (slave->id == "") {
         slave->id = masterId + "-" + lexical_cast<string>(nextSlaveId++);
@@ -522,25 +672,45 @@ void Master::operator () ()
       }
 
       LOG(INFO) << "Re-registering " << slave << " at " << slave->pid;
-      slaves[slave->id] = slave;
-      pidToSid[slave->pid] = slave->id;
+      slave->handle = slaveIds.intern(slave->id);
+      slaves[slave->handle] = slave;
+      pidToSid[slave->pid] = slave->handle;
       link(slave->pid);
+      recordCapabilities(slave->pid, capabilities);
       send(slave->pid,
-           pack<M2S_REREGISTER_REPLY>(slave->id, HEARTBEAT_INTERVAL));
+           pack<M2S_REREGISTER_REPLY>(slave->id, HEARTBEAT_INTERVAL,
+                                      MESOS_CAPABILITIES));
 
       allocator->slaveAdded(slave);
 
       foreach (const Task &t, tasks) {
-        Task *task = new Task(t);
-        slave->addTask(task);
+        Task *task = new (taskPool.allocate()) Task(t);
 
-        // Tell this slave the current framework pid for this task.
-        Framework *framework = lookupFramework(task->frameworkId);
-        if (framework != NULL) {
+        // The framework might not have re-registered yet, but it keeps
+        // the same handle when it does.
+        Interner::Handle frameworkHandle =
+          frameworkIds.intern(task->frameworkId);
+        slave->addTask(task, frameworkHandle);
+        addExecutor(frameworkHandle, slave);
+
+        Framework *framework = lookupFramework(frameworkHandle);
+        if (framework != NULL)
           framework->addTask(task);
-          send(slave->pid, pack<M2S_UPDATE_FRAMEWORK_PID>(framework->id,
-                                                          framework->pid));
-        }
+
+        allocator->taskAdded(task);
+      }
+
+      foreach (const FrameworkID &fid, executorFrameworkIds)
+        addExecutor(frameworkIds.intern(fid), slave);
+
+      // Tell this slave the current pids of the frameworks it has
+      // executors for (once per framework rather than once per task).
+      foreach (Interner::Handle frameworkHandle, slave->executorFrameworks) {
+        Framework *framework = lookupFramework(frameworkHandle);
+        if (framework != NULL)
+          send(slave->pid, pack<M2S_UPDATE_FRAMEWORK_PID>(
+                framework->id, framework->pid,
+                MesosProcess::capabilities(framework->pid)));
       }
 
       // TODO(benh|alig): We should put a timeout on how long we keep
@@ -576,19 +746,7 @@ void Master::operator () ()
             LOG(WARNING) << "Locally ignoring duplicate message with id:" << seq();
             break;
           }
-          // Update the task state locally.
-          Task *task = slave->lookupTask(fid, tid);
-          if (task != NULL) {
-            LOG(INFO) << "Status update: " << task << " is in state " << state;
-            task->state = state;
-            evLogger->logTaskStateUpdated(tid, fid, state);
-            // Remove the task if it finished or failed
-            if (state == TASK_FINISHED || state == TASK_FAILED ||
-                state == TASK_KILLED || state == TASK_LOST) {
-              LOG(INFO) << "Removing " << task << " because it's done";
-              removeTask(task, TRR_TASK_ENDED);
-            }
-          }
+          updateTaskState(slave, framework, tid, state);
         } else {
           LOG(ERROR) << "S2M_STATUS_UPDATE error: couldn't lookup "
                      << "framework id " << fid;
@@ -600,6 +758,37 @@ void Master::operator () ()
       break;
     }
 
+    case S2M_STATUS_UPDATES: {
+      SlaveID sid;
+      FrameworkID fid;
+      vector<TaskStatus> updates;
+      tie(sid, fid, updates) = unpack<S2M_STATUS_UPDATES>(body());
+
+      if (Slave *slave = lookupSlave(sid)) {
+        if (Framework *framework = lookupFramework(fid)) {
+          // Pass on the whole batch, which the framework acknowledges
+          // at once (the slave only batches updates for frameworks
+          // that said they can take them).
+          forward(framework->pid, pack<M2F_STATUS_UPDATES>(updates));
+          if (duplicate()) {
+            LOG(WARNING) << "Locally ignoring duplicate message with id:" << seq();
+            break;
+          }
+          statusUpdateBatches++;
+          batchedStatusUpdates += updates.size();
+          foreach (const TaskStatus &update, updates)
+            updateTaskState(slave, framework, update.taskId, update.state);
+        } else {
+          LOG(ERROR) << "S2M_STATUS_UPDATES error: couldn't lookup "
+                     << "framework id " << fid;
+        }
+      } else {
+        LOG(ERROR) << "S2M_STATUS_UPDATES error: couldn't lookup slave id "
+                   << sid;
+      }
+      break;
+    }
+
     case S2M_FRAMEWORK_MESSAGE: {
       SlaveID sid;
       FrameworkID fid;
@@ -621,6 +810,11 @@ void Master::operator () ()
       tie(sid, fid, status) = unpack<S2M_LOST_EXECUTOR>(body());
       Slave *slave = lookupSlave(sid);
       if (slave != NULL) {
+        // The slave has forgotten the executor info along with the
+        // executor.
+        Interner::Handle handle;
+        if (frameworkIds.lookup(fid, &handle))
+          slave->executorInfoHashes.erase(handle);
         Framework *framework = lookupFramework(fid);
         if (framework != NULL) {
           // TODO(benh): Send the framework it's executor's exit status?
@@ -667,7 +861,7 @@ void Master::operator () ()
     }
 
     case M2M_TIMER_TICK: {
-      unordered_map<SlaveID, Slave *> slavesCopy = slaves;
+      unordered_map<Interner::Handle, Slave *> slavesCopy = slaves;
       foreachpair (_, Slave *slave, slavesCopy) {
 	if (slave->lastHeartbeat + HEARTBEAT_TIMEOUT <= elapsed()) {
 	  LOG(INFO) << slave << " missing heartbeats ... considering disconnected";
@@ -676,8 +870,7 @@ void Master::operator () ()
       }
 
       // Check which framework filters can be expired.
-      foreachpair (_, Framework *framework, frameworks)
-        framework->removeExpiredFilters(elapsed());
+      removeExpiredFilters(elapsed());
 
       // Do allocations!
       allocator->timerTick();
@@ -704,16 +897,16 @@ void Master::operator () ()
       // TODO(benh): Could we get PROCESS_EXIT from a network partition?
       LOG(INFO) << "Process exited: " << from();
       if (pidToFid.find(from()) != pidToFid.end()) {
-        FrameworkID fid = pidToFid[from()];
-        if (Framework *framework = lookupFramework(fid)) {
+        Interner::Handle handle = pidToFid[from()];
+        if (Framework *framework = lookupFramework(handle)) {
           LOG(INFO) << framework << " disconnected";
 //   	  framework->failoverTimer = new FrameworkFailoverTimer(self(), fid);
 //   	  link(spawn(framework->failoverTimer));
 	  removeFramework(framework);
         }
       } else if (pidToSid.find(from()) != pidToSid.end()) {
-        SlaveID sid = pidToSid[from()];
-        if (Slave *slave = lookupSlave(sid)) {
+        Interner::Handle handle = pidToSid[from()];
+        if (Slave *slave = lookupSlave(handle)) {
           LOG(INFO) << slave << " disconnected";
           removeSlave(slave);
         }
@@ -732,6 +925,9 @@ void Master::operator () ()
     }
 
     case M2M_GET_STATE: {
+      // Reply with our current state.
+      if (publishDeadline != 0)
+        publishState();
       send(from(), pack<M2M_GET_STATE_REPLY>(getState()));
       break;
     }
@@ -747,17 +943,59 @@ void Master::operator () ()
       LOG(ERROR) << "Received unknown MSGID " << msgid() << " from " << from();
       break;
     }
+
+    // Anything other than a timeout or a request for our state may
+    // have changed it, and so may the offers made below.
+    bool changed = msgid() != PROCESS_TIMEOUT && msgid() != M2M_GET_STATE;
+
+    if (allocationDeadline != 0 && allocationDeadline <= elapsed()) {
+      allocationDeadline = 0;
+      allocator->timerTick();
+      changed = true;
+    }
+
+    if (changed && publishDeadline == 0)
+      publishDeadline = elapsed() + publishInterval;
+
+    if (publishDeadline != 0 && publishDeadline <= elapsed())
+      publishState();
+  }
+}
+
+
+// Get the resources a task asks for, taking cpus and mem from its typed
+// fields if they were filled in (as the scheduler driver does) and
+// everything else from its params
+Resources Master::getTaskResources(const TaskDescription& t)
+{
+  if (t.cpus == -1 || t.mem == -1)
+    return paramsToResources(Params(t.params));
+
+  Resources res(t.cpus, t.mem);
+  const vector<string>& names = resourceDimensions();
+  for (size_t i = MEM + 1; i < names.size(); i++) {
+    map<string, string>::const_iterator it = t.params.find(names[i]);
+    if (it != t.params.end())
+      res[i] = lexical_cast<int32_t>(it->second);
   }
+  return res;
 }
 
 
 OfferID Master::makeOffer(Framework *framework,
                           const vector<SlaveResources>& resources)
 {
-  OfferID oid = masterId + "-" + lexical_cast<string>(nextSlotOfferId++);
-
-  SlotOffer *offer = new SlotOffer(oid, framework->id, resources);
-  slotOffers[offer->id] = offer;
+  int64_t number = nextSlotOfferId++;
+  OfferID oid = masterId + "-" + lexical_cast<string>(number);
+
+  SlotOffer *offer =
+    new (offerPool.allocate()) SlotOffer(oid, number, framework->id);
+  if (!spareOfferResources.empty()) {
+    offer->resources.swap(spareOfferResources.back());
+    spareOfferResources.pop_back();
+  }
+  offer->resources.assign(resources.begin(), resources.end());
+  slotOffers[offer->number] = offer;
   framework->addOffer(offer);
   foreach (const SlaveResources& r, resources) {
     r.slave->slotOffers.insert(offer);
@@ -768,9 +1006,10 @@ OfferID Master::makeOffer(Framework *framework,
   map<SlaveID, PID> pids;
   foreach (const SlaveResources& r, resources) {
     Params params;
-    params.set("cpus", r.resources.cpus);
-    params.set("mem", r.resources.mem);
+    resourcesToParams(r.resources, &params);
     SlaveOffer offer(r.slave->id, r.slave->hostname, params.getMap());
+    offer.cpus = r.resources[CPUS];
+    offer.mem = r.resources[MEM];
     offers.push_back(offer);
     pids[r.slave->id] = r.slave->pid;
   }
@@ -798,13 +1037,14 @@ void Master::processOfferReply(SlotOffer *offer,
 
   // Count resources in the response, and check that its tasks are valid
   unordered_map<Slave *, Resources> responseResources;
+  vector<Resources> taskResources;
+  taskResources.reserve(tasks.size());
   foreach (const TaskDescription &t, tasks) {
     // Check whether this task size is valid
-    Params params(t.params);
-    Resources res(params.getInt32("cpus", -1),
-                  params.getInt32("mem", -1));
-    if (res.cpus < MIN_CPUS || res.mem < MIN_MEM || 
-        res.cpus > MAX_CPUS || res.mem > MAX_MEM) {
+    Resources res = getTaskResources(t);
+    taskResources.push_back(res);
+    if (res[CPUS] < MIN_CPUS || res[MEM] < MIN_MEM || 
+        res[CPUS] > MAX_CPUS || res[MEM] > MAX_MEM || res.anyNegative()) {
       terminateFramework(framework, 0,
           "Invalid task size: " + lexical_cast<string>(res));
       return;
@@ -821,7 +1061,7 @@ void Master::processOfferReply(SlotOffer *offer,
   // Check that the total accepted on each slave isn't more than offered
   foreachpair (Slave *s, Resources& respRes, responseResources) {
     Resources &offRes = offerResources[s];
-    if (respRes.cpus > offRes.cpus || respRes.mem > offRes.mem) {
+    if (!respRes.fitsIn(offRes)) {
       terminateFramework(framework, 0, "Too many resources accepted");
       return;
     }
@@ -840,18 +1080,16 @@ void Master::processOfferReply(SlotOffer *offer,
   }
 
   // Launch the tasks in the response
-  foreach (const TaskDescription &t, tasks) {
-    // Record the resources in event_history
-    Params params(t.params);
-    Resources res(params.getInt32("cpus", -1),
-                  params.getInt64("mem", -1));
+  for (size_t i = 0; i < tasks.size(); i++) {
+    const TaskDescription &t = tasks[i];
 
+    // Record the resources in event_history
     Slave *slave = lookupSlave(t.slaveId);
     evLogger->logTaskCreated(t.taskId, framework->id, t.slaveId, 
-                             slave->webUIUrl, res);
+                             slave->webUIUrl, taskResources[i]);
 
     // Launch the tasks in the response
-    launchTask(framework, t);
+    launchTask(framework, t, taskResources[i]);
   }
 
   // If there are resources left on some slaves, add filters for them
@@ -861,13 +1099,13 @@ void Master::processOfferReply(SlotOffer *offer,
   foreachpair (Slave *s, Resources offRes, offerResources) {
     Resources respRes = responseResources[s];
     Resources left = offRes - respRes;
-    if (left.cpus > 0 || left.mem > 0) {
+    if (left.anyPositive()) {
       resourcesLeft.push_back(SlaveResources(s, left));
     }
-    if (timeout != 0 && respRes.cpus == 0 && respRes.mem == 0) {
+    if (timeout != 0 && respRes == Resources()) {
       LOG(INFO) << "Adding filter on " << s << " to " << framework
                 << " for  " << timeout << " seconds";
-      framework->slaveFilter[s] = expiry;
+      addFilter(framework, s, expiry);
     }
   }
   
@@ -876,30 +1114,58 @@ void Master::processOfferReply(SlotOffer *offer,
 }
 
 
-void Master::launchTask(Framework *framework, const TaskDescription& t)
+void Master::launchTask(Framework *framework, const TaskDescription& t,
+                        const Resources& res)
 {
-  Params params(t.params);
-  Resources res(params.getInt32("cpus", -1),
-                params.getInt32("mem", -1));
-
   // The invariant right now is that launchTask is called only for
   // TaskDescriptions where the slave is still valid (see the code
   // above in processOfferReply).
   Slave *slave = lookupSlave(t.slaveId);
   CHECK(slave != NULL);
 
-  Task *task = new Task(t.taskId, framework->id, res, TASK_STARTING,
-                        t.name, "", slave->id);
+  Task *task = new (taskPool.allocate())
+    Task(t.taskId, framework->id, res, TASK_STARTING, t.name, "", slave->id);
 
   framework->addTask(task);
-  slave->addTask(task);
+  slave->addTask(task, framework->handle);
+  addExecutor(framework->handle, slave);
 
   allocator->taskAdded(task);
 
   LOG(INFO) << "Launching " << task << " on " << slave;
-  send(slave->pid, pack<M2S_RUN_TASK>(
-        framework->id, t.taskId, framework->name, framework->user,
-        framework->executorInfo, t.name, t.arg, t.params, framework->pid));
+
+  // Slaves that advertise CAPABILITY_TASK_RESOURCES give the task the
+  // resources we counted it as using. Older ones go by its params, so
+  // make those say the same.
+  Params params(t.params);
+  if (!(capabilities(slave->pid) & CAPABILITY_TASK_RESOURCES))
+    resourcesToParams(res, &params);
+
+  // Only send the executor info if the slave doesn't have it already.
+  int64_t &sentHash = slave->executorInfoHashes[framework->handle];
+  if (sentHash == framework->executorInfoHash &&
+      (capabilities(slave->pid) & CAPABILITY_CACHED_EXECUTOR_INFO)) {
+    serializer counter(NULL, compact(slave->pid));
+    counter & framework->executorInfo;
+    executorInfoBytesSaved += counter.size;
+    cachedExecutorInfos++;
+    send(slave->pid, pack<M2S_RUN_CACHED_TASK>(
+          framework->id, t.taskId, framework->executorInfoHash, t.name, t.arg,
+          params, framework->pid, res));
+  } else {
+    sentHash = framework->executorInfoHash;
+    send(slave->pid, pack<M2S_RUN_TASK>(
+          framework->id, t.taskId, framework->name, framework->user,
+          framework->executorInfo, t.name, t.arg, params, framework->pid,
+          RunTaskExtras(capabilities(framework->pid), res)));
+  }
+}
+
+
+void Master::addExecutor(Interner::Handle frameworkHandle, Slave *slave)
+{
+  executorSlaves[frameworkHandle].insert(slave->handle);
+  slave->executorFrameworks.insert(frameworkHandle);
 }
 
 
@@ -957,21 +1223,30 @@ void Master::removeSlotOffer(SlotOffer *offer,
   // Tell the allocator about the resources freed up
   allocator->offerReturned(offer, reason, resourcesLeft);
   
-  // Delete it
-  slotOffers.erase(offer->id);
-  delete offer;
+  // Delete it, keeping its resources vector around for a future offer
+  slotOffers.erase(offer->number);
+  if (spareOfferResources.size() < MAX_SPARE_OFFER_RESOURCES) {
+    offer->resources.clear();
+    spareOfferResources.push_back(vector<SlaveResources>());
+    spareOfferResources.back().swap(offer->resources);
+  }
+  offerPool.destroy(offer);
 }
 
 
 void Master::addFramework(Framework *framework)
 {
-  CHECK(frameworks.find(framework->id) == frameworks.end());
+  framework->handle = frameworkIds.intern(framework->id);
+  framework->executorInfoHash = executorInfoHash(framework->executorInfo);
+
+  CHECK(frameworks.find(framework->handle) == frameworks.end());
 
-  frameworks[framework->id] = framework;
-  pidToFid[framework->pid] = framework->id;
+  frameworks[framework->handle] = framework;
+  pidToFid[framework->pid] = framework->handle;
   link(framework->pid);
 
-  send(framework->pid, pack<M2F_REGISTER_REPLY>(framework->id));
+  send(framework->pid,
+       pack<M2F_REGISTER_REPLY>(framework->id, MESOS_CAPABILITIES));
 
   allocator->frameworkAdded(framework);
 }
@@ -985,20 +1260,21 @@ void Master::failoverFramework(Framework *framework, const PID &newPid)
 
   // Remove the framework's slot offers.
   // TODO(benh): Consider just reoffering these to the new framework.
-  unordered_set<SlotOffer *> slotOffersCopy = framework->slotOffers;
+  SlotOfferSet slotOffersCopy = framework->slotOffers;
   foreach (SlotOffer* offer, slotOffersCopy) {
     removeSlotOffer(offer, ORR_FRAMEWORK_FAILOVER, offer->resources);
   }
 
   send(oldPid, pack<M2F_ERROR>(1, "Framework failover"));
+  recordCapabilities(oldPid, 0);
 
   // TODO(benh): unlink(old->pid);
   pidToFid.erase(oldPid);
-  pidToFid[newPid] = framework->id;
+  pidToFid[newPid] = framework->handle;
   framework->pid = newPid;
   link(newPid);
 
-  send(newPid, pack<M2F_REGISTER_REPLY>(framework->id));
+  send(newPid, pack<M2F_REGISTER_REPLY>(framework->id, MESOS_CAPABILITIES));
 }
 
 
@@ -1009,9 +1285,18 @@ void Master::removeFramework(Framework *framework)
   framework->active = false;
   // TODO: Notify allocator that a framework removal is beginning?
   
-  // Tell slaves to kill the framework
-  foreachpair (_, Slave *slave, slaves)
+  // Tell the slaves its executor has run on to kill the framework
+  const unordered_set<Interner::Handle>& sids =
+    executorSlaves[framework->handle];
+  foreach (Interner::Handle sid, sids) {
+    Slave *slave = lookupSlave(sid);
+    CHECK(slave != NULL);
     send(slave->pid, pack<M2S_KILL_FRAMEWORK>(framework->id));
+    slave->executorFrameworks.erase(framework->handle);
+    slave->executorInfoHashes.erase(framework->handle);
+  }
+  broadcastMessagesSaved += slaves.size() - sids.size();
+  executorSlaves.erase(framework->handle);
 
   // Remove pointers to the framework's tasks in slaves
   unordered_map<TaskID, Task *> tasksCopy = framework->tasks;
@@ -1022,7 +1307,7 @@ void Master::removeFramework(Framework *framework)
   }
   
   // Remove the framework's slot offers
-  unordered_set<SlotOffer *> slotOffersCopy = framework->slotOffers;
+  SlotOfferSet slotOffersCopy = framework->slotOffers;
   foreach (SlotOffer* offer, slotOffersCopy) {
     removeSlotOffer(offer, ORR_FRAMEWORK_LOST, offer->resources);
   }
@@ -1032,9 +1317,11 @@ void Master::removeFramework(Framework *framework)
 
   // TODO(benh): unlink(framework->pid);
   pidToFid.erase(framework->pid);
+  recordCapabilities(framework->pid, 0);
 
-  // Delete it
-  frameworks.erase(framework->id);
+  // Delete it (nothing refers to its handle any more)
+  frameworks.erase(framework->handle);
+  frameworkIds.release(framework->handle);
   allocator->frameworkRemoved(framework);
   delete framework;
 }
@@ -1047,7 +1334,8 @@ void Master::removeSlave(Slave *slave)
   // TODO: Notify allocator that a slave removal is beginning?
   
   // Remove pointers to slave's tasks in frameworks, and send status updates
-  unordered_map<pair<FrameworkID, TaskID>, Task *> tasksCopy = slave->tasks;
+  unordered_map<pair<Interner::Handle, TaskID>, Task *> tasksCopy =
+    slave->tasks;
   foreachpair (_, Task *task, tasksCopy) {
     Framework *framework = lookupFramework(task->frameworkId);
     // A framework might not actually exist because the master failed
@@ -1064,9 +1352,18 @@ void Master::removeSlave(Slave *slave)
     removeTask(task, TRR_SLAVE_LOST);
   }
 
+  // Frameworks that have run executors on the slave or currently have
+  // offers for it are the ones that need to hear that it was lost
+  unordered_set<Interner::Handle> interestedFrameworks =
+    slave->executorFrameworks;
+
   // Remove slot offers from the slave; this will also rescind them
-  unordered_set<SlotOffer *> slotOffersCopy = slave->slotOffers;
+  SlotOfferSet slotOffersCopy = slave->slotOffers;
   foreach (SlotOffer *offer, slotOffersCopy) {
+    Framework *framework = lookupFramework(offer->frameworkId);
+    if (framework != NULL)
+      interestedFrameworks.insert(framework->handle);
+
     // Only report resources on slaves other than this one to the allocator
     vector<SlaveResources> otherSlaveResources;
     foreach (SlaveResources& r, offer->resources) {
@@ -1081,21 +1378,54 @@ void Master::removeSlave(Slave *slave)
   foreachpair (_, Framework *framework, frameworks)
     framework->slaveFilter.erase(slave);
   
-  // Send lost-slave message to all frameworks (this helps them re-run
-  // previously finished tasks whose output was on the lost slave)
-  foreachpair (_, Framework *framework, frameworks)
-    send(framework->pid, pack<M2F_LOST_SLAVE>(slave->id));
+  foreach (Interner::Handle fid, slave->executorFrameworks)
+    executorSlaves[fid].erase(slave->handle);
+
+  // Send lost-slave message to the interested frameworks (this helps
+  // them re-run previously finished tasks whose output was on the lost
+  // slave)
+  int numSent = 0;
+  foreach (Interner::Handle fid, interestedFrameworks) {
+    Framework *framework = lookupFramework(fid);
+    if (framework != NULL) {
+      send(framework->pid, pack<M2F_LOST_SLAVE>(slave->id));
+      numSent++;
+    }
+  }
+  broadcastMessagesSaved += frameworks.size() - numSent;
 
   // TODO(benh): unlink(slave->pid);
   pidToSid.erase(slave->pid);
+  recordCapabilities(slave->pid, 0);
 
-  // Delete it
-  slaves.erase(slave->id);
+  // Delete it (nothing refers to its handle any more)
+  slaves.erase(slave->handle);
+  slaveIds.release(slave->handle);
   allocator->slaveRemoved(slave);
   delete slave;
 }
 
 
+// Update the state of a task the slave sent a status update for
+void Master::updateTaskState(Slave *slave, Framework *framework,
+                             TaskID tid, TaskState state)
+{
+  Task *task = slave->lookupTask(framework->handle, tid);
+  if (task != NULL) {
+    LOG(INFO) << "Status update: " << task << " is in state " << state;
+    task->state = state;
+    framework->published.reset();
+    evLogger->logTaskStateUpdated(tid, framework->id, state);
+    // Remove the task if it finished or failed
+    if (state == TASK_FINISHED || state == TASK_FAILED ||
+        state == TASK_KILLED || state == TASK_LOST) {
+      LOG(INFO) << "Removing " << task << " because it's done";
+      removeTask(task, TRR_TASK_ENDED);
+    }
+  }
+}
+
+
 // Remove a slot offer (because it was replied or we lost a framework or slave)
 void Master::removeTask(Task *task, TaskRemovalReason reason)
 {
@@ -1104,9 +1434,46 @@ void Master::removeTask(Task *task, TaskRemovalReason reason)
   CHECK(framework != NULL);
   CHECK(slave != NULL);
   framework->removeTask(task->id);
-  slave->removeTask(task);
+  slave->removeTask(task, framework->handle);
   allocator->taskRemoved(task, reason);
-  delete task;
+  taskPool.destroy(task);
+}
+
+
+void Master::addFilter(Framework *framework, Slave *slave, double expiry)
+{
+  framework->slaveFilter[slave] = expiry;
+  if (expiry != 0)
+    filterExpiries.push(FilterExpiry(expiry, framework->id, slave->id));
+}
+
+
+void Master::removeExpiredFilters(double now)
+{
+  unordered_map<Framework *, vector<Slave *> > unfiltered;
+
+  while (!filterExpiries.empty() && filterExpiries.top().time <= now) {
+    FilterExpiry expiry = filterExpiries.top();
+    filterExpiries.pop();
+
+    // Skip filters that were since removed, replaced or whose framework
+    // or slave has gone away
+    Framework *framework = lookupFramework(expiry.frameworkId);
+    Slave *slave = lookupSlave(expiry.slaveId);
+    if (framework == NULL || slave == NULL)
+      continue;
+
+    unordered_map<Slave *, double>::iterator it =
+      framework->slaveFilter.find(slave);
+    if (it == framework->slaveFilter.end() || it->second != expiry.time)
+      continue;
+
+    framework->slaveFilter.erase(it);
+    unfiltered[framework].push_back(slave);
+  }
+
+  foreachpair (Framework *framework, const vector<Slave *>& slaves, unfiltered)
+    allocator->filtersExpired(framework, slaves);
 }
 
 
@@ -1129,6 +1496,14 @@ FrameworkID Master::newFrameworkId()
 }
 
 
+void Master::scheduleAllocation(double delay)
+{
+  double deadline = elapsed() + delay;
+  if (allocationDeadline == 0 || deadline < allocationDeadline)
+    allocationDeadline = deadline;
+}
+
+
 const Params& Master::getConf()
 {
   return conf;
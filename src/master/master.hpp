@@ -1,12 +1,14 @@
 #ifndef __MASTER_HPP__
 #define __MASTER_HPP__
 
+#include <pthread.h>
 #include <time.h>
 #include <arpa/inet.h>
 
 #include <algorithm>
 #include <fstream>
 #include <map>
+#include <queue>
 #include <set>
 #include <sstream>
 #include <stdexcept>
@@ -25,7 +27,10 @@
 
 #include "common/fatal.hpp"
 #include "common/foreach.hpp"
+#include "common/interner.hpp"
+#include "common/lock.hpp"
 #include "common/params.hpp"
+#include "common/pool.hpp"
 #include "common/resources.hpp"
 #include "common/task.hpp"
 
@@ -60,6 +65,9 @@ using foreach::_;
 // Maximum number of slot offers to have outstanding for each framework.
 const int MAX_OFFERS_PER_FRAMEWORK = 50;
 
+// Maximum number of freed offer resource vectors to keep for reuse.
+const size_t MAX_SPARE_OFFER_RESOURCES = 1024;
+
 // Default number of seconds until a refused slot is resent to a framework.
 const double DEFAULT_REFUSAL_TIMEOUT = 5;
 
@@ -84,6 +92,10 @@ const double HEARTBEAT_TIMEOUT = 15;
 // Time to wait for a framework to failover (TODO(benh): Make configurable)).
 const time_t FRAMEWORK_FAILOVER_TIMEOUT = 60;
 
+// Most seconds the state the master publishes (for the web UI) can be
+// out of date by.
+const double DEFAULT_STATE_PUBLISH_INTERVAL = 1;
+
 // Some forward declarations
 struct Slave;
 class Allocator;
@@ -134,26 +146,35 @@ struct SlaveResources
 struct SlotOffer
 {
   OfferID id;
+  int64_t number; // Sequence number the master created this offer with
   FrameworkID frameworkId;
   vector<SlaveResources> resources;
   
-  SlotOffer(OfferID i, FrameworkID f, const vector<SlaveResources>& r)
-    : id(i), frameworkId(f), resources(r) {}
+  SlotOffer(OfferID i, int64_t n, FrameworkID f)
+    : id(i), number(n), frameworkId(f) {}
 };
 
+
+// A set of offers whose nodes come from the master's pools.
+typedef unordered_set<SlotOffer *, boost::hash<SlotOffer *>,
+                      std::equal_to<SlotOffer *>,
+                      PoolAllocator<SlotOffer *> > SlotOfferSet;
+
 // An connected framework.
 struct Framework
 {
   PID pid;
   FrameworkID id;
+  Interner::Handle handle; // Master's handle for id
   bool active; // Turns false when framework is being removed
   string name;
   string user;
   ExecutorInfo executorInfo;
+  int64_t executorInfoHash; // Set when the framework gets added
   double connectTime;
 
   unordered_map<TaskID, Task *> tasks;
-  unordered_set<SlotOffer *> slotOffers; // Active offers given to this framework
+  SlotOfferSet slotOffers; // Active offers given to this framework
 
   Resources resources; // Total resources owned by framework (tasks + offers)
   
@@ -164,9 +185,14 @@ struct Framework
   // A failover timer if the connection to this framework is lost.
   FrameworkFailoverTimer *failoverTimer;
 
-  Framework(const PID &_pid, FrameworkID _id, double time)
-    : pid(_pid), id(_id), active(true), connectTime(time),
-      failoverTimer(NULL) {}
+  // How the master's last published state showed this framework, or
+  // NULL if its tasks or offers have changed since.
+  state::Ref<state::Framework> published;
+
+  Framework(const PID &_pid, FrameworkID _id, double time,
+            SlabPools *nodePools = NULL)
+    : pid(_pid), id(_id), handle(0), active(true), connectTime(time),
+      slotOffers(PoolAllocator<SlotOffer *>(nodePools)), failoverTimer(NULL) {}
 
   ~Framework()
   {
@@ -192,6 +218,7 @@ struct Framework
     CHECK(tasks.count(task->id) == 0);
     tasks[task->id] = task;
     this->resources += task->resources;
+    published.reset();
   }
   
   void removeTask(TaskID tid)
@@ -200,6 +227,7 @@ struct Framework
     unordered_map<TaskID, Task *>::iterator it = tasks.find(tid);
     this->resources -= it->second->resources;
     tasks.erase(it);
+    published.reset();
   }
   
   void addOffer(SlotOffer *offer)
@@ -208,6 +236,7 @@ struct Framework
     slotOffers.insert(offer);
     foreach (SlaveResources &r, offer->resources)
       this->resources += r.resources;
+    published.reset();
   }
 
   void removeOffer(SlotOffer *offer)
@@ -216,6 +245,7 @@ struct Framework
     slotOffers.erase(offer);
     foreach (SlaveResources &r, offer->resources)
       this->resources -= r.resources;
+    published.reset();
   }
   
   bool filters(Slave *slave, Resources resources)
@@ -223,15 +253,27 @@ struct Framework
     // TODO: Implement other filters
     return slaveFilter.find(slave) != slaveFilter.end();
   }
-  
-  void removeExpiredFilters(double now)
+};
+
+
+// A pending expiry of a framework's filter on a slave. The master keeps
+// these in a queue ordered by time so that each timer tick only looks at
+// the filters that are actually expiring. Entries are not removed when a
+// filter is replaced or cleared early; they are just ignored on expiry if
+// the framework no longer has a filter with that time for the slave.
+struct FilterExpiry
+{
+  double time;
+  FrameworkID frameworkId;
+  SlaveID slaveId;
+
+  FilterExpiry(double t, const FrameworkID& fid, const SlaveID& sid)
+    : time(t), frameworkId(fid), slaveId(sid) {}
+
+  // Reversed so that a priority_queue yields the earliest expiry first.
+  bool operator < (const FilterExpiry& that) const
   {
-    vector<Slave *> toRemove;
-    foreachpair (Slave *slave, double removalTime, slaveFilter)
-      if (removalTime != 0 && removalTime <= now)
-        toRemove.push_back(slave);
-    foreach (Slave *slave, toRemove)
-      slaveFilter.erase(slave);
+    return time > that.time;
   }
 };
 
@@ -241,6 +283,7 @@ struct Slave
 {  
   PID pid;
   SlaveID id;
+  Interner::Handle handle; // Master's handle for id
   bool active; // Turns false when slave is being removed
   string hostname;
   string webUIUrl;
@@ -251,35 +294,50 @@ struct Slave
   Resources resourcesOffered; // Resources currently in offers
   Resources resourcesInUse;   // Resources currently used by tasks
 
-  unordered_map<pair<FrameworkID, TaskID>, Task *> tasks;
-  unordered_set<SlotOffer *> slotOffers; // Active offers of slots on this slave
+  // Tasks keyed by the master's handle for their framework and task ID
+  unordered_map<pair<Interner::Handle, TaskID>, Task *> tasks;
+  SlotOfferSet slotOffers; // Active offers of slots on this slave
+
+  // Handles of the frameworks whose executors have run on this slave
+  unordered_set<Interner::Handle> executorFrameworks;
+
+  // Hashes of the executor infos sent to this slave (which it keeps
+  // while it runs the framework's executor), by framework handle
+  unordered_map<Interner::Handle, int64_t> executorInfoHashes;
+
+  // How the master's published state shows this slave (which doesn't
+  // change), or NULL if it hasn't been published yet
+  state::Ref<state::Slave> published;
   
-  Slave(const PID &_pid, SlaveID _id, double time)
-    : pid(_pid), id(_id), active(true)
+  Slave(const PID &_pid, SlaveID _id, double time,
+        SlabPools *nodePools = NULL)
+    : pid(_pid), id(_id), handle(0), active(true),
+      slotOffers(PoolAllocator<SlotOffer *>(nodePools))
   {
     connectTime = lastHeartbeat = time;
   }
 
-  Task * lookupTask(FrameworkID fid, TaskID tid)
+  Task * lookupTask(Interner::Handle frameworkHandle, TaskID tid)
   {
-    foreachpair (_, Task *task, tasks)
-      if (task->frameworkId == fid && task->id == tid)
-        return task;
-
-    return NULL;
+    unordered_map<pair<Interner::Handle, TaskID>, Task *>::iterator it =
+      tasks.find(make_pair(frameworkHandle, tid));
+    if (it != tasks.end())
+      return it->second;
+    else
+      return NULL;
   }
 
-  void addTask(Task *task)
+  void addTask(Task *task, Interner::Handle frameworkHandle)
   {
-    CHECK(tasks.find(make_pair(task->frameworkId, task->id)) == tasks.end());
-    tasks[make_pair(task->frameworkId, task->id)] = task;
+    CHECK(tasks.find(make_pair(frameworkHandle, task->id)) == tasks.end());
+    tasks[make_pair(frameworkHandle, task->id)] = task;
     resourcesInUse += task->resources;
   }
   
-  void removeTask(Task *task)
+  void removeTask(Task *task, Interner::Handle frameworkHandle)
   {
-    CHECK(tasks.find(make_pair(task->frameworkId, task->id)) != tasks.end());
-    tasks.erase(make_pair(task->frameworkId, task->id));
+    CHECK(tasks.find(make_pair(frameworkHandle, task->id)) != tasks.end());
+    tasks.erase(make_pair(frameworkHandle, task->id));
     resourcesInUse -= task->resources;
   }
   
@@ -317,17 +375,57 @@ protected:
   Params conf;
   EventLogger* evLogger;
 
-  unordered_map<FrameworkID, Framework *> frameworks;
-  unordered_map<SlaveID, Slave *> slaves;
-  unordered_map<OfferID, SlotOffer *> slotOffers;
+  // Framework and slave IDs are interned as they arrive in messages so
+  // that the master's tables can be keyed by integer handles.
+  Interner frameworkIds;
+  Interner slaveIds;
+
+  unordered_map<Interner::Handle, Framework *> frameworks;
+  unordered_map<Interner::Handle, Slave *> slaves;
+  unordered_map<int64_t, SlotOffer *> slotOffers; // Keyed by offer number
+
+  unordered_map<PID, Interner::Handle> pidToFid;
+  unordered_map<PID, Interner::Handle> pidToSid;
+
+  // Handles of the slaves that each framework's executor has run on,
+  // keyed by framework handle (so that they survive the framework
+  // failing over or not having re-registered yet). Messages about a
+  // framework only go to these slaves rather than to every slave.
+  unordered_map<Interner::Handle, unordered_set<Interner::Handle> >
+    executorSlaves;
+  int64_t broadcastMessagesSaved; // Messages these sets saved us sending
 
-  unordered_map<PID, FrameworkID> pidToFid;
-  unordered_map<PID, SlaveID> pidToSid;
+  int64_t statusUpdateBatches;  // Batches of status updates from slaves
+  int64_t batchedStatusUpdates; // Status updates in those batches
+
+  int64_t cachedExecutorInfos;    // Tasks launched with a cached ExecutorInfo
+  int64_t executorInfoBytesSaved; // Bytes those ExecutorInfos would have taken
+
+  std::priority_queue<FilterExpiry> filterExpiries;
+
+  // Tasks, offers and the nodes of the offer sets on frameworks and
+  // slaves are allocated from pools, since they come and go at the rate
+  // offers are made. Offer resource vectors are kept for reuse too.
+  ObjectPool<Task> taskPool;
+  ObjectPool<SlotOffer> offerPool;
+  SlabPools offerSetNodePools;
+  vector<vector<SlaveResources> > spareOfferResources;
 
   int64_t nextFrameworkId; // Used to give each framework a unique ID.
   int64_t nextSlaveId;     // Used to give each slave a unique ID.
   int64_t nextSlotOfferId; // Used to give each slot offer a unique ID.
 
+  double allocationDeadline; // When to next call allocator->timerTick() early
+                             // (see scheduleAllocation), or 0 if not needed.
+
+  // The state last published for readers outside the master's process
+  // (see getState), guarded by a mutex since they run in other threads.
+  state::MasterState *publishedState;
+  pthread_mutex_t publishedStateMutex;
+  double publishDeadline; // When to next publish the state, or 0 if it
+                          // hasn't changed since it was last published.
+  double publishInterval; // Longest the published state may be out of date
+
   string allocatorType;
   Allocator *allocator;
 
@@ -344,6 +442,10 @@ public:
 
   static void registerOptions(Configurator* conf);
 
+  // Returns a copy of the state the master last published (no more
+  // than state_publish_interval seconds old), which the caller owns.
+  // Can be called from any thread (the web UI's, for one) without
+  // waiting on the master's messages.
   state::MasterState *getState();
   
   OfferID makeOffer(Framework *framework,
@@ -352,11 +454,18 @@ public:
   void rescindOffer(SlotOffer *offer);
   
   void killTask(Task *task);
+
+  // Record that a framework's executor is (or was) running on a slave.
+  void addExecutor(Interner::Handle frameworkHandle, Slave *slave);
   
   Framework * lookupFramework(FrameworkID fid);
 
+  Framework * lookupFramework(Interner::Handle handle);
+
   Slave * lookupSlave(SlaveID sid);
 
+  Slave * lookupSlave(Interner::Handle handle);
+
   SlotOffer * lookupSlotOffer(OfferID soid);
 
   // Return connected frameworks that are not in the process of being removed
@@ -365,19 +474,34 @@ public:
   // Return connected slaves that are not in the process of being removed
   vector<Slave *> getActiveSlaves();
 
+  // Have the allocator's timerTick called after the given number of
+  // seconds rather than waiting for the next regular timer tick (unless
+  // a call is already due sooner than that)
+  void scheduleAllocation(double delay);
+
   const Params& getConf();
 
 protected:
   void operator () ();
 
+  // Publish a new snapshot of the master's state (see getState),
+  // rebuilding only the parts for frameworks that changed since the
+  // last one
+  void publishState();
+
   // Process a resource offer reply (for a non-cancelled offer) by launching
   // the desired tasks (if the offer contains a valid set of tasks) and
   // reporting any unused resources to the allocator
   void processOfferReply(SlotOffer *offer,
       const vector<TaskDescription>& tasks, const Params& params);
 
-  // Launch a task described in a slot offer response
-  void launchTask(Framework *framework, const TaskDescription& task);
+  // Get the resources a task in a slot offer response asks for
+  Resources getTaskResources(const TaskDescription& task);
+
+  // Launch a task described in a slot offer response, with the resources
+  // returned by getTaskResources
+  void launchTask(Framework *framework, const TaskDescription& task,
+                  const Resources& resources);
   
   // Terminate a framework, sending it a particular error message
   // TODO: Make the error codes and messages programmer-friendly
@@ -391,8 +515,18 @@ protected:
                        OfferReturnReason reason,
                        const vector<SlaveResources>& resourcesLeft);
 
+  // Update the state of a task the slave sent a status update for
+  void updateTaskState(Slave *slave, Framework *framework,
+                       TaskID tid, TaskState state);
+
   void removeTask(Task *task, TaskRemovalReason reason);
 
+  // Filter a slave for a framework until the given time (or forever if 0)
+  void addFilter(Framework *framework, Slave *slave, double expiry);
+
+  // Remove filters that have expired and tell the allocator about them
+  void removeExpiredFilters(double now);
+
   void addFramework(Framework *framework);
 
   // Replace the scheduler for a framework with a new process ID, in the
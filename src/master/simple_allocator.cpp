@@ -5,7 +5,6 @@
 #include "simple_allocator.hpp"
 
 
-using std::max;
 using std::sort;
 
 using namespace mesos;
@@ -36,7 +35,7 @@ void SimpleAllocator::slaveAdded(Slave* slave)
   LOG(INFO) << "Added " << slave;
   refusers[slave] = unordered_set<Framework*>();
   totalResources += slave->resources;
-  makeNewOffers(slave);
+  offerFreedResources(vector<Slave*>(1, slave));
 }
 
 
@@ -45,6 +44,7 @@ void SimpleAllocator::slaveRemoved(Slave* slave)
   LOG(INFO) << "Removed " << slave;
   totalResources -= slave->resources;
   refusers.erase(slave);
+  dirtySlaves.erase(slave);
 }
 
 
@@ -55,10 +55,11 @@ void SimpleAllocator::taskRemoved(Task* task, TaskRemovalReason reason)
   Slave* slave = master->lookupSlave(task->slaveId);
   CHECK(slave != 0);
   refusers[slave].clear();
+  dirtySlaves.insert(slave);
   // Re-offer the resources, unless this task was removed due to a lost
   // slave or a lost framework (in which case we'll get another callback)
   if (reason == TRR_TASK_ENDED || reason == TRR_EXECUTOR_LOST)
-    makeNewOffers(slave);
+    offerFreedResources(vector<Slave*>(1, slave));
 }
 
 
@@ -67,6 +68,8 @@ void SimpleAllocator::offerReturned(SlotOffer* offer,
                                     const vector<SlaveResources>& resLeft)
 {
   LOG(INFO) << "Offer returned: " << offer << ", reason = " << reason;
+  foreach (const SlaveResources& r, resLeft)
+    dirtySlaves.insert(r.slave);
   // If this offer returned due to the framework replying, add it to refusers
   if (reason == ORR_FRAMEWORK_REPLIED) {
     Framework* framework = master->lookupFramework(offer->frameworkId);
@@ -74,7 +77,7 @@ void SimpleAllocator::offerReturned(SlotOffer* offer,
     foreach (const SlaveResources& r, resLeft) {
       VLOG(1) << "Framework reply leaves " << r.resources 
               << " free on " << r.slave;
-      if (r.resources.cpus > 0 || r.resources.mem > 0) {
+      if (r.resources.anyPositive()) {
         VLOG(1) << "Inserting " << framework << " as refuser for " << r.slave;
         refusers[r.slave].insert(framework);
       }
@@ -89,7 +92,7 @@ void SimpleAllocator::offerReturned(SlotOffer* offer,
     vector<Slave*> slaves;
     foreach (const SlaveResources& r, resLeft)
       slaves.push_back(r.slave);
-    makeNewOffers(slaves);
+    offerFreedResources(slaves);
   }
 }
 
@@ -101,10 +104,33 @@ void SimpleAllocator::offersRevived(Framework* framework)
 }
 
 
+void SimpleAllocator::filtersExpired(Framework* framework,
+                                     const vector<Slave*>& slaves)
+{
+  VLOG(1) << "Filters expired for " << framework << " on "
+          << slaves.size() << " slaves";
+  // These get re-offered on the timer tick that follows the expiry
+  foreach (Slave* slave, slaves)
+    dirtySlaves.insert(slave);
+}
+
+
 void SimpleAllocator::timerTick()
 {
-  // TODO: Is this necessary?
-  makeNewOffers();
+  // Only re-offer slaves whose free resources changed, or that got
+  // unfiltered, since they were last looked at
+  if (dirtySlaves.empty())
+    return;
+  vector<Slave*> slaves(dirtySlaves.begin(), dirtySlaves.end());
+  makeNewOffers(slaves);
+}
+
+
+void SimpleAllocator::addStatistics(state::MasterState* state)
+{
+  state->allocation_passes = passes;
+  state->slaves_examined = slavesExamined;
+  state->last_pass_slaves = lastPassSlaves;
 }
 
 
@@ -114,20 +140,12 @@ struct DominantShareComparator
 {
   Resources total;
   
-  DominantShareComparator(Resources _total) : total(_total)
-  {
-    if (total.cpus == 0) // Prevent division by zero if there are no slaves
-      total.cpus = 1;
-    if (total.mem == 0)
-      total.mem = 1;
-  }
+  DominantShareComparator(Resources _total) : total(_total) {}
   
   bool operator() (Framework* f1, Framework* f2)
   {
-    double share1 = max(f1->resources.cpus / (double) total.cpus,
-                        f1->resources.mem  / (double) total.mem);
-    double share2 = max(f2->resources.cpus / (double) total.cpus,
-                        f2->resources.mem  / (double) total.mem);
+    double share1 = f1->resources.dominantShare(total);
+    double share2 = f2->resources.dominantShare(total);
     if (share1 == share2)
       return f1->id < f2->id; // Make the sort deterministic for unit testing
     else
@@ -163,8 +181,29 @@ void SimpleAllocator::makeNewOffers(Slave* slave)
 }
 
 
+void SimpleAllocator::offerFreedResources(const vector<Slave*>& slaves)
+{
+  if (batchInterval <= 0) {
+    makeNewOffers(slaves);
+    return;
+  }
+  // Leave the slaves for the timer tick that ends this batch
+  foreach (Slave* slave, slaves)
+    dirtySlaves.insert(slave);
+  master->scheduleAllocation(batchInterval);
+}
+
+
 void SimpleAllocator::makeNewOffers(const vector<Slave*>& slaves)
 {
+  // Every slave looked at now is up to date until its resources change again
+  foreach (Slave* slave, slaves)
+    dirtySlaves.erase(slave);
+  passes++;
+  slavesExamined += slaves.size();
+  lastPassSlaves = slaves.size();
+  VLOG(1) << "Allocation pass over " << slaves.size() << " slaves";
+
   // Get an ordering of frameworks to send offers to
   vector<Framework*> ordering = getAllocationOrdering();
   if (ordering.size() == 0) {
@@ -177,7 +216,7 @@ void SimpleAllocator::makeNewOffers(const vector<Slave*>& slaves)
   foreach (Slave* slave, slaves) {
     if (slave->active) {
       Resources res = slave->resourcesFree();
-      if (res.cpus >= MIN_CPUS && res.mem >= MIN_MEM) {
+      if (res[CPUS] >= MIN_CPUS && res[MEM] >= MIN_MEM) {
         VLOG(1) << "Found free resources: " << res << " on " << slave;
         freeResources[slave] = res;
       }
@@ -214,6 +253,7 @@ void SimpleAllocator::makeNewOffers(const vector<Slave*>& slaves)
         freeResources.erase(r.slave);
       }
       master->makeOffer(framework, offerable);
+      offerMade(framework);
     }
   }
 }
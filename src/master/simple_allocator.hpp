@@ -19,6 +19,7 @@ using boost::unordered_set;
 
 class SimpleAllocator : public Allocator
 {
+protected:
   Master* master;
 
   Resources totalResources;
@@ -26,9 +27,27 @@ class SimpleAllocator : public Allocator
   // Remember which frameworks refused each slave "recently"; this is cleared
   // when the slave's free resources go up or when everyone has refused it
   unordered_map<Slave*, unordered_set<Framework*> > refusers;
+
+  // Slaves whose free resources went up (or that some framework stopped
+  // filtering) without being re-offered yet; timer ticks only look at these
+  unordered_set<Slave*> dirtySlaves;
+
+  // Seconds to let freed resources accumulate for before offering them,
+  // so that each framework gets one offer per batch rather than one per
+  // freed slave (0 to offer them right away)
+  double batchInterval;
+
+  // Statistics about allocation passes
+  int64_t passes;
+  int64_t slavesExamined;
+  int32_t lastPassSlaves;
   
 public:
-  SimpleAllocator(Master* _master): master(_master) {}
+  SimpleAllocator(Master* _master)
+    : master(_master), passes(0), slavesExamined(0), lastPassSlaves(0)
+  {
+    batchInterval = master->getConf().get<double>("offer_batch_interval", 0);
+  }
   
   ~SimpleAllocator() {}
   
@@ -47,12 +66,21 @@ public:
                              const vector<SlaveResources>& resourcesLeft);
 
   virtual void offersRevived(Framework* framework);
+
+  virtual void filtersExpired(Framework* framework,
+                              const vector<Slave*>& slaves);
   
   virtual void timerTick();
+
+  virtual void addStatistics(state::MasterState* state);
   
-private:
+protected:
   // Get an ordering to consider frameworks in for launching tasks
-  vector<Framework*> getAllocationOrdering();
+  virtual vector<Framework*> getAllocationOrdering();
+
+  // Called after an offer has been made to a framework (and hence after
+  // its resources have gone up), for subclasses that track shares
+  virtual void offerMade(Framework* framework) {}
   
   // Look at the full state of the cluster and send out offers
   void makeNewOffers();
@@ -62,6 +90,10 @@ private:
 
   // Make resource offers for a subset of the slaves
   void makeNewOffers(const vector<Slave*>& slaves);
+
+  // Make resource offers for slaves whose free resources went up, either
+  // right away or at the end of the current batch interval
+  void offerFreedResources(const vector<Slave*>& slaves);
 };
 
 }}} /* namespace */
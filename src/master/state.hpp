@@ -1,6 +1,7 @@
 #ifndef MASTER_STATE_HPP
 #define MASTER_STATE_HPP
 
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -14,6 +15,56 @@
 
 namespace mesos { namespace internal { namespace master { namespace state {
 
+#ifndef SWIG
+/**
+ * A counted reference to a slave or framework in a MasterState. These
+ * never change once they are in one, so copies of a MasterState (like
+ * those of the state a master publishes) share them and the last
+ * reference deletes them. Counts are atomic since copies get handed
+ * to other threads.
+ */
+template <typename T>
+class Ref
+{
+public:
+  explicit Ref(T *_t = NULL) : t(_t) { acquire(); }
+
+  Ref(const Ref<T>& that) : t(that.t) { acquire(); }
+
+  ~Ref() { release(); }
+
+  Ref<T>& operator = (const Ref<T>& that)
+  {
+    Ref<T>(that).swap(*this);
+    return *this;
+  }
+
+  void reset(T *_t = NULL) { Ref<T>(_t).swap(*this); }
+
+  void swap(Ref<T>& that) { std::swap(t, that.t); }
+
+  T * get() const { return t; }
+
+  operator bool () const { return t != NULL; }
+
+private:
+  void acquire()
+  {
+    if (t != NULL)
+      __sync_fetch_and_add(&t->refs, 1);
+  }
+
+  void release()
+  {
+    if (t != NULL && __sync_sub_and_fetch(&t->refs, 1) == 0)
+      delete t;
+  }
+
+  T *t;
+};
+#endif
+
+
 struct SlaveResources
 {  
   SlaveID slave_id;
@@ -47,16 +98,19 @@ struct Slave
   Slave(SlaveID id_, const std::string& host_, const std::string& web_ui_url_,
 	int32_t cpus_, int64_t mem_, time_t connect_)
     : id(id_), host(host_), web_ui_url(web_ui_url_),
-      cpus(cpus_), mem(mem_), connect_time(connect_) {}
+      cpus(cpus_), mem(mem_), connect_time(connect_), refs(0) {}
 
-  Slave() {}
+  Slave() : refs(0) {}
 
   SlaveID id;
   std::string host;
   std::string web_ui_url;
   int32_t cpus;
   int64_t mem;
+  std::string other_resources; // Dimensions besides cpus and mem
   int64_t connect_time;
+
+  int refs; // MasterStates sharing this slave (see Ref)
 };
 
 
@@ -85,9 +139,9 @@ struct Framework
       const std::string& name_, const std::string& executor_,
       int32_t cpus_, int64_t mem_, time_t connect_)
     : id(id_), user(user_), name(name_), executor(executor_),
-      cpus(cpus_), mem(mem_), connect_time(connect_) {}
+      cpus(cpus_), mem(mem_), connect_time(connect_), refs(0) {}
 
-  Framework() {}
+  Framework() : refs(0) {}
 
   ~Framework()
   {
@@ -103,10 +157,13 @@ struct Framework
   std::string executor;
   int32_t cpus;
   int64_t mem;
+  std::string other_resources; // Dimensions besides cpus and mem
   int64_t connect_time;
 
   std::vector<Task *> tasks;
   std::vector<SlotOffer *> offers;
+
+  int refs; // MasterStates sharing this framework (see Ref)
 };
 
 
@@ -114,17 +171,39 @@ struct MasterState
 {
   MasterState(const std::string& build_date_, const std::string& build_user_,
 	      const std::string& pid_, bool _isFT = false)
-    : build_date(build_date_), build_user(build_user_), pid(pid_), isFT(_isFT) {}
+    : build_date(build_date_), build_user(build_user_), pid(pid_), isFT(_isFT),
+      allocation_passes(0), slaves_examined(0), last_pass_slaves(0),
+      task_pool_in_use(0), task_pool_capacity(0), offer_pool_in_use(0),
+      offer_pool_capacity(0), offer_set_node_pool_in_use(0),
+      offer_set_node_pool_capacity(0), broadcast_messages_saved(0),
+      status_update_batches(0), batched_status_updates(0),
+      cached_executor_infos(0), executor_info_bytes_saved(0),
+      connections_made(0), connections_reused(0), messages_written(0),
+      bytes_written(0), socket_writes(0) {}
+
+  MasterState()
+    : allocation_passes(0), slaves_examined(0), last_pass_slaves(0),
+      task_pool_in_use(0), task_pool_capacity(0), offer_pool_in_use(0),
+      offer_pool_capacity(0), offer_set_node_pool_in_use(0),
+      offer_set_node_pool_capacity(0), broadcast_messages_saved(0),
+      status_update_batches(0), batched_status_updates(0),
+      cached_executor_infos(0), executor_info_bytes_saved(0),
+      connections_made(0), connections_reused(0), messages_written(0),
+      bytes_written(0), socket_writes(0) {}
 
-  MasterState() {}
+#ifndef SWIG
+  void addSlave(const Ref<Slave>& slave)
+  {
+    slaves.push_back(slave.get());
+    slaveRefs.push_back(slave);
+  }
 
-  ~MasterState()
+  void addFramework(const Ref<Framework>& framework)
   {
-    foreach (Slave *slave, slaves)
-      delete slave;
-    foreach (Framework *framework, frameworks)
-      delete framework;
+    frameworks.push_back(framework.get());
+    frameworkRefs.push_back(framework);
   }
+#endif
 
   std::string build_date;
   std::string build_user;
@@ -133,6 +212,51 @@ struct MasterState
   std::vector<Slave *> slaves;
   std::vector<Framework *> frameworks;
   bool isFT;
+
+#ifndef SWIG
+  // What keeps the slaves and frameworks above alive (copies of a
+  // MasterState share them).
+  std::vector<Ref<Slave> > slaveRefs;
+  std::vector<Ref<Framework> > frameworkRefs;
+#endif
+
+  // Allocator statistics.
+  int64_t allocation_passes; // Number of times offers were computed
+  int64_t slaves_examined;   // Total slaves looked at across all passes
+  int32_t last_pass_slaves;  // Slaves looked at in the most recent pass
+
+  // Occupancy of the master's object pools (objects in use / allocated).
+  int64_t task_pool_in_use;
+  int64_t task_pool_capacity;
+  int64_t offer_pool_in_use;
+  int64_t offer_pool_capacity;
+  int64_t offer_set_node_pool_in_use;
+  int64_t offer_set_node_pool_capacity;
+
+  // Messages not sent because they only went to the slaves or frameworks
+  // a framework or slave was relevant to, rather than to all of them.
+  int64_t broadcast_messages_saved;
+
+  // Batches of status updates received from slaves, and the updates
+  // in them.
+  int64_t status_update_batches;
+  int64_t batched_status_updates;
+
+  // Tasks launched on slaves that already had their framework's
+  // ExecutorInfo, and the bytes not sent because of it.
+  int64_t cached_executor_infos;
+  int64_t executor_info_bytes_saved;
+
+  // Outbound connections made for sends to nodes without a link, and
+  // sends that reused an idle one instead (for the whole OS process).
+  int64_t connections_made;
+  int64_t connections_reused;
+
+  // Messages and bytes written to remote nodes, and the socket writes
+  // it took (several queued messages are written at once).
+  int64_t messages_written;
+  int64_t bytes_written;
+  int64_t socket_writes;
 };
 
 }}}} /* namespace */
@@ -17,7 +17,7 @@ extern "C" void init_master();  // Initializer for the Python master module
 
 namespace {
 
-PID master;
+mesos::internal::master::Master *master;
 string webuiPort;
 string logDir;
 
@@ -48,7 +48,7 @@ void *runMasterWebUI(void *)
 }
 
 
-void startMasterWebUI(const PID &master, const Params &params)
+void startMasterWebUI(Master *master, const Params &params)
 {
   // TODO(*): It would be nice if we didn't have to be specifying
   // default values for configuration options in the code like
@@ -70,31 +70,10 @@ void startMasterWebUI(const PID &master, const Params &params)
 
 namespace state {
 
-class StateGetter : public MesosProcess
-{
-public:
-  MasterState *masterState;
-
-  StateGetter() {}
-  ~StateGetter() {}
-
-  void operator () ()
-  {
-    send(::master, pack<M2M_GET_STATE>());
-    receive();
-    CHECK(msgid() == M2M_GET_STATE_REPLY);
-    masterState = unpack<M2M_GET_STATE_REPLY, 0>(body());
-  }
-};
-
-
-// From master_state.hpp
+// From master_state.hpp (Python owns the copy of the master's state)
 MasterState *get_master()
 {
-  StateGetter getter;
-  PID pid = Process::spawn(&getter);
-  Process::wait(pid);
-  return getter.masterState;
+  return ::master->getState();
 }
 
 } /* namespace state { */
@@ -14,7 +14,7 @@
 
 namespace mesos { namespace internal { namespace master {
 
-void startMasterWebUI(const PID &master, const Params &params);
+void startMasterWebUI(Master *master, const Params &params);
 
 }}} /* namespace */
 
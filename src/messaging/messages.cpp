@@ -2,6 +2,7 @@
 
 using std::map;
 using std::string;
+using std::vector;
 
 using process::tuples::serializer;
 using process::tuples::deserializer;
@@ -46,43 +47,116 @@ void operator & (deserializer& s, TaskState& state)
 }
 
 
-void operator & (serializer& s, const SlaveOffer& offer)
+// The fields of nested types, which get delimited by their length in
+// the compact encoding (so that fields can be appended to them).
+static void fields(serializer& s, const TaskStatus& status)
+{
+  s & status.taskId;
+  s & status.state;
+  s & status.data;
+}
+
+
+void operator & (serializer& s, const TaskStatus& status)
+{
+  s.delimited(status, fields);
+}
+
+
+static void fields(deserializer& s, TaskStatus& status)
+{
+  s & status.taskId;
+  s & status.state;
+  s & status.data;
+}
+
+
+void operator & (deserializer& s, TaskStatus& status)
+{
+  s.delimited(status, fields);
+}
+
+
+// The typed cpus and mem of offers and tasks only go in the compact
+// encoding; in the original one they're left -1 for the reader to take
+// from params, as older peers do.
+static void fields(serializer& s, const SlaveOffer& offer)
 {
   s & offer.slaveId;
   s & offer.host;
   s & offer.params;
+  if (s.compact) {
+    s & offer.cpus;
+    s & offer.mem;
+  }
 }
 
 
-void operator & (deserializer& s, SlaveOffer& offer)
+void operator & (serializer& s, const SlaveOffer& offer)
+{
+  s.delimited(offer, fields);
+}
+
+
+static void fields(deserializer& s, SlaveOffer& offer)
 {
   s & offer.slaveId;
   s & offer.host;
   s & offer.params;
+  if (s.compact) {
+    s & offer.cpus;
+    s & offer.mem;
+  }
 }
 
 
-void operator & (serializer& s, const TaskDescription& task)
-{  
+void operator & (deserializer& s, SlaveOffer& offer)
+{
+  s.delimited(offer, fields);
+}
+
+
+static void fields(serializer& s, const TaskDescription& task)
+{
   s & task.taskId;
   s & task.slaveId;
   s & task.name;
   s & task.arg;
   s & task.params;
+  if (s.compact) {
+    s & task.cpus;
+    s & task.mem;
+  }
 }
 
 
-void operator & (deserializer& s, TaskDescription& task)
-{  
+void operator & (serializer& s, const TaskDescription& task)
+{
+  s.delimited(task, fields);
+}
+
+
+static void fields(deserializer& s, TaskDescription& task)
+{
   s & task.taskId;
   s & task.slaveId;
   s & task.name;
   s & task.arg;
   s & task.params;
+  if (s.compact) {
+    s & task.cpus;
+    s & task.mem;
+  }
 }
 
 
-void operator & (serializer& s, const FrameworkMessage& message)
+void operator & (deserializer& s, TaskDescription& task)
+{
+  s.delimited(task, fields);
+}
+
+
+static void fields(serializer& s, const FrameworkMessage& message)
 {
   s & message.slaveId;
   s & message.taskId;
@@ -90,7 +164,13 @@ void operator & (serializer& s, const FrameworkMessage& message)
 }
 
 
-void operator & (deserializer& s, FrameworkMessage& message)
+void operator & (serializer& s, const FrameworkMessage& message)
+{
+  s.delimited(message, fields);
+}
+
+
+static void fields(deserializer& s, FrameworkMessage& message)
 {
   s & message.slaveId;
   s & message.taskId;
@@ -98,7 +178,13 @@ void operator & (deserializer& s, FrameworkMessage& message)
 }
 
 
-void operator & (serializer& s, const ExecutorInfo& info)
+void operator & (deserializer& s, FrameworkMessage& message)
+{
+  s.delimited(message, fields);
+}
+
+
+static void fields(serializer& s, const ExecutorInfo& info)
 {
   s & info.uri;
   s & info.initArg;
@@ -106,7 +192,13 @@ void operator & (serializer& s, const ExecutorInfo& info)
 }
 
 
-void operator & (deserializer& s, ExecutorInfo& info)
+void operator & (serializer& s, const ExecutorInfo& info)
+{
+  s.delimited(info, fields);
+}
+
+
+static void fields(deserializer& s, ExecutorInfo& info)
 {
   s & info.uri;
   s & info.initArg;
@@ -114,6 +206,31 @@ void operator & (deserializer& s, ExecutorInfo& info)
 }
 
 
+void operator & (deserializer& s, ExecutorInfo& info)
+{
+  s.delimited(info, fields);
+}
+
+
+int64_t executorInfoHash(const ExecutorInfo& info)
+{
+  serializer counter;
+  counter & info;
+  string data(counter.size, '\0');
+  serializer s(&data[0]);
+  s & info;
+
+  // FNV-1a rather than boost::hash, which may differ between the
+  // builds of a master and its slaves.
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < data.size(); i++) {
+    hash ^= (unsigned char) data[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash == 0 ? 1 : (int64_t) hash;
+}
+
+
 void operator & (serializer& s, const Params& params)
 {
   const map<string, string>& map = params.getMap();
@@ -130,10 +247,12 @@ void operator & (deserializer& s, Params& params)
   map<string, string>& map = params.getMap();
   map.clear();
   int32_t size;
-  string key;
-  string value;
   s & size;
   for (int32_t i = 0; i < size; i++) {
+    // Fresh strings for every entry: the deserializer reads into a
+    // string's buffer, which may still be shared with the last entry.
+    string key;
+    string value;
     s & key;
     s & value;
     map[key] = value;
@@ -143,18 +262,71 @@ void operator & (deserializer& s, Params& params)
 
 void operator & (serializer& s, const Resources& resources)
 {
-  s & resources.cpus;
-  s & resources.mem;
+  if (!s.compact) {
+    s & resources[CPUS];
+    s & resources[MEM];
+    return;
+  }
+
+  int32_t count = resourceDimensions().size();
+  s & count;
+  for (int32_t i = 0; i < count; i++)
+    s & resources[i];
 }
 
 
 void operator & (deserializer& s, Resources& resources)
 {
-  s & resources.cpus;
-  s & resources.mem;
+  resources = Resources();
+  if (!s.compact) {
+    s & resources[CPUS];
+    s & resources[MEM];
+    return;
+  }
+
+  int32_t count;
+  s & count;
+  for (int32_t i = 0; i < count; i++) {
+    int32_t value;
+    s & value;
+    if (i < MAX_RESOURCE_DIMENSIONS)
+      resources[i] = value;
+  }
 }
 
-void operator & (serializer& s, const Task& taskInfo)
+
+vector<int32_t> otherResourceAmounts(const Resources& resources)
+{
+  vector<int32_t> amounts;
+  for (size_t i = MEM + 1; i < resourceDimensions().size(); i++)
+    amounts.push_back(resources[i]);
+  return amounts;
+}
+
+
+void setOtherResourceAmounts(const vector<int32_t>& amounts,
+                             Resources *resources)
+{
+  for (size_t i = 0; i < amounts.size(); i++)
+    if (MEM + 1 + i < (size_t) MAX_RESOURCE_DIMENSIONS)
+      (*resources)[MEM + 1 + i] = amounts[i];
+}
+
+
+void operator & (serializer& s, const RunTaskExtras& extras)
+{
+  s & extras.frameworkCapabilities;
+  s & extras.resources;
+}
+
+
+void operator & (deserializer& s, RunTaskExtras& extras)
+{
+  s & extras.frameworkCapabilities;
+  s & extras.resources;
+}
+
+static void fields(serializer& s, const Task& taskInfo)
 {
   s & taskInfo.id;
   s & taskInfo.frameworkId;
@@ -165,7 +337,13 @@ void operator & (serializer& s, const Task& taskInfo)
   s & taskInfo.slaveId;
 }
 
-void operator & (deserializer& s, Task& taskInfo)
+
+void operator & (serializer& s, const Task& taskInfo)
+{
+  s.delimited(taskInfo, fields);
+}
+
+static void fields(deserializer& s, Task& taskInfo)
 {
   s & taskInfo.id;
   s & taskInfo.frameworkId;
@@ -176,4 +354,10 @@ void operator & (deserializer& s, Task& taskInfo)
   s & taskInfo.slaveId;
 }
 
+
+void operator & (deserializer& s, Task& taskInfo)
+{
+  s.delimited(taskInfo, fields);
+}
+
 }} /* namespace mesos { namespace internal { */
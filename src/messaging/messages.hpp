@@ -3,6 +3,7 @@
 
 #include <float.h>
 #include <stdint.h>
+#include <string.h>
 
 #include <map>
 #include <string>
@@ -28,8 +29,50 @@
 
 namespace mesos { namespace internal {
 
+// Messages in the original encoding start with this and a '|'. Their
+// layout stays readable by older peers: fields only get appended to
+// the end of a message (where older peers ignore them, and newer peers
+// read them as zeros when an older peer leaves them out), and anything
+// else new is only sent in the compact encoding.
 const std::string MESOS_MESSAGING_VERSION = "0";
 
+// Messages in the compact binary encoding start with this byte
+// instead of MESOS_MESSAGING_VERSION and a '|' (old peers drop them,
+// so they only get sent to peers that advertise
+// CAPABILITY_BINARY_ENCODING).
+const char MESOS_BINARY_VERSION = 1;
+
+// Capabilities peers advertise to each other when they register (a
+// registration from an old peer doesn't have the field, which reads
+// as no capabilities).
+enum Capability {
+  CAPABILITY_BINARY_ENCODING = 1 << 0,
+  CAPABILITY_BATCHED_STATUS_UPDATES = 1 << 1,
+  CAPABILITY_CACHED_EXECUTOR_INFO = 1 << 2,
+  CAPABILITY_TASK_RESOURCES = 1 << 3, // Slave goes by RunTaskExtras
+};
+
+const int32_t MESOS_CAPABILITIES =
+  CAPABILITY_BINARY_ENCODING | CAPABILITY_BATCHED_STATUS_UPDATES |
+  CAPABILITY_CACHED_EXECUTOR_INFO | CAPABILITY_TASK_RESOURCES;
+
+
+// What a master sends a slave about a task after the fields that older
+// slaves read: the capabilities of the task's framework, and the
+// resources the master counts the task as using, which slaves that
+// advertise CAPABILITY_TASK_RESOURCES give the task (rather than what
+// its params say).
+struct RunTaskExtras
+{
+  RunTaskExtras() : frameworkCapabilities(0) {}
+
+  RunTaskExtras(int32_t _frameworkCapabilities, const Resources& _resources)
+    : frameworkCapabilities(_frameworkCapabilities), resources(_resources) {}
+
+  int32_t frameworkCapabilities;
+  Resources resources;
+};
+
 enum MessageType {
   /* From framework to master. */
   F2M_REGISTER_FRAMEWORK = RELIABLE_MSGID,
@@ -111,6 +154,17 @@ enum MessageType {
   S2S_GET_STATE_REPLY,
   S2S_SHUTDOWN,          // Used in tests to shut down slave
 
+  /* Batched status updates (from slave to master and from master to
+     framework), only sent to peers that advertise
+     CAPABILITY_BATCHED_STATUS_UPDATES. These come last so that the
+     ids of the messages above stay the same. */
+  S2M_STATUS_UPDATES,
+  M2F_STATUS_UPDATES,
+
+  /* A task for a framework whose executor info the slave already has,
+     only sent to slaves that advertise CAPABILITY_CACHED_EXECUTOR_INFO. */
+  M2S_RUN_CACHED_TASK,
+
   MESOS_MSGID,
 };
 
@@ -123,6 +177,46 @@ enum MessageType {
 #include <tuples/details.hpp>
 
 
+/*
+ * The body of a Mesos message: either the messaging version, a '|'
+ * and the serialized tuple, or MESOS_BINARY_VERSION and the tuple in
+ * the compact encoding, written straight into the outgoing message.
+ */
+template <MSGID ID>
+class TupleBody : public MessageBody
+{
+public:
+  TupleBody(const tuple<ID> &_t, bool _compact = false)
+    : t(_t), compact(_compact), size(_t.serialized_size(_compact)) {}
+
+  virtual size_t length() const
+  {
+    if (compact)
+      return 1 + size;
+    return MESOS_MESSAGING_VERSION.size() + 1 + size;
+  }
+
+  virtual void write(char *data) const
+  {
+    if (compact) {
+      data[0] = MESOS_BINARY_VERSION;
+      t.serialize_to(data + 1, true);
+      return;
+    }
+
+    size_t prefix = MESOS_MESSAGING_VERSION.size();
+    memcpy(data, MESOS_MESSAGING_VERSION.data(), prefix);
+    data[prefix] = '|';
+    t.serialize_to(data + prefix + 1);
+  }
+
+private:
+  const tuple<ID> &t;
+  const bool compact;
+  const size_t size;
+};
+
+
 class MesosProcess : public ReliableProcess
 {
 public:
@@ -135,19 +229,22 @@ public:
   template <MSGID ID>
   static void post(const PID &to, const tuple<ID> &t)
   {
-    const std::string &data = MESOS_MESSAGING_VERSION + "|" + std::string(t);
-    ReliableProcess::post(to, ID, data.data(), data.size());
+    ReliableProcess::post(to, ID, TupleBody<ID>(t));
   }
 
 protected:
-  std::string body() const
+  // The serialized tuple of the current message (read in place, so
+  // it's only valid until the next message is received).
+  process::tuples::view body() const
   {
     size_t size;
     const char *s = ReliableProcess::body(&size);
-    const std::string data(s, size);
-    size_t index = data.find('|');
-    CHECK(index != std::string::npos);
-    return data.substr(index + 1);
+    if (size > 0 && s[0] == MESOS_BINARY_VERSION)
+      return process::tuples::view(s + 1, size - 1, true);
+    const char *separator = (const char *) memchr(s, '|', size);
+    CHECK(separator != NULL);
+    size_t index = separator - s;
+    return process::tuples::view(s + index + 1, size - index - 1);
   }
 
   static void send(const PID &to, MSGID id)
@@ -159,29 +256,51 @@ protected:
   template <MSGID ID>
   void send(const PID &to, const tuple<ID> &t)
   {
-    const std::string &data = MESOS_MESSAGING_VERSION + "|" + std::string(t);
-    ReliableProcess::send(to, ID, data.data(), data.size());
+    ReliableProcess::send(to, ID, TupleBody<ID>(t, compact(to)));
   }
 
   template <MSGID ID>
   bool forward(const PID &to, const tuple<ID> &t)
   {
-    const std::string &data = MESOS_MESSAGING_VERSION + "|" + std::string(t);
-    ReliableProcess::forward(to, ID, data.data(), data.size());
+    return ReliableProcess::forward(to, ID, TupleBody<ID>(t, compact(to)));
   }
 
   template <MSGID ID>
   int rsend(const PID &to, const tuple<ID> &t)
   {
-    const std::string &data = MESOS_MESSAGING_VERSION + "|" + std::string(t);
-    return ReliableProcess::rsend(to, ID, data.data(), data.size());
+    return ReliableProcess::rsend(to, ID, TupleBody<ID>(t, compact(to)));
   }
 
   template <MSGID ID>
   int rsend(const PID &via, const PID &to, const tuple<ID> &t)
   {
-    const std::string &data = MESOS_MESSAGING_VERSION + "|" + std::string(t);
-    return ReliableProcess::rsend(via, to, ID, data.data(), data.size());
+    return ReliableProcess::rsend(via, to, ID,
+                                  TupleBody<ID>(t, compact(via)));
+  }
+
+  // Records the capabilities a peer advertised when it registered,
+  // which decide how messages to it get encoded and which messages it
+  // gets sent (a peer that advertised none, or is gone, is forgotten
+  // about).
+  void recordCapabilities(const PID &peer, int32_t capabilities)
+  {
+    if (capabilities != 0)
+      peers[peer] = capabilities;
+    else
+      peers.erase(peer);
+  }
+
+  // The capabilities a peer advertised (none if it didn't).
+  int32_t capabilities(const PID &peer) const
+  {
+    std::map<PID, int32_t>::const_iterator it = peers.find(peer);
+    return it != peers.end() ? it->second : 0;
+  }
+
+  // Whether messages to a peer can use the compact encoding.
+  bool compact(const PID &peer) const
+  {
+    return capabilities(peer) & CAPABILITY_BINARY_ENCODING;
   }
 
   virtual MSGID receive(double secs = 0)
@@ -192,10 +311,12 @@ protected:
     if (RELIABLE_MSGID < id && id < MESOS_MSGID) {
       size_t size;
       const char *s = ReliableProcess::body(&size);
-      const std::string data(s, size);
-      size_t index = data.find('|');
-      if (index == std::string::npos ||
-          MESOS_MESSAGING_VERSION != data.substr(0, index)) {
+      if (size > 0 && s[0] == MESOS_BINARY_VERSION)
+        return id;
+      const char *separator = (const char *) memchr(s, '|', size);
+      if (separator == NULL ||
+          MESOS_MESSAGING_VERSION.compare(0, std::string::npos,
+                                          s, separator - s) != 0) {
         LOG(ERROR) << "Dropping message from " << from()
                    << " with incorrect messaging version!";
         if (!indefinite) {
@@ -208,6 +329,10 @@ protected:
     }
     return id;
   }
+
+private:
+  // Capabilities of the peers that advertised any.
+  std::map<PID, int32_t> peers;
 };
 
 
@@ -218,14 +343,16 @@ using boost::tuples::tie;
 TUPLE(F2M_REGISTER_FRAMEWORK,
       (std::string /*name*/,
        std::string /*user*/,
-       ExecutorInfo));
+       ExecutorInfo,
+       int32_t /*capabilities*/));
 
 TUPLE(F2M_REREGISTER_FRAMEWORK,
       (FrameworkID,
        std::string /*name*/,
        std::string /*user*/,
        ExecutorInfo,
-       int32_t /*generation*/));
+       int32_t /*generation*/,
+       int32_t /*capabilities*/));
 
 TUPLE(F2M_UNREGISTER_FRAMEWORK,
       (FrameworkID));
@@ -251,7 +378,8 @@ TUPLE(F2F_TASK_RUNNING_STATUS,
       ());
 
 TUPLE(M2F_REGISTER_REPLY,
-      (FrameworkID));
+      (FrameworkID,
+       int32_t /*capabilities*/));
 
 TUPLE(M2F_SLOT_OFFER,
       (OfferID,
@@ -280,14 +408,20 @@ TUPLE(M2F_ERROR,
 TUPLE(S2M_REGISTER_SLAVE,
       (std::string /*name*/,
        std::string /*webUIUrl*/,
-       Resources));
+       Resources,
+       int32_t /*capabilities*/,
+       std::vector<int32_t> /*other resource amounts*/));
 
 TUPLE(S2M_REREGISTER_SLAVE,
       (SlaveID,
        std::string /*name*/,
        std::string /*webuiUrl*/,
        Resources,
-       std::vector<Task>));
+       std::vector<Task>,
+       std::vector<FrameworkID> /*frameworks with executors*/,
+       int32_t /*capabilities*/,
+       std::vector<int32_t> /*other resource amounts*/,
+       std::vector<std::vector<int32_t> > /*tasks' other amounts*/));
 
 TUPLE(S2M_UNREGISTER_SLAVE,
       (SlaveID));
@@ -324,11 +458,13 @@ TUPLE(GOT_MASTER_ID,
   
 TUPLE(M2S_REGISTER_REPLY,
       (SlaveID,
-       double /*heartbeat interval*/));
+       double /*heartbeat interval*/,
+       int32_t /*capabilities*/));
 
 TUPLE(M2S_REREGISTER_REPLY,
       (SlaveID,
-       double /*heartbeat interval*/));
+       double /*heartbeat interval*/,
+       int32_t /*capabilities*/));
 
 TUPLE(M2S_RUN_TASK,
       (FrameworkID,
@@ -339,7 +475,18 @@ TUPLE(M2S_RUN_TASK,
        std::string /*taskName*/,
        std::string /*taskArgs*/,
        Params,
-       PID /*framework PID*/));
+       PID /*framework PID*/,
+       RunTaskExtras));
+
+TUPLE(M2S_RUN_CACHED_TASK,
+      (FrameworkID,
+       TaskID,
+       int64_t /*executor info hash*/,
+       std::string /*taskName*/,
+       std::string /*taskArgs*/,
+       Params,
+       PID /*framework PID*/,
+       Resources));
 
 TUPLE(M2S_KILL_TASK,
       (FrameworkID,
@@ -354,13 +501,15 @@ TUPLE(M2S_FRAMEWORK_MESSAGE,
 
 TUPLE(M2S_UPDATE_FRAMEWORK_PID,
       (FrameworkID,
-       PID));
+       PID,
+       int32_t /*framework capabilities*/));
 
 TUPLE(M2S_SHUTDOWN,
       ());
 
 TUPLE(E2S_REGISTER_EXECUTOR,
-      (FrameworkID));
+      (FrameworkID,
+       int32_t /*capabilities*/));
 
 TUPLE(E2S_STATUS_UPDATE,
       (FrameworkID,
@@ -376,7 +525,8 @@ TUPLE(S2E_REGISTER_REPLY,
       (SlaveID,
        std::string /*hostname*/,
        std::string /*frameworkName*/,
-       std::string /*initArg*/));
+       std::string /*initArg*/,
+       int32_t /*capabilities*/));
 
 TUPLE(S2E_RUN_TASK,
       (TaskID,
@@ -431,6 +581,14 @@ TUPLE(S2S_GET_STATE_REPLY,
 TUPLE(S2S_SHUTDOWN,
       ());
 
+TUPLE(S2M_STATUS_UPDATES,
+      (SlaveID,
+       FrameworkID,
+       std::vector<TaskStatus>));
+
+TUPLE(M2F_STATUS_UPDATES,
+      (std::vector<TaskStatus>));
+
 
 /* Serialization functions for sharing objects of local Mesos types. */
 
@@ -446,6 +604,9 @@ void operator & (process::tuples::deserializer&, slave::state::SlaveState *&);
 void operator & (process::tuples::serializer&, const TaskState&);
 void operator & (process::tuples::deserializer&, TaskState&);
 
+void operator & (process::tuples::serializer&, const TaskStatus&);
+void operator & (process::tuples::deserializer&, TaskStatus&);
+
 void operator & (process::tuples::serializer&, const SlaveOffer&);
 void operator & (process::tuples::deserializer&, SlaveOffer&);
 
@@ -458,12 +619,28 @@ void operator & (process::tuples::deserializer&, FrameworkMessage&);
 void operator & (process::tuples::serializer&, const ExecutorInfo&);
 void operator & (process::tuples::deserializer&, ExecutorInfo&);
 
+// A hash of an ExecutorInfo's contents (never 0), by which a master
+// refers to an ExecutorInfo it has already sent a slave (to slaves
+// that advertise CAPABILITY_CACHED_EXECUTOR_INFO).
+int64_t executorInfoHash(const ExecutorInfo&);
+
 void operator & (process::tuples::serializer&, const Params&);
 void operator & (process::tuples::deserializer&, Params&);
 
+// Resources have just cpus and mem in the original encoding, and every
+// dimension in the compact one.
 void operator & (process::tuples::serializer&, const Resources&);
 void operator & (process::tuples::deserializer&, Resources&);
 
+// The amounts of the dimensions after cpus and mem, which messages sent
+// before the compact encoding has been negotiated (registrations) carry
+// in a field of their own.
+std::vector<int32_t> otherResourceAmounts(const Resources&);
+void setOtherResourceAmounts(const std::vector<int32_t>&, Resources *);
+
+void operator & (process::tuples::serializer&, const RunTaskExtras&);
+void operator & (process::tuples::deserializer&, RunTaskExtras&);
+
 void operator & (process::tuples::serializer&, const Task&);
 void operator & (process::tuples::deserializer&, Task&);
 
@@ -513,9 +690,11 @@ void operator & (process::tuples::deserializer& d, std::map<K, V>& m)
   m.clear();
   int32_t size;
   d & size;
-  K k;
-  V v;
   for (size_t i = 0; i < size; i++) {
+    // Fresh keys and values for every entry, since strings are read
+    // into their buffers, which may be shared with the previous entry.
+    K k;
+    V v;
     d & k;
     d & v;
     m[k] = v;
@@ -170,16 +170,19 @@ protected:
 	VLOG(1) << "New master at " << masterPid << " with ID:" << masterSeq;
 
         redirect(master, masterPid);
+        recordCapabilities(master, 0);
 	master = masterPid;
 	link(master);
 
 	if (fid == "") {
 	  // Touched for the very first time.
-	  send(master, pack<F2M_REGISTER_FRAMEWORK>(frameworkName, user, execInfo));
+	  send(master, pack<F2M_REGISTER_FRAMEWORK>(frameworkName, user, execInfo,
+                                                    MESOS_CAPABILITIES));
 	} else {
 	  // Not the first time, or failing over.
 	  send(master, pack<F2M_REREGISTER_FRAMEWORK>(fid, frameworkName, user,
-						      execInfo, generation++));
+						      execInfo, generation++,
+                                                      MESOS_CAPABILITIES));
 	}
 	break;
       }
@@ -193,7 +196,9 @@ protected:
       }
 
       case M2F_REGISTER_REPLY: {
-        tie(fid) = unpack<M2F_REGISTER_REPLY>(body());
+        int32_t capabilities;
+        tie(fid, capabilities) = unpack<M2F_REGISTER_REPLY>(body());
+        recordCapabilities(master, capabilities);
         invoke(bind(&Scheduler::registered, sched, driver, fid));
         break;
       }
@@ -231,25 +236,41 @@ protected:
         string data;
         tie(tid, state, data) = unpack<M2F_STATUS_UPDATE>(body());
 
+        // Acknowledge duplicates too, since the master only resends a
+        // status update if our previous acknowledgement got lost.
+        ack();
+
         if (duplicate()) {
           VLOG(1) << "Received a duplicate status update for tid " << tid
 		     << ", status = " << state;
           break;
         }
 
+        stopStatusUpdateTimer(tid);
+
+        TaskStatus status(tid, state, data);
+        invoke(bind(&Scheduler::statusUpdate, sched, driver, ref(status)));
+        break;
+      }
+
+      case M2F_STATUS_UPDATES: {
+        vector<TaskStatus> updates;
+        tie(updates) = unpack<M2F_STATUS_UPDATES>(body());
+
+        // One acknowledgement for the whole batch (see above for why
+        // duplicates get acknowledged as well).
         ack();
 
-        // Stop any status update timers we might have had running.
-        if (timers.count(tid) > 0) {
-          StatusUpdateTimer* timer = timers[tid];
-          timers.erase(tid);
-          send(timer->self(), MESOS_MSGID);
-          wait(timer->self());
-          delete timer;
+        if (duplicate()) {
+          VLOG(1) << "Received a duplicate batch of " << updates.size()
+                  << " status updates";
+          break;
         }
 
-        TaskStatus status(tid, state, data);
-        invoke(bind(&Scheduler::statusUpdate, sched, driver, ref(status)));
+        foreach (TaskStatus &status, updates) {
+          stopStatusUpdateTimer(status.taskId);
+          invoke(bind(&Scheduler::statusUpdate, sched, driver, ref(status)));
+        }
         break;
       }
 
@@ -327,8 +348,19 @@ protected:
       spawn(timer);
     }
 
+    // Fill in the typed resources of each task from its params so that
+    // the master doesn't have to parse them.
+    vector<TaskDescription> typedTasks = tasks;
+    foreach (TaskDescription& task, typedTasks) {
+      if (task.cpus == -1 || task.mem == -1) {
+        Params taskParams(task.params);
+        task.cpus = taskParams.getInt32("cpus", -1);
+        task.mem = taskParams.getInt32("mem", -1);
+      }
+    }
+
     send(master,
-         pack<F2M_SLOT_OFFER_REPLY>(fid, offerId, tasks, Params(params)));
+         pack<F2M_SLOT_OFFER_REPLY>(fid, offerId, typedTasks, Params(params)));
   }
 
   void reviveOffers()
@@ -351,6 +383,18 @@ protected:
   }
 
 private:
+  // Stop any status update timer we might have had running for a task.
+  void stopStatusUpdateTimer(TaskID tid)
+  {
+    if (timers.count(tid) > 0) {
+      StatusUpdateTimer* timer = timers[tid];
+      timers.erase(tid);
+      send(timer->self(), MESOS_MSGID);
+      wait(timer->self());
+      delete timer;
+    }
+  }
+
   friend class mesos::MesosSchedulerDriver;
 
   MesosSchedulerDriver* driver;
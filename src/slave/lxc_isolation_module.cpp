@@ -166,7 +166,7 @@ void LxcIsolationModule::resourcesChanged(Framework* fw)
     // separate thread, and to give frameworks some time to scale down their
     // memory usage.
 
-    int32_t cpuShares = max(CPU_SHARES_PER_CPU * fw->resources.cpus,
+    int32_t cpuShares = max(CPU_SHARES_PER_CPU * fw->resources[CPUS],
                             MIN_CPU_SHARES);
     if (!setResourceLimit(fw, "cpu.shares", cpuShares)) {
       // Tell slave to kill framework, which will invoke killExecutor.
@@ -174,7 +174,7 @@ void LxcIsolationModule::resourcesChanged(Framework* fw)
       return;
     }
 
-    int64_t rssLimit = max(fw->resources.mem, MIN_RSS) * 1024LL * 1024LL;
+    int64_t rssLimit = max(fw->resources[MEM], MIN_RSS) * 1024LL * 1024LL;
     if (!setResourceLimit(fw, "memory.limit_in_bytes", rssLimit)) {
       // Tell slave to kill framework, which will invoke killExecutor.
       slave->killFramework(fw);
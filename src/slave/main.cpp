@@ -35,6 +35,10 @@ int main(int argc, char **argv)
   Configurator conf;
   conf.addOption<string>("url", 'u', "Master URL");
   conf.addOption<string>("isolation", 'i', "Isolation module name", "process");
+  conf.addOption<string>("resource_dimensions",
+                         "Comma-separated names of resources to offer\n"
+                         "besides cpus, mem, disk and net (e.g. gpus);\n"
+                         "slaves take their amounts as options too");
 #ifdef MESOS_WEBUI
   conf.addOption<int>("webui_port", 'w', "Web UI port", 8081);
 #endif
@@ -56,6 +60,8 @@ int main(int argc, char **argv)
 
   Logging::init(argv[0], params);
 
+  registerResourceDimensions(params.get("resource_dimensions", ""));
+
   if (!params.contains("url")) {
     cerr << "Master URL argument (--url) required." << endl;
     exit(1);
@@ -164,8 +164,8 @@ public:
       case S2PD_UPDATE_RESOURCES: {
         Resources res;
 	tie(res) = unpack<S2PD_UPDATE_RESOURCES>(body());
-	this->cpuShares = (res.cpus > 0 ? res.cpus*10 : 1);
-	this->mem = (res.mem > 0 ? res.mem : 512 * Megabyte);
+	this->cpuShares = (res[CPUS] > 0 ? res[CPUS]*10 : 1);
+	this->mem = (res[MEM] > 0 ? res[MEM] : 512 * Megabyte);
 	break;
       }
       case S2PD_KILL_ALL: {
@@ -16,6 +16,7 @@
 
 using std::list;
 using std::make_pair;
+using std::max;
 using std::ostringstream;
 using std::istringstream;
 using std::pair;
@@ -42,10 +43,12 @@ private:
   PID slave;
   SlaveID sid;
   double interval;
+  int32_t capabilities;
 
 protected:
   void operator () ()
   {
+    recordCapabilities(master, capabilities);
     link(slave);
     link(master);
     do {
@@ -60,8 +63,10 @@ protected:
   }
 
 public:
-  Heart(const PID &_master, const PID &_slave, SlaveID _sid, double _interval)
-    : master(_master), slave(_slave), sid(_sid), interval(_interval) {}
+  Heart(const PID &_master, const PID &_slave, SlaveID _sid, double _interval,
+        int32_t _capabilities)
+    : master(_master), slave(_slave), sid(_sid), interval(_interval),
+      capabilities(_capabilities) {}
 };
 
 
@@ -69,6 +74,15 @@ public:
 const int32_t DEFAULT_CPUS = 1;
 const int32_t DEFAULT_MEM = 1 * Gigabyte;
 
+// Default window to collect status updates for a framework in before
+// sending them to the master together (none, so each one gets sent
+// right away), and most updates per batch.
+const double DEFAULT_STATUS_UPDATE_BATCH_WINDOW = 0;
+const int32_t DEFAULT_STATUS_UPDATE_BATCH_SIZE = 100;
+
+// A batch gets sent early once its update data reaches this size.
+const size_t STATUS_UPDATE_BATCH_BYTES = 64 * 1024;
+
 
 } /* namespace */
 
@@ -76,14 +90,26 @@ const int32_t DEFAULT_MEM = 1 * Gigabyte;
 Slave::Slave(Resources _resources, bool _local,
              IsolationModule *_isolationModule)
   : id(""), resources(_resources), local(_local),
-    isolationModule(_isolationModule) {}
+    isolationModule(_isolationModule), statusUpdateDeadline(0),
+    statusUpdateBatchWindow(DEFAULT_STATUS_UPDATE_BATCH_WINDOW),
+    statusUpdateBatchSize(DEFAULT_STATUS_UPDATE_BATCH_SIZE),
+    statusUpdateBatchesSent(0), batchedStatusUpdates(0) {}
 
 
 Slave::Slave(const Params& _conf, bool _local, IsolationModule *_module)
-  : id(""), conf(_conf), local(_local), isolationModule(_module)
+  : id(""), conf(_conf), local(_local), isolationModule(_module),
+    statusUpdateDeadline(0), statusUpdateBatchesSent(0),
+    batchedStatusUpdates(0)
 {
+  statusUpdateBatchWindow = conf.get<double>("status_update_batch_window",
+                                             DEFAULT_STATUS_UPDATE_BATCH_WINDOW);
+  statusUpdateBatchSize = conf.get<int32_t>("status_update_batch_size",
+                                            DEFAULT_STATUS_UPDATE_BATCH_SIZE);
   resources = Resources(conf.get<int32_t>("cpus", DEFAULT_CPUS),
                         conf.get<int32_t>("mem", DEFAULT_MEM));
+  const vector<string>& names = resourceDimensions();
+  for (size_t i = MEM + 1; i < names.size(); i++)
+    resources[i] = conf.get<int32_t>(names[i], 0);
 }
 
 
@@ -93,6 +119,9 @@ void Slave::registerOptions(Configurator* conf)
                            DEFAULT_CPUS);
   conf->addOption<int64_t>("mem", 'm', "Memory for use by tasks, in MB\n",
                            DEFAULT_MEM);
+  conf->addOption<int32_t>("disk", "Disk space for use by tasks, in MB", 0);
+  conf->addOption<int32_t>("net",
+                           "Network bandwidth for use by tasks, in Mbps", 0);
   conf->addOption<string>("work_dir",
                           "Where to place framework work directories\n"
                           "(default: MESOS_HOME/work)");
@@ -109,6 +138,15 @@ void Slave::registerOptions(Configurator* conf)
    conf->addOption<string>("frameworks_home",
                            "Directory prepended to relative executor\n"
                            "paths (default: MESOS_HOME/frameworks)");
+  conf->addOption<double>("status_update_batch_window",
+                          "Seconds to collect a framework's status updates\n"
+                          "for before sending them to the master together\n"
+                          "(0 to send each one right away; try 0.01\n"
+                          "for workloads with many short tasks)",
+                          DEFAULT_STATUS_UPDATE_BATCH_WINDOW);
+  conf->addOption<int32_t>("status_update_batch_size",
+                           "Most status updates to send to the master at once",
+                           DEFAULT_STATUS_UPDATE_BATCH_SIZE);
 }
 
 
@@ -125,17 +163,23 @@ state::SlaveState *Slave::getState()
   std::ostringstream master_pid;
   master_pid << master;
   state::SlaveState *state =
-    new state::SlaveState(BUILD_DATE, BUILD_USER, id, resources.cpus, 
-        resources.mem, my_pid.str(), master_pid.str());
+    new state::SlaveState(BUILD_DATE, BUILD_USER, id, resources[CPUS], 
+        resources[MEM], my_pid.str(), master_pid.str());
+
+  state->other_resources = otherResourcesString(resources);
+  state->unacknowledged_messages = unacknowledged();
+  state->status_update_batches = statusUpdateBatchesSent;
+  state->batched_status_updates = batchedStatusUpdates;
 
   foreachpair(_, Framework *f, frameworks) {
     state::Framework *framework = new state::Framework(f->id, f->name, 
-        f->executorInfo.uri, f->executorStatus, f->resources.cpus,
-        f->resources.mem);
+        f->executorInfo.uri, f->executorStatus, f->resources[CPUS],
+        f->resources[MEM]);
+    framework->other_resources = otherResourcesString(f->resources);
     state->frameworks.push_back(framework);
     foreachpair(_, Task *t, f->tasks) {
       state::Task *task = new state::Task(t->id, t->name, t->state,
-          t->resources.cpus, t->resources.mem);
+          t->resources[CPUS], t->resources[MEM]);
       framework->tasks.push_back(task);
     }
   }
@@ -172,7 +216,12 @@ void Slave::operator () ()
   isolationModule->initialize(this);
 
   while (true) {
-    switch (receive()) {
+    // Wait no longer than until batched status updates are due, if any.
+    double timeout = 0;
+    if (statusUpdateDeadline != 0)
+      timeout = max(statusUpdateDeadline - elapsed(), 0.0001);
+
+    switch (receive(timeout)) {
       case NEW_MASTER_DETECTED: {
 	string masterSeq;
 	PID masterPid;
@@ -181,16 +230,20 @@ void Slave::operator () ()
 	LOG(INFO) << "New master at " << masterPid << " with ID:" << masterSeq;
 
         redirect(master, masterPid);
+        recordCapabilities(master, 0);
 	master = masterPid;
 	link(master);
 
 	if (id.empty()) {
 	  // Slave started before master.
-	  send(master, pack<S2M_REGISTER_SLAVE>(hostname, webUIUrl, resources));
+	  send(master, pack<S2M_REGISTER_SLAVE>(hostname, webUIUrl, resources,
+                                                MESOS_CAPABILITIES,
+                                                otherResourceAmounts(resources)));
 	} else {
 	  // Reconnecting, so reconstruct resourcesInUse for the master.
 	  Resources resourcesInUse; 
 	  vector<Task> taskVec;
+	  vector<vector<int32_t> > taskOtherAmounts;
 
 	  foreachpair(_, Framework *framework, frameworks) {
 	    foreachpair(_, Task *task, framework->tasks) {
@@ -198,10 +251,21 @@ void Slave::operator () ()
 	      Task ti = *task;
 	      ti.slaveId = id;
 	      taskVec.push_back(ti);
+	      taskOtherAmounts.push_back(otherResourceAmounts(task->resources));
 	    }
 	  }
 
-	  send(master, pack<S2M_REREGISTER_SLAVE>(id, hostname, webUIUrl, resources, taskVec));
+	  // Also tell the master which frameworks have executors here, so
+	  // it knows to send them framework updates.
+	  vector<FrameworkID> executorVec;
+	  foreachpair(const FrameworkID& fid, _, executors)
+	    executorVec.push_back(fid);
+
+	  send(master, pack<S2M_REREGISTER_SLAVE>(id, hostname, webUIUrl, resources,
+						  taskVec, executorVec,
+                                                  MESOS_CAPABILITIES,
+                                                  otherResourceAmounts(resources),
+                                                  taskOtherAmounts));
 	}
 	break;
       }
@@ -213,21 +277,29 @@ void Slave::operator () ()
 
       case M2S_REGISTER_REPLY: {
 	double interval = 0;
-        tie(this->id, interval) = unpack<M2S_REGISTER_REPLY>(body());
+        int32_t capabilities;
+        tie(this->id, interval, capabilities) =
+          unpack<M2S_REGISTER_REPLY>(body());
         LOG(INFO) << "Registered with master; given slave ID " << this->id;
-        link(spawn(new Heart(master, self(), this->id, interval)));
+        recordCapabilities(master, capabilities);
+        link(spawn(new Heart(master, self(), this->id, interval,
+                             capabilities)));
         break;
       }
       
       case M2S_REREGISTER_REPLY: {
         SlaveID sid;
 	double interval = 0;
-        tie(sid, interval) = unpack<M2S_REREGISTER_REPLY>(body());
+        int32_t capabilities;
+        tie(sid, interval, capabilities) =
+          unpack<M2S_REREGISTER_REPLY>(body());
         LOG(INFO) << "RE-registered with master; given slave ID " << sid << " had "<< this->id;
         if (this->id == "")
           this->id = sid;
         CHECK(this->id == sid);
-        link(spawn(new Heart(master, self(), this->id, interval)));
+        recordCapabilities(master, capabilities);
+        link(spawn(new Heart(master, self(), this->id, interval,
+                             capabilities)));
         break;
       }
       
@@ -238,31 +310,58 @@ void Slave::operator () ()
         ExecutorInfo execInfo;
         Params params;
         PID pid;
-        tie(fid, tid, fwName, user, execInfo, taskName, taskArg, params, pid) =
-          unpack<M2S_RUN_TASK>(body());
+        RunTaskExtras extras;
+        tie(fid, tid, fwName, user, execInfo, taskName, taskArg, params, pid,
+            extras) = unpack<M2S_RUN_TASK>(body());
         LOG(INFO) << "Got assigned task " << fid << ":" << tid;
-        Resources res;
-        res.cpus = params.getInt32("cpus", -1);
-        res.mem = params.getInt64("mem", -1);
         Framework *framework = getFramework(fid);
         if (framework == NULL) {
           // Framework not yet created on this node - create it.
           framework = new Framework(fid, fwName, user, execInfo, pid);
           frameworks[fid] = framework;
+          recordCapabilities(pid, extras.frameworkCapabilities);
           isolationModule->startExecutor(framework);
+        } else if (MesosProcess::capabilities(master) &
+                   CAPABILITY_CACHED_EXECUTOR_INFO) {
+          // Keep what the master last sent, so that it can refer to it.
+          framework->executorInfo = execInfo;
+          framework->executorInfoHash = executorInfoHash(execInfo);
         }
-        Task *task = framework->addTask(tid, taskName, res);
-        Executor *executor = getExecutor(fid);
-        if (executor) {
-          send(executor->pid,
-               pack<S2E_RUN_TASK>(tid, taskName, taskArg, params));
-          isolationModule->resourcesChanged(framework);
-        } else {
-          // Executor not yet registered; queue task for when it starts up
-          TaskDescription *td = new TaskDescription(
-              tid, taskName, taskArg, params.str());
-          framework->queuedTasks.push_back(td);
+        runTask(framework, tid, taskName, taskArg, params, extras.resources);
+        break;
+      }
+
+      case M2S_RUN_CACHED_TASK: {
+        FrameworkID fid;
+        TaskID tid;
+        int64_t hash;
+        string taskName, taskArg;
+        Params params;
+        PID pid;
+        Resources resources;
+        tie(fid, tid, hash, taskName, taskArg, params, pid, resources) =
+          unpack<M2S_RUN_CACHED_TASK>(body());
+        LOG(INFO) << "Got assigned task " << fid << ":" << tid;
+        Framework *framework = getFramework(fid);
+        if (framework == NULL || framework->executorInfoHash != hash) {
+          // The executor exited (and took the executor info with it)
+          // before the master heard about it.
+          LOG(WARNING) << "Lost task " << fid << ":" << tid << " because "
+                       << "its executor info is no longer cached";
+          TaskStatus update(tid, TASK_LOST, "Executor info not cached");
+          if (framework != NULL) {
+            statusUpdate(framework, update);
+          } else {
+            // There are no other updates for the framework to keep this
+            // one in order with, but remember its sequence number so
+            // that killing the framework cancels it like the others.
+            int seq = rsend(master, pid, pack<S2M_STATUS_UPDATE>(
+                              id, fid, tid, update.state, update.data));
+            seqs[fid].insert(seq);
+          }
+          break;
         }
+        runTask(framework, tid, taskName, taskArg, params, resources);
         break;
       }
 
@@ -311,18 +410,25 @@ void Slave::operator () ()
       case M2S_UPDATE_FRAMEWORK_PID: {
         FrameworkID fid;
         PID pid;
-        tie(fid, pid) = unpack<M2S_UPDATE_FRAMEWORK_PID>(body());
+        int32_t capabilities;
+        tie(fid, pid, capabilities) = unpack<M2S_UPDATE_FRAMEWORK_PID>(body());
         Framework *framework = getFramework(fid);
         if (framework != NULL) {
           LOG(INFO) << "Updating framework " << fid << " pid to " << pid;
+          // Batches are sent for the framework's new pid, so send any
+          // collected for the old one first.
+          flushStatusUpdates(framework);
+          recordCapabilities(framework->pid, 0);
           framework->pid = pid;
+          recordCapabilities(pid, capabilities);
         }
         break;
       }
 
       case E2S_REGISTER_EXECUTOR: {
         FrameworkID fid;
-        tie(fid) = unpack<E2S_REGISTER_EXECUTOR>(body());
+        int32_t capabilities;
+        tie(fid, capabilities) = unpack<E2S_REGISTER_EXECUTOR>(body());
         LOG(INFO) << "Got executor registration for framework " << fid;
         if (Framework *fw = getFramework(fid)) {
           if (getExecutor(fid) != 0) {
@@ -334,13 +440,15 @@ void Slave::operator () ()
           Executor *executor = new Executor(fid, from());
           executors[fid] = executor;
           link(from());
+          recordCapabilities(from(), capabilities);
           // Now that the executor is up, set its resource limits
           isolationModule->resourcesChanged(fw);
           // Tell executor that it's registered and give it its queued tasks
           send(from(), pack<S2E_REGISTER_REPLY>(this->id,
                                                 hostname,
                                                 fw->name,
-                                                fw->executorInfo.initArg));
+                                                fw->executorInfo.initArg,
+                                                MESOS_CAPABILITIES));
           sendQueuedTasks(fw);
         } else {
           // Framework is gone; tell the executor to exit
@@ -367,12 +475,7 @@ void Slave::operator () ()
             isolationModule->resourcesChanged(framework);
           }
 
-	  // Reliably send message and save sequence number for
-	  // canceling later.
-	  int seq = rsend(master, framework->pid,
-			  pack<S2M_STATUS_UPDATE>(id, fid, tid,
-                                                  taskState, data));
-	  seqs[fid].insert(seq);
+          statusUpdate(framework, TaskStatus(tid, taskState, data));
 	} else {
 	  LOG(WARNING) << "Got status update for UNKNOWN task "
 		       << fid << ":" << tid;
@@ -421,6 +524,7 @@ void Slave::operator () ()
 			<< " disconnected";
 	      Framework *framework = getFramework(ex->frameworkId);
 	      if (framework != NULL) {
+                flushStatusUpdates(framework);
 		send(master, pack<S2M_LOST_EXECUTOR>(id, ex->frameworkId, -1));
 		killFramework(framework);
 	      }
@@ -450,12 +554,19 @@ void Slave::operator () ()
         return;
       }
 
+      case PROCESS_TIMEOUT: {
+        break;
+      }
+
       default: {
         LOG(ERROR) << "Received unknown message ID " << msgid()
                    << " from " << from();
         break;
       }
     }
+
+    if (statusUpdateDeadline != 0 && statusUpdateDeadline <= elapsed())
+      flushStatusUpdates();
   }
 }
 
@@ -492,11 +603,126 @@ void Slave::sendQueuedTasks(Framework *framework)
 }
 
 
+// Start a task for a framework, or queue it until the framework's
+// executor registers. The task gets the resources the master counted
+// it as using, which a master from before CAPABILITY_TASK_RESOURCES
+// doesn't send (so they're all 0); it goes by the task's params then.
+void Slave::runTask(Framework *framework, const TaskID &tid,
+                    const string &name, const string &arg,
+                    const Params &params, const Resources &resources)
+{
+  Params taskParams(params);
+  Resources res = resources;
+  if (res.anyPositive())
+    resourcesToParams(res, &taskParams); // What the executor sees
+  else
+    res = paramsToResources(params);
+
+  framework->addTask(tid, name, res);
+  Executor *executor = getExecutor(framework->id);
+  if (executor) {
+    send(executor->pid, pack<S2E_RUN_TASK>(tid, name, arg, taskParams));
+    isolationModule->resourcesChanged(framework);
+  } else {
+    // Executor not yet registered; queue task for when it starts up
+    TaskDescription *td =
+      new TaskDescription(tid, name, arg, taskParams.str());
+    framework->queuedTasks.push_back(td);
+  }
+}
+
+
+// Send a status update for a task to the master, either right away or
+// in a batch with the framework's other updates
+void Slave::statusUpdate(Framework *framework, const TaskStatus &update)
+{
+  const int32_t batched = CAPABILITY_BATCHED_STATUS_UPDATES;
+  if (statusUpdateBatchWindow <= 0 ||
+      !(capabilities(master) & batched) ||
+      !(capabilities(framework->pid) & batched)) {
+    // Keep the updates in order.
+    flushStatusUpdates(framework);
+
+    // Reliably send message and save sequence number for
+    // canceling later.
+    int seq = rsend(master, framework->pid,
+                    pack<S2M_STATUS_UPDATE>(id, framework->id, update.taskId,
+                                            update.state, update.data));
+    seqs[framework->id].insert(seq);
+    return;
+  }
+
+  StatusUpdateBatch &batch = statusUpdateBatches[framework->id];
+  batch.updates.push_back(update);
+  batch.bytes += update.data.size();
+
+  if (batch.updates.size() >= (size_t) statusUpdateBatchSize ||
+      batch.bytes >= STATUS_UPDATE_BATCH_BYTES) {
+    flushStatusUpdates(framework);
+  } else if (statusUpdateDeadline == 0) {
+    statusUpdateDeadline = elapsed() + statusUpdateBatchWindow;
+  }
+}
+
+
+// Send the batched status updates for a framework right away
+void Slave::flushStatusUpdates(Framework *framework)
+{
+  unordered_map<FrameworkID, StatusUpdateBatch>::iterator it =
+    statusUpdateBatches.find(framework->id);
+  if (it == statusUpdateBatches.end())
+    return;
+
+  const vector<TaskStatus> &updates = it->second.updates;
+
+  const int32_t batched = CAPABILITY_BATCHED_STATUS_UPDATES;
+  if ((capabilities(master) & batched) &&
+      (capabilities(framework->pid) & batched)) {
+    // One reliable message (and one acknowledgement) for all of them.
+    int seq = rsend(master, framework->pid,
+                    pack<S2M_STATUS_UPDATES>(id, framework->id, updates));
+    seqs[framework->id].insert(seq);
+    statusUpdateBatchesSent++;
+    batchedStatusUpdates += updates.size();
+  } else {
+    // We've since found a master that can't take batches.
+    foreach (const TaskStatus &update, updates) {
+      int seq = rsend(master, framework->pid,
+                      pack<S2M_STATUS_UPDATE>(id, framework->id,
+                                              update.taskId, update.state,
+                                              update.data));
+      seqs[framework->id].insert(seq);
+    }
+  }
+
+  statusUpdateBatches.erase(it);
+  if (statusUpdateBatches.empty())
+    statusUpdateDeadline = 0;
+}
+
+
+// Send all batched status updates right away
+void Slave::flushStatusUpdates()
+{
+  while (!statusUpdateBatches.empty()) {
+    Framework *framework = getFramework(statusUpdateBatches.begin()->first);
+    CHECK(framework != NULL);
+    flushStatusUpdates(framework);
+  }
+}
+
+
 // Kill a framework (including its executor if killExecutor is true).
 void Slave::killFramework(Framework *framework, bool killExecutor)
 {
   LOG(INFO) << "Cleaning up framework " << framework->id;
 
+  // Drop the framework's batched status updates (sending them would
+  // only mean canceling them again right below).
+  statusUpdateBatches.erase(framework->id);
+  if (statusUpdateBatches.empty())
+    statusUpdateDeadline = 0;
+
   // Cancel sending any reliable messages for this framework.
   foreach (int seq, seqs[framework->id])
     cancel(seq);
@@ -519,10 +745,12 @@ void Slave::killFramework(Framework *framework, bool killExecutor)
     }
 
     LOG(INFO) << "Cleaning up executor for framework " << framework->id;
+    recordCapabilities(ex->pid, 0);
     delete ex;
     executors.erase(framework->id);
   }
 
+  recordCapabilities(framework->pid, 0);
   frameworks.erase(framework->id);
   delete framework;
 }
@@ -536,6 +764,7 @@ void Slave::executorExited(FrameworkID fid, int status)
   if (Framework *f = getFramework(fid)) {
     LOG(INFO) << "Executor for framework " << fid << " exited "
               << "with status " << status;
+    flushStatusUpdates(f);
     send(master, pack<S2M_LOST_EXECUTOR>(id, fid, status));
     killFramework(f, false);
   }
@@ -84,6 +84,7 @@ struct Framework
   string name;
   string user;
   ExecutorInfo executorInfo;
+  int64_t executorInfoHash; // Lets the master refer to executorInfo
   list<TaskDescription *> queuedTasks; // Holds tasks until executor starts
   unordered_map<TaskID, Task *> tasks;
   Resources resources;
@@ -95,7 +96,8 @@ struct Framework
   
   Framework(FrameworkID _id, const string& _name, const string& _user,
             const ExecutorInfo& _executorInfo, const PID& _pid)
-    : id(_id), name(_name), user(_user), executorInfo(_executorInfo), pid(_pid) {}
+    : id(_id), name(_name), user(_user), executorInfo(_executorInfo),
+      executorInfoHash(internal::executorInfoHash(_executorInfo)), pid(_pid) {}
 
   ~Framework()
   {
@@ -163,6 +165,17 @@ struct Executor
 };
 
 
+// Status updates for a framework waiting to be sent to the master in
+// one reliable message (see Slave::statusUpdate)
+struct StatusUpdateBatch
+{
+  vector<TaskStatus> updates;
+  size_t bytes; // Bytes of update data in the batch
+
+  StatusUpdateBatch() : bytes(0) {}
+};
+
+
 class Slave : public MesosProcess
 {
 public:
@@ -182,6 +195,17 @@ public:
   // Sequence numbers of reliable messages sent on behalf of framework.
   unordered_map<FrameworkID, unordered_set<int> > seqs;
 
+  // Status updates waiting to be sent in batches, by framework, and
+  // when to send them (or 0 if none are waiting).
+  unordered_map<FrameworkID, StatusUpdateBatch> statusUpdateBatches;
+  double statusUpdateDeadline;
+
+  double statusUpdateBatchWindow; // Seconds to collect updates for
+  int32_t statusUpdateBatchSize;  // Most updates to send in a batch
+
+  int64_t statusUpdateBatchesSent; // Batches of status updates sent
+  int64_t batchedStatusUpdates;    // Status updates in those batches
+
 public:
   Slave(Resources resources, bool local, IsolationModule* isolationModule);
 
@@ -210,9 +234,26 @@ protected:
 
   Executor * getExecutor(FrameworkID frameworkId);
 
+  // Start a task for a framework on its executor, or queue it if the
+  // executor hasn't registered yet.
+  void runTask(Framework *framework, const TaskID &tid,
+               const string &name, const string &arg, const Params &params,
+               const Resources &resources);
+
   // Send any tasks queued up for the given framework to its executor
   // (needed if we received tasks while the executor was starting up).
   void sendQueuedTasks(Framework *framework);
+
+  // Send a status update for a task to the master, either right away
+  // or in a batch with other updates for the framework (if both the
+  // master and the framework can take batches).
+  void statusUpdate(Framework *framework, const TaskStatus &update);
+
+  // Send the batched status updates for a framework right away.
+  void flushStatusUpdates(Framework *framework);
+
+  // Send all batched status updates right away.
+  void flushStatusUpdates();
 };
 
 }}}
@@ -51,6 +51,7 @@ struct Framework
   std::string executor_status;
   int32_t cpus;
   int64_t mem;
+  std::string other_resources; // Dimensions besides cpus and mem
 
   std::vector<Task *> tasks;
 };
@@ -61,9 +62,13 @@ struct SlaveState
 	     SlaveID id_, int32_t cpus_, int64_t mem_, const std::string& pid_,
 	     const std::string& master_pid_)
     : build_date(build_date_), build_user(build_user_), id(id_),
-      cpus(cpus_), mem(mem_), pid(pid_), master_pid(master_pid_) {}
+      cpus(cpus_), mem(mem_), pid(pid_), master_pid(master_pid_),
+      unacknowledged_messages(0), status_update_batches(0),
+      batched_status_updates(0) {}
 
-  SlaveState() {}
+  SlaveState()
+    : unacknowledged_messages(0), status_update_batches(0),
+      batched_status_updates(0) {}
 
   ~SlaveState()
   {
@@ -76,9 +81,17 @@ struct SlaveState
   SlaveID id;
   int32_t cpus;
   int64_t mem;
+  std::string other_resources; // Dimensions besides cpus and mem
   std::string pid;
   std::string master_pid;
 
+  // Reliable messages (i.e. status updates) not acknowledged yet.
+  int64_t unacknowledged_messages;
+
+  // Batches of status updates sent, and the updates in them.
+  int64_t status_update_batches;
+  int64_t batched_status_updates;
+
   std::vector<Framework *> frameworks;
 };
 
@@ -0,0 +1,435 @@
+#include <gmock/gmock.h>
+
+#include <mesos_exec.hpp>
+#include <mesos_sched.hpp>
+
+#include <event_history/event_logger.hpp>
+
+#include <local/local.hpp>
+
+#include <master/master.hpp>
+
+#include <slave/isolation_module.hpp>
+#include <slave/process_based_isolation_module.hpp>
+#include <slave/slave.hpp>
+
+#include <tests/utils.hpp>
+
+using namespace mesos;
+using namespace mesos::internal;
+using namespace mesos::internal::test;
+
+using mesos::internal::eventhistory::EventLogger;
+using mesos::internal::master::Master;
+using mesos::internal::slave::Slave;
+using mesos::internal::slave::Framework;
+using mesos::internal::slave::IsolationModule;
+using mesos::internal::slave::ProcessBasedIsolationModule;
+
+using std::string;
+using std::map;
+using std::vector;
+
+using testing::_;
+using testing::AnyNumber;
+using testing::AtMost;
+using testing::DoAll;
+using testing::Eq;
+using testing::Return;
+using testing::SaveArg;
+
+
+namespace {
+
+// Launch a local cluster that uses the given allocator.
+PID launchWithAllocator(const string& allocator, int numSlaves)
+{
+  Params conf;
+  conf.set("slaves", numSlaves);
+  conf.set("cpus", 2);
+  conf.set("mem", 1 * Gigabyte);
+  conf.set("quiet", false);
+  conf.set("allocator", allocator);
+  return local::launch(conf, false);
+}
+
+
+// Runs a framework's executor in the test's own process.
+class LocalIsolationModule : public IsolationModule
+{
+public:
+  Executor *executor;
+  MesosExecutorDriver *driver;
+  string pid;
+
+  LocalIsolationModule(Executor *_executor)
+    : executor(_executor), driver(NULL) {}
+
+  virtual ~LocalIsolationModule() {}
+
+  virtual void initialize(Slave *slave) {
+    pid = slave->self();
+  }
+
+  virtual void startExecutor(Framework *framework) {
+    setenv("MESOS_LOCAL", "1", 1);
+    setenv("MESOS_SLAVE_PID", pid.c_str(), 1);
+    setenv("MESOS_FRAMEWORK_ID", framework->id.c_str(), 1);
+
+    driver = new MesosExecutorDriver(executor);
+    driver->start();
+  }
+
+  virtual void killExecutor(Framework* framework) {
+    driver->stop();
+    driver->join();
+    delete driver;
+
+    unsetenv("MESOS_LOCAL");
+    unsetenv("MESOS_SLAVE_PID");
+    unsetenv("MESOS_FRAMEWORK_ID");
+  }
+};
+
+}
+
+
+TEST(DrfAllocatorTest, ResourceOfferWithMultipleSlaves)
+{
+  ASSERT_TRUE(GTEST_IS_THREADSAFE);
+
+  PID master = launchWithAllocator("drf", 10);
+
+  MockScheduler sched;
+  MesosSchedulerDriver driver(&sched, master);
+
+  vector<SlaveOffer> offers;
+
+  trigger resourceOfferCall;
+
+  EXPECT_CALL(sched, getFrameworkName(&driver))
+    .WillOnce(Return(""));
+
+  EXPECT_CALL(sched, getExecutorInfo(&driver))
+    .WillOnce(Return(ExecutorInfo("noexecutor", "")));
+
+  EXPECT_CALL(sched, registered(&driver, _))
+    .Times(1);
+
+  EXPECT_CALL(sched, resourceOffer(&driver, _, _))
+    .WillOnce(DoAll(SaveArg<2>(&offers), Trigger(&resourceOfferCall)));
+
+  EXPECT_CALL(sched, offerRescinded(&driver, _))
+    .Times(AtMost(1));
+
+  driver.start();
+
+  WAIT_UNTIL(resourceOfferCall);
+
+  EXPECT_NE(0, offers.size());
+  EXPECT_GE(10, offers.size());
+
+  EXPECT_EQ("2", offers[0].params["cpus"]);
+  EXPECT_EQ("1024", offers[0].params["mem"]);
+
+  driver.stop();
+  driver.join();
+
+  local::shutdown();
+}
+
+
+TEST(DrfAllocatorTest, ResourcesReofferedAfterReject)
+{
+  ASSERT_TRUE(GTEST_IS_THREADSAFE);
+
+  PID master = launchWithAllocator("drf", 10);
+
+  MockScheduler sched1;
+  MesosSchedulerDriver driver1(&sched1, master);
+
+  OfferID offerId;
+
+  trigger sched1ResourceOfferCall;
+
+  EXPECT_CALL(sched1, getFrameworkName(&driver1))
+    .WillOnce(Return(""));
+
+  EXPECT_CALL(sched1, getExecutorInfo(&driver1))
+    .WillOnce(Return(ExecutorInfo("noexecutor", "")));
+
+  EXPECT_CALL(sched1, registered(&driver1, _))
+    .Times(1);
+
+  EXPECT_CALL(sched1, resourceOffer(&driver1, _, _))
+    .WillOnce(DoAll(SaveArg<1>(&offerId), Trigger(&sched1ResourceOfferCall)));
+
+  driver1.start();
+
+  WAIT_UNTIL(sched1ResourceOfferCall);
+
+  driver1.replyToOffer(offerId, vector<TaskDescription>(), map<string, string>());
+
+  driver1.stop();
+  driver1.join();
+
+  MockScheduler sched2;
+  MesosSchedulerDriver driver2(&sched2, master);
+
+  trigger sched2ResourceOfferCall;
+
+  EXPECT_CALL(sched2, getFrameworkName(&driver2))
+    .WillOnce(Return(""));
+
+  EXPECT_CALL(sched2, getExecutorInfo(&driver2))
+    .WillOnce(Return(ExecutorInfo("noexecutor", "")));
+
+  EXPECT_CALL(sched2, registered(&driver2, _))
+    .Times(1);
+
+  EXPECT_CALL(sched2, resourceOffer(&driver2, _, _))
+    .WillOnce(Trigger(&sched2ResourceOfferCall));
+
+  EXPECT_CALL(sched2, offerRescinded(&driver2, _))
+    .Times(AtMost(1));
+
+  driver2.start();
+
+  WAIT_UNTIL(sched2ResourceOfferCall);
+
+  driver2.stop();
+  driver2.join();
+
+  local::shutdown();
+}
+
+
+TEST(DrfAllocatorTest, FrameworkWithLowerShareOfferedFirst)
+{
+  ASSERT_TRUE(GTEST_IS_THREADSAFE);
+
+  Params conf;
+  conf.set("allocator", "drf");
+
+  EventLogger el;
+  Master m(conf, &el);
+  PID master = Process::spawn(&m);
+
+  BasicMasterDetector masterDetector(master);
+
+  MockScheduler sched1;
+  MesosSchedulerDriver driver1(&sched1, master);
+
+  MockScheduler sched2;
+  MesosSchedulerDriver driver2(&sched2, master);
+
+  OfferID offerId1;
+  vector<SlaveOffer> offers1, offers2;
+
+  trigger registeredCall1, registeredCall2;
+  trigger resourceOfferCall1, resourceOfferCall2, statusUpdateCall;
+
+  EXPECT_CALL(sched1, getFrameworkName(&driver1))
+    .WillOnce(Return(""));
+
+  EXPECT_CALL(sched1, getExecutorInfo(&driver1))
+    .WillOnce(Return(ExecutorInfo("noexecutor", "")));
+
+  EXPECT_CALL(sched1, registered(&driver1, _))
+    .WillOnce(Trigger(&registeredCall1));
+
+  EXPECT_CALL(sched1, resourceOffer(&driver1, _, _))
+    .WillOnce(DoAll(SaveArg<1>(&offerId1), SaveArg<2>(&offers1),
+                    Trigger(&resourceOfferCall1)))
+    .WillRepeatedly(Return());
+
+  EXPECT_CALL(sched1, offerRescinded(&driver1, _))
+    .Times(AnyNumber());
+
+  EXPECT_CALL(sched1, statusUpdate(&driver1, _))
+    .WillOnce(Trigger(&statusUpdateCall));
+
+  EXPECT_CALL(sched2, getFrameworkName(&driver2))
+    .WillOnce(Return(""));
+
+  EXPECT_CALL(sched2, getExecutorInfo(&driver2))
+    .WillOnce(Return(ExecutorInfo("noexecutor", "")));
+
+  EXPECT_CALL(sched2, registered(&driver2, _))
+    .WillOnce(Trigger(&registeredCall2));
+
+  EXPECT_CALL(sched2, resourceOffer(&driver2, _, _))
+    .WillOnce(DoAll(SaveArg<2>(&offers2), Trigger(&resourceOfferCall2)))
+    .WillRepeatedly(Return());
+
+  EXPECT_CALL(sched2, offerRescinded(&driver2, _))
+    .Times(AnyNumber());
+
+  // Register both frameworks before there are any resources to offer,
+  // so that the first framework gets the lower (tie-breaking) ID.
+  driver1.start();
+
+  WAIT_UNTIL(registeredCall1);
+
+  driver2.start();
+
+  WAIT_UNTIL(registeredCall2);
+
+  MockExecutor exec;
+
+  EXPECT_CALL(exec, init(_, _))
+    .Times(1);
+
+  EXPECT_CALL(exec, launchTask(_, _))
+    .Times(1);
+
+  EXPECT_CALL(exec, shutdown(_))
+    .Times(1);
+
+  LocalIsolationModule isolationModule1(&exec);
+  ProcessBasedIsolationModule isolationModule2;
+
+  // Neither framework has any resources yet, so the first slave goes to
+  // the first framework on the tie-break.
+  Slave s1(Resources(2, 1 * Gigabyte), true, &isolationModule1);
+  PID slave1 = Process::spawn(&s1);
+
+  BasicMasterDetector detector1(master, slave1, true);
+
+  WAIT_UNTIL(resourceOfferCall1);
+
+  ASSERT_EQ(1, offers1.size());
+
+  vector<TaskDescription> tasks;
+  tasks.push_back(TaskDescription(1, offers1[0].slaveId, "",
+                                  offers1[0].params, ""));
+
+  driver1.replyToOffer(offerId1, tasks, map<string, string>());
+
+  WAIT_UNTIL(statusUpdateCall);
+
+  // Now the first framework's task holds half of the cluster, so the
+  // second slave goes to the second framework even though the tie-break
+  // would still favour the first one.
+  Slave s2(Resources(2, 1 * Gigabyte), true, &isolationModule2);
+  PID slave2 = Process::spawn(&s2);
+
+  BasicMasterDetector detector2(master, slave2, true);
+
+  WAIT_UNTIL(resourceOfferCall2);
+
+  ASSERT_EQ(1, offers2.size());
+  EXPECT_NE(offers1[0].slaveId, offers2[0].slaveId);
+
+  driver2.stop();
+  driver2.join();
+
+  driver1.stop();
+  driver1.join();
+
+  MesosProcess::post(slave1, pack<S2S_SHUTDOWN>());
+  Process::wait(slave1);
+
+  MesosProcess::post(slave2, pack<S2S_SHUTDOWN>());
+  Process::wait(slave2);
+
+  MesosProcess::post(master, pack<M2M_SHUTDOWN>());
+  Process::wait(master);
+}
+
+
+TEST(SimpleAllocatorTest, SlavesAddedTogetherOfferedInOneBatch)
+{
+  ASSERT_TRUE(GTEST_IS_THREADSAFE);
+
+  // The clock only moves when we say so, so that every slave registers
+  // before the batch interval can run out.
+  Clock::pause();
+
+  MockFilter filter;
+  Process::filter(&filter);
+
+  EXPECT_MSG(filter, _, _, _)
+    .WillRepeatedly(Return(false));
+
+  Params conf;
+  conf.set("offer_batch_interval", 0.5);
+
+  EventLogger el;
+  Master m(conf, &el);
+  PID master = Process::spawn(&m);
+
+  BasicMasterDetector masterDetector(master);
+
+  MockScheduler sched;
+  MesosSchedulerDriver driver(&sched, master);
+
+  vector<SlaveOffer> offers;
+
+  trigger registeredCall, resourceOfferCall;
+
+  EXPECT_CALL(sched, getFrameworkName(&driver))
+    .WillOnce(Return(""));
+
+  EXPECT_CALL(sched, getExecutorInfo(&driver))
+    .WillOnce(Return(ExecutorInfo("noexecutor", "")));
+
+  EXPECT_CALL(sched, registered(&driver, _))
+    .WillOnce(Trigger(&registeredCall));
+
+  EXPECT_CALL(sched, resourceOffer(&driver, _, _))
+    .WillOnce(DoAll(SaveArg<2>(&offers), Trigger(&resourceOfferCall)));
+
+  driver.start();
+
+  WAIT_UNTIL(registeredCall);
+
+  // Without batching each of these slaves would be offered on its own.
+  ProcessBasedIsolationModule isolationModule1;
+  ProcessBasedIsolationModule isolationModule2;
+  ProcessBasedIsolationModule isolationModule3;
+  Slave s1(Resources(2, 1 * Gigabyte), true, &isolationModule1);
+  Slave s2(Resources(2, 1 * Gigabyte), true, &isolationModule2);
+  Slave s3(Resources(2, 1 * Gigabyte), true, &isolationModule3);
+
+  vector<PID> slaves;
+  slaves.push_back(Process::spawn(&s1));
+  slaves.push_back(Process::spawn(&s2));
+  slaves.push_back(Process::spawn(&s3));
+
+  trigger slaveRegisteredMsgs[3];
+
+  for (size_t i = 0; i < slaves.size(); i++) {
+    EXPECT_MSG(filter, Eq(M2S_REGISTER_REPLY), _, Eq(slaves[i]))
+      .WillOnce(DoAll(Trigger(&slaveRegisteredMsgs[i]), Return(false)))
+      .RetiresOnSaturation();
+  }
+
+  BasicMasterDetector slavesDetector(master, slaves);
+
+  for (size_t i = 0; i < slaves.size(); i++)
+    WAIT_UNTIL(slaveRegisteredMsgs[i]);
+
+  EXPECT_FALSE(resourceOfferCall.value);
+
+  Clock::advance(0.5);
+
+  WAIT_UNTIL(resourceOfferCall);
+
+  EXPECT_EQ(3, offers.size());
+
+  driver.stop();
+  driver.join();
+
+  foreach (const PID& slave, slaves) {
+    MesosProcess::post(slave, pack<S2S_SHUTDOWN>());
+    Process::wait(slave);
+  }
+
+  MesosProcess::post(master, pack<M2M_SHUTDOWN>());
+  Process::wait(master);
+
+  Process::filter(NULL);
+
+  Clock::resume();
+}
@@ -0,0 +1,46 @@
+#include <gtest/gtest.h>
+
+#include <common/interner.hpp>
+
+using namespace mesos;
+using namespace mesos::internal;
+
+
+TEST(InternerTest, InternAssignsDenseHandles)
+{
+  Interner interner;
+  ASSERT_EQ(0, interner.intern("a"));
+  ASSERT_EQ(1, interner.intern("b"));
+  ASSERT_EQ(0, interner.intern("a"));
+  ASSERT_EQ(2, interner.size());
+  ASSERT_EQ("a", interner.id(0));
+  ASSERT_EQ("b", interner.id(1));
+}
+
+
+TEST(InternerTest, LookupDoesNotIntern)
+{
+  Interner interner;
+  Interner::Handle handle;
+  ASSERT_FALSE(interner.lookup("a", &handle));
+  ASSERT_EQ(0, interner.size());
+  interner.intern("a");
+  ASSERT_TRUE(interner.lookup("a", &handle));
+  ASSERT_EQ(0, handle);
+}
+
+
+TEST(InternerTest, ReleasedHandlesAreReused)
+{
+  Interner interner;
+  interner.intern("a");
+  interner.intern("b");
+  interner.release(0);
+  ASSERT_EQ(1, interner.size());
+  Interner::Handle handle;
+  ASSERT_FALSE(interner.lookup("a", &handle));
+  ASSERT_EQ(0, interner.intern("c"));
+  ASSERT_EQ("c", interner.id(0));
+  ASSERT_EQ(2, interner.intern("a"));
+  ASSERT_EQ(3, interner.size());
+}
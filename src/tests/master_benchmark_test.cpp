@@ -0,0 +1,384 @@
+#include <gmock/gmock.h>
+
+#include <iostream>
+
+#include <mesos_sched.hpp>
+
+#include <boost/lexical_cast.hpp>
+
+#include <local/local.hpp>
+
+#include <master/master.hpp>
+
+#include <tests/utils.hpp>
+
+using namespace mesos;
+using namespace mesos::internal;
+using namespace mesos::internal::test;
+
+using boost::lexical_cast;
+
+using std::cout;
+using std::endl;
+using std::map;
+using std::string;
+using std::vector;
+
+using testing::_;
+using testing::AnyNumber;
+using testing::DoAll;
+using testing::Return;
+using testing::SaveArg;
+
+
+namespace {
+
+/**
+ * A process that pretends to be a slave running a given number of
+ * tasks for a framework. It re-registers with the master, sends it a
+ * stream of status updates for those tasks (one at a time or in
+ * batches of the given size) and records how long the master took to
+ * process all of them.
+ */
+class StatusUpdateSender : public MesosProcess
+{
+public:
+  StatusUpdateSender(const PID &_master, const FrameworkID &_fid,
+                     int _numTasks, int _numUpdates, int _batchSize = 1)
+    : time(0), master(_master), fid(_fid), numTasks(_numTasks),
+      numUpdates(_numUpdates), batchSize(_batchSize) {}
+
+  double time; // Seconds taken by the master to process the updates.
+
+protected:
+  void operator () ()
+  {
+    SlaveID sid = "benchmark-" + lexical_cast<string>(numTasks);
+
+    // Use up all of the slave's resources so nothing gets offered.
+    Resources taskResources(1, 32 * Megabyte);
+    Resources resources;
+    vector<Task> tasks;
+    for (int i = 0; i < numTasks; i++) {
+      tasks.push_back(Task(i, fid, taskResources,
+                           TASK_RUNNING, "", "", sid));
+      resources += taskResources;
+    }
+
+    send(master, pack<S2M_REREGISTER_SLAVE>(sid, "localhost", "",
+                                            resources, tasks,
+                                            vector<FrameworkID>(1, fid),
+                                            MESOS_CAPABILITIES,
+                                            otherResourceAmounts(resources),
+                                            vector<vector<int32_t> >()));
+    while (receive() != M2S_REREGISTER_REPLY);
+    recordCapabilities(master, unpack<M2S_REREGISTER_REPLY, 2>(body()));
+
+    double start = elapsed();
+
+    if (batchSize == 1) {
+      for (int i = 0; i < numUpdates; i++) {
+        send(master, pack<S2M_STATUS_UPDATE>(sid, fid, tasks[i % numTasks].id,
+                                             TASK_RUNNING, ""));
+      }
+    } else {
+      vector<TaskStatus> updates;
+      for (int i = 0; i < numUpdates; i++) {
+        updates.push_back(TaskStatus(tasks[i % numTasks].id, TASK_RUNNING, ""));
+        if (updates.size() == batchSize || i == numUpdates - 1) {
+          send(master, pack<S2M_STATUS_UPDATES>(sid, fid, updates));
+          updates.clear();
+        }
+      }
+    }
+
+    // The master handles messages in order, so once it answers this
+    // it has processed every status update.
+    send(master, pack<M2M_GET_STATE>());
+    while (receive() != M2M_GET_STATE_REPLY);
+
+    time = elapsed() - start;
+
+    delete unpack<M2M_GET_STATE_REPLY, 0>(body());
+
+    send(master, pack<S2M_UNREGISTER_SLAVE>(sid));
+  }
+
+private:
+  const PID master;
+  const FrameworkID fid;
+  const int numTasks;
+  const int numUpdates;
+  const int batchSize;
+};
+
+
+/**
+ * A process that pretends to be a slave with the given resources. It
+ * registers with the master and then ignores everything (including
+ * the tasks it is asked to run) until the master shuts it down.
+ */
+class IdleSlave : public MesosProcess
+{
+public:
+  IdleSlave(const PID &_master, const Resources &_resources)
+    : master(_master), resources(_resources) {}
+
+  trigger registered;
+
+protected:
+  void operator () ()
+  {
+    send(master, pack<S2M_REGISTER_SLAVE>("localhost", "", resources,
+                                          MESOS_CAPABILITIES,
+                                          otherResourceAmounts(resources)));
+    while (receive() != M2S_REGISTER_REPLY);
+    registered.value = true;
+    while (receive() != M2S_SHUTDOWN);
+  }
+
+private:
+  const PID master;
+  const Resources resources;
+};
+
+
+/**
+ * A process that pretends to be a framework. It registers with the
+ * master and then replies to a number of offers, launching the given
+ * number of tasks on the first slave of each offer and declining the
+ * rest without a filter (so the master re-offers them right away).
+ * Replies either carry the tasks' typed resources, as the scheduler
+ * driver sends them, or only their params, and it records how long the
+ * master took from each reply until its next offer for both kinds.
+ */
+class OfferReplier : public MesosProcess
+{
+public:
+  OfferReplier(const PID &_master, int _numReplies, int _numTasks)
+    : typedTime(0), paramsTime(0), master(_master),
+      numReplies(_numReplies), numTasks(_numTasks) {}
+
+  double typedTime;  // Seconds spent on replies with typed resources.
+  double paramsTime; // Seconds spent on replies with only params.
+
+protected:
+  void operator () ()
+  {
+    send(master, pack<F2M_REGISTER_FRAMEWORK>("", "",
+                                              ExecutorInfo("noexecutor", ""),
+                                              MESOS_CAPABILITIES));
+    while (receive() != M2F_REGISTER_REPLY);
+    FrameworkID fid;
+    int32_t capabilities;
+    tie(fid, capabilities) = unpack<M2F_REGISTER_REPLY>(body());
+    recordCapabilities(master, capabilities);
+
+    map<string, string> taskParams;
+    taskParams["cpus"] = "1";
+    taskParams["mem"] = lexical_cast<string>(32 * Megabyte);
+
+    map<string, string> replyParams;
+    replyParams["timeout"] = "0";
+
+    double start = 0;
+
+    for (int i = 0; i <= numReplies; i++) {
+      while (receive() != M2F_SLOT_OFFER);
+
+      if (i > 0) {
+        // Replies alternate between typed and params-only tasks.
+        if (i % 2 == 1)
+          typedTime += elapsed() - start;
+        else
+          paramsTime += elapsed() - start;
+      }
+
+      if (i == numReplies)
+        break;
+
+      OfferID oid;
+      vector<SlaveOffer> offers;
+      map<SlaveID, PID> pids;
+      tie(oid, offers, pids) = unpack<M2F_SLOT_OFFER>(body());
+
+      vector<TaskDescription> tasks;
+      for (int j = 0; j < numTasks; j++) {
+        TaskDescription task(i * numTasks + j, offers[0].slaveId, "",
+                             taskParams, "");
+        if (i % 2 == 0) {
+          task.cpus = 1;
+          task.mem = 32 * Megabyte;
+        }
+        tasks.push_back(task);
+      }
+
+      start = elapsed();
+      send(master, pack<F2M_SLOT_OFFER_REPLY>(fid, oid, tasks,
+                                              Params(replyParams)));
+    }
+
+    send(master, pack<F2M_UNREGISTER_FRAMEWORK>(fid));
+  }
+
+private:
+  const PID master;
+  const int numReplies;
+  const int numTasks;
+};
+
+}
+
+
+TEST(MasterBenchmark, StatusUpdateThroughputWithDenseSlaves)
+{
+  ASSERT_TRUE(GTEST_IS_THREADSAFE);
+
+  const int numUpdates = 5000;
+
+  PID master = local::launch(0, 0, 0, false, false);
+
+  MockScheduler sched;
+  MesosSchedulerDriver driver(&sched, master);
+
+  FrameworkID fid;
+
+  trigger registeredCall;
+
+  EXPECT_CALL(sched, getFrameworkName(&driver))
+    .WillOnce(Return(""));
+
+  EXPECT_CALL(sched, getExecutorInfo(&driver))
+    .WillOnce(Return(ExecutorInfo("noexecutor", "")));
+
+  EXPECT_CALL(sched, registered(&driver, _))
+    .WillOnce(DoAll(SaveArg<1>(&fid), Trigger(&registeredCall)));
+
+  // Tasks get reported lost as each fake slave unregisters.
+  EXPECT_CALL(sched, statusUpdate(&driver, _))
+    .Times(AnyNumber());
+
+  EXPECT_CALL(sched, slaveLost(&driver, _))
+    .Times(AnyNumber());
+
+  driver.start();
+
+  WAIT_UNTIL(registeredCall);
+
+  vector<double> times;
+
+  int sizes[] = { 10, 100, 1000 };
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    StatusUpdateSender sender(master, fid, sizes[i], numUpdates);
+    Process::wait(Process::spawn(&sender));
+    ASSERT_LT(0, sender.time);
+    times.push_back(sender.time);
+    cout << "Master processed " << numUpdates << " status updates for "
+         << sizes[i] << " tasks per slave in " << sender.time
+         << " seconds (" << (numUpdates / sender.time) << " updates/sec)"
+         << endl;
+  }
+
+  // Looking up a task shouldn't depend on how many its slave has, so
+  // a hundred times as many tasks per slave (scanned linearly, that
+  // would be a hundred times the work) should hardly slow things down.
+  EXPECT_LT(times.back(), 3 * times.front());
+
+  driver.stop();
+  driver.join();
+
+  local::shutdown();
+}
+
+
+TEST(MasterBenchmark, StatusUpdateThroughputInBatches)
+{
+  ASSERT_TRUE(GTEST_IS_THREADSAFE);
+
+  const int numTasks = 100;
+  const int numUpdates = 5000;
+
+  PID master = local::launch(0, 0, 0, false, false);
+
+  MockScheduler sched;
+  MesosSchedulerDriver driver(&sched, master);
+
+  FrameworkID fid;
+
+  trigger registeredCall;
+
+  EXPECT_CALL(sched, getFrameworkName(&driver))
+    .WillOnce(Return(""));
+
+  EXPECT_CALL(sched, getExecutorInfo(&driver))
+    .WillOnce(Return(ExecutorInfo("noexecutor", "")));
+
+  EXPECT_CALL(sched, registered(&driver, _))
+    .WillOnce(DoAll(SaveArg<1>(&fid), Trigger(&registeredCall)));
+
+  EXPECT_CALL(sched, statusUpdate(&driver, _))
+    .Times(AnyNumber());
+
+  EXPECT_CALL(sched, slaveLost(&driver, _))
+    .Times(AnyNumber());
+
+  driver.start();
+
+  WAIT_UNTIL(registeredCall);
+
+  int batchSizes[] = { 1, 10, 100 };
+  for (size_t i = 0; i < sizeof(batchSizes) / sizeof(batchSizes[0]); i++) {
+    StatusUpdateSender sender(master, fid, numTasks, numUpdates,
+                              batchSizes[i]);
+    Process::wait(Process::spawn(&sender));
+    ASSERT_LT(0, sender.time);
+    cout << "Master processed " << numUpdates << " status updates in "
+         << "batches of " << batchSizes[i] << " in " << sender.time
+         << " seconds (" << (numUpdates / sender.time) << " updates/sec)"
+         << endl;
+  }
+
+  driver.stop();
+  driver.join();
+
+  local::shutdown();
+}
+
+
+TEST(MasterBenchmark, OfferReplyThroughputWithLargeReplies)
+{
+  ASSERT_TRUE(GTEST_IS_THREADSAFE);
+
+  const int numReplies = 20;
+  const int numTasks = 1000;
+
+  PID master = local::launch(0, 0, 0, false, false);
+
+  // Each reply uses up one slave, and one more slave keeps the last
+  // reply followed by an offer.
+  vector<IdleSlave *> slaves;
+  for (int i = 0; i <= numReplies; i++) {
+    IdleSlave *slave =
+      new IdleSlave(master, Resources(numTasks, numTasks * 32 * Megabyte));
+    Process::spawn(slave);
+    WAIT_UNTIL(slave->registered);
+    slaves.push_back(slave);
+  }
+
+  OfferReplier replier(master, numReplies, numTasks);
+  Process::wait(Process::spawn(&replier));
+  ASSERT_LT(0, replier.typedTime);
+  ASSERT_LT(0, replier.paramsTime);
+
+  cout << "Master processed offer replies of " << numTasks << " tasks in "
+       << (replier.typedTime / (numReplies / 2)) << " seconds with typed "
+       << "resources and " << (replier.paramsTime / (numReplies / 2))
+       << " seconds with params" << endl;
+
+  local::shutdown();
+
+  foreach (IdleSlave *slave, slaves) {
+    Process::wait(slave->self());
+    delete slave;
+  }
+}
@@ -37,6 +37,7 @@ using std::vector;
 using testing::_;
 using testing::A;
 using testing::An;
+using testing::AnyNumber;
 using testing::AtMost;
 using testing::DoAll;
 using testing::Eq;
@@ -87,6 +88,73 @@ public:
 };
 
 
+// A process that asks a slave for its state.
+class SlaveStateGetter : public MesosProcess
+{
+public:
+  SlaveStateGetter(const PID &_slave) : state(NULL), slave(_slave) {}
+
+  ~SlaveStateGetter() { delete state; }
+
+  mesos::internal::slave::state::SlaveState *state;
+
+protected:
+  void operator () ()
+  {
+    send(slave, pack<S2S_GET_STATE>());
+    while (receive() != S2S_GET_STATE_REPLY);
+    state = unpack<S2S_GET_STATE_REPLY, 0>(body());
+  }
+
+private:
+  const PID slave;
+};
+
+
+// A process that asks a master for its state.
+class MasterStateGetter : public MesosProcess
+{
+public:
+  MasterStateGetter(const PID &_master) : state(NULL), master(_master) {}
+
+  ~MasterStateGetter() { delete state; }
+
+  mesos::internal::master::state::MasterState *state;
+
+protected:
+  void operator () ()
+  {
+    send(master, pack<M2M_GET_STATE>());
+    while (receive() != M2M_GET_STATE_REPLY);
+    state = unpack<M2M_GET_STATE_REPLY, 0>(body());
+  }
+
+private:
+  const PID master;
+};
+
+
+// Waits (a second at most) for a master to have published a state with
+// the given numbers of slaves and offers, and returns the last state it
+// published.
+mesos::internal::master::state::MasterState * waitForPublishedState(
+    Master *master, size_t numSlaves, size_t numOffers)
+{
+  mesos::internal::master::state::MasterState *state = NULL;
+  for (int i = 0; i < 1000; i++) {
+    delete state;
+    state = master->getState();
+    size_t offers = 0;
+    foreach (mesos::internal::master::state::Framework *f, state->frameworks)
+      offers += f->offers.size();
+    if (state->slaves.size() == numSlaves && offers == numOffers)
+      break;
+    usleep(1000);
+  }
+  return state;
+}
+
+
 TEST(MasterTest, ResourceOfferWithMultipleSlaves)
 {
   ASSERT_TRUE(GTEST_IS_THREADSAFE);
@@ -197,6 +265,54 @@ TEST(MasterTest, ResourcesReofferedAfterReject)
 }
 
 
+TEST(MasterTest, ResourcesReofferedAfterFilterExpires)
+{
+  ASSERT_TRUE(GTEST_IS_THREADSAFE);
+
+  PID master = local::launch(1, 2, 1 * Gigabyte, false, false);
+
+  MockScheduler sched;
+  MesosSchedulerDriver driver(&sched, master);
+
+  OfferID offerId;
+
+  trigger resourceOfferCall, secondResourceOfferCall;
+
+  EXPECT_CALL(sched, getFrameworkName(&driver))
+    .WillOnce(Return(""));
+
+  EXPECT_CALL(sched, getExecutorInfo(&driver))
+    .WillOnce(Return(ExecutorInfo("noexecutor", "")));
+
+  EXPECT_CALL(sched, registered(&driver, _))
+    .Times(1);
+
+  EXPECT_CALL(sched, resourceOffer(&driver, _, _))
+    .WillOnce(DoAll(SaveArg<1>(&offerId), Trigger(&resourceOfferCall)))
+    .WillOnce(Trigger(&secondResourceOfferCall));
+
+  EXPECT_CALL(sched, offerRescinded(&driver, _))
+    .Times(AtMost(1));
+
+  driver.start();
+
+  WAIT_UNTIL(resourceOfferCall);
+
+  // Refuse the slave for a second; it should only get offered back to
+  // us once the filter has expired.
+  map<string, string> params;
+  params["timeout"] = "1";
+  driver.replyToOffer(offerId, vector<TaskDescription>(), params);
+
+  WAIT_UNTIL(secondResourceOfferCall);
+
+  driver.stop();
+  driver.join();
+
+  local::shutdown();
+}
+
+
 TEST(MasterTest, ResourcesReofferedAfterBadResponse)
 {
   ASSERT_TRUE(GTEST_IS_THREADSAFE);
@@ -283,6 +399,99 @@ TEST(MasterTest, ResourcesReofferedAfterBadResponse)
 }
 
 
+TEST(MasterTest, SlaveEnforcesTypedResources)
+{
+  ASSERT_TRUE(GTEST_IS_THREADSAFE);
+
+  EventLogger el;
+  Master m(&el);
+  PID master = Process::spawn(&m);
+
+  MockExecutor exec;
+
+  TaskDescription launched;
+
+  trigger launchTaskCall;
+
+  EXPECT_CALL(exec, init(_, _))
+    .Times(1);
+
+  EXPECT_CALL(exec, launchTask(_, _))
+    .WillOnce(DoAll(SaveArg<1>(&launched), Trigger(&launchTaskCall)));
+
+  EXPECT_CALL(exec, shutdown(_))
+    .Times(1);
+
+  LocalIsolationModule isolationModule(&exec);
+
+  Slave s(Resources(2, 1 * Gigabyte), true, &isolationModule);
+  PID slave = Process::spawn(&s);
+
+  BasicMasterDetector detector(master, slave, true);
+
+  MockScheduler sched;
+  MesosSchedulerDriver driver(&sched, master);
+
+  OfferID offerId;
+  vector<SlaveOffer> offers;
+
+  trigger resourceOfferCall;
+
+  EXPECT_CALL(sched, getFrameworkName(&driver))
+    .WillOnce(Return(""));
+
+  EXPECT_CALL(sched, getExecutorInfo(&driver))
+    .WillOnce(Return(ExecutorInfo("noexecutor", "")));
+
+  EXPECT_CALL(sched, registered(&driver, _))
+    .Times(1);
+
+  EXPECT_CALL(sched, resourceOffer(&driver, _, _))
+    .WillOnce(DoAll(SaveArg<1>(&offerId), SaveArg<2>(&offers),
+                    Trigger(&resourceOfferCall)))
+    .WillRepeatedly(Return());
+
+  EXPECT_CALL(sched, statusUpdate(&driver, _))
+    .Times(AnyNumber());
+
+  EXPECT_CALL(sched, error(&driver, _, _))
+    .Times(0);
+
+  driver.start();
+
+  WAIT_UNTIL(resourceOfferCall);
+
+  EXPECT_NE(0, offers.size());
+
+  // Small typed resources for the master, but params that would have
+  // the task use the whole machine if the slave went by them.
+  map<string, string> params;
+  params["cpus"] = "2";
+  params["mem"] = lexical_cast<string>(1 * Gigabyte);
+
+  vector<TaskDescription> tasks;
+  tasks.push_back(TaskDescription(1, offers[0].slaveId, "", params, ""));
+  tasks[0].cpus = 1;
+  tasks[0].mem = 32 * Megabyte;
+
+  driver.replyToOffer(offerId, tasks, map<string, string>());
+
+  WAIT_UNTIL(launchTaskCall);
+
+  EXPECT_EQ("1", launched.params["cpus"]);
+  EXPECT_EQ(lexical_cast<string>(32 * Megabyte), launched.params["mem"]);
+
+  driver.stop();
+  driver.join();
+
+  MesosProcess::post(slave, pack<S2S_SHUTDOWN>());
+  Process::wait(slave);
+
+  MesosProcess::post(master, pack<M2M_SHUTDOWN>());
+  Process::wait(master);
+}
+
+
 TEST(MasterTest, SlaveLost)
 {
   ASSERT_TRUE(GTEST_IS_THREADSAFE);
@@ -558,6 +767,119 @@ TEST(MasterTest, TaskRunning)
 }
 
 
+TEST(MasterTest, KillFrameworkOnlySentToExecutorSlaves)
+{
+  ASSERT_TRUE(GTEST_IS_THREADSAFE);
+
+  MockFilter filter;
+  Process::filter(&filter);
+
+  EXPECT_MSG(filter, _, _, _)
+    .WillRepeatedly(Return(false));
+
+  MockExecutor exec1, exec2;
+
+  trigger shutdownCall;
+
+  EXPECT_CALL(exec1, init(_, _))
+    .Times(1);
+
+  EXPECT_CALL(exec1, launchTask(_, _))
+    .Times(1);
+
+  EXPECT_CALL(exec1, shutdown(_))
+    .WillOnce(Trigger(&shutdownCall));
+
+  EXPECT_CALL(exec2, init(_, _))
+    .Times(0);
+
+  LocalIsolationModule isolationModule1(&exec1);
+  LocalIsolationModule isolationModule2(&exec2);
+
+  EventLogger el;
+  Master m(&el);
+  PID master = Process::spawn(&m);
+
+  Slave s1(Resources(2, 1 * Gigabyte), true, &isolationModule1);
+  PID slave1 = Process::spawn(&s1);
+
+  BasicMasterDetector detector1(master, slave1, true);
+
+  MockScheduler sched;
+  MesosSchedulerDriver driver(&sched, master);
+
+  OfferID offerId;
+  vector<SlaveOffer> offers;
+
+  trigger resourceOfferCall, statusUpdateCall;
+
+  EXPECT_CALL(sched, getFrameworkName(&driver))
+    .WillOnce(Return(""));
+
+  EXPECT_CALL(sched, getExecutorInfo(&driver))
+    .WillOnce(Return(ExecutorInfo("noexecutor", "")));
+
+  EXPECT_CALL(sched, registered(&driver, _))
+    .Times(1);
+
+  EXPECT_CALL(sched, resourceOffer(&driver, _, _))
+    .WillOnce(DoAll(SaveArg<1>(&offerId), SaveArg<2>(&offers),
+                    Trigger(&resourceOfferCall)))
+    .WillRepeatedly(Return());
+
+  EXPECT_CALL(sched, statusUpdate(&driver, _))
+    .WillOnce(Trigger(&statusUpdateCall));
+
+  driver.start();
+
+  WAIT_UNTIL(resourceOfferCall);
+
+  EXPECT_EQ(1, offers.size());
+
+  vector<TaskDescription> tasks;
+  tasks.push_back(TaskDescription(1, offers[0].slaveId, "", offers[0].params, ""));
+
+  driver.replyToOffer(offerId, tasks, map<string, string>());
+
+  WAIT_UNTIL(statusUpdateCall);
+
+  // The framework's executor never runs on this slave, so it shouldn't
+  // be told to kill the framework when it goes away.
+  Slave s2(Resources(2, 1 * Gigabyte), true, &isolationModule2);
+  PID slave2 = Process::spawn(&s2);
+
+  trigger slave2RegisteredMsg;
+
+  EXPECT_MSG(filter, Eq(M2S_REGISTER_REPLY), _, Eq(slave2))
+    .WillOnce(DoAll(Trigger(&slave2RegisteredMsg), Return(false)));
+
+  BasicMasterDetector detector2(master, slave2, true);
+
+  // Make sure the master knows about the slave before the framework
+  // goes away, or it couldn't have sent it the kill anyway.
+  WAIT_UNTIL(slave2RegisteredMsg);
+
+  EXPECT_MSG(filter, Eq(M2S_KILL_FRAMEWORK), _, _)
+    .WillOnce(Return(false));
+
+  driver.stop();
+  driver.join();
+
+  WAIT_UNTIL(shutdownCall);
+
+  MesosProcess::post(slave1, pack<S2S_SHUTDOWN>());
+  Process::wait(slave1);
+
+  MesosProcess::post(slave2, pack<S2S_SHUTDOWN>());
+  Process::wait(slave2);
+
+  MesosProcess::post(master, pack<M2M_SHUTDOWN>());
+  Process::wait(master);
+
+  Process::filter(NULL);
+}
+
+
 TEST(MasterTest, SchedulerFailoverStatusUpdate)
 {
   ASSERT_TRUE(GTEST_IS_THREADSAFE);
@@ -688,6 +1010,526 @@ TEST(MasterTest, SchedulerFailoverStatusUpdate)
 }
 
 
+TEST(MasterTest, StatusUpdateRetransmittedAfterLostAck)
+{
+  ASSERT_TRUE(GTEST_IS_THREADSAFE);
+
+  Clock::pause();
+
+  MockFilter filter;
+  Process::filter(&filter);
+
+  EXPECT_MSG(filter, _, _, _)
+    .WillRepeatedly(Return(false));
+
+  MockExecutor exec;
+
+  EXPECT_CALL(exec, init(_, _))
+    .Times(1);
+
+  EXPECT_CALL(exec, launchTask(_, _))
+    .Times(2);
+
+  EXPECT_CALL(exec, shutdown(_))
+    .Times(1);
+
+  LocalIsolationModule isolationModule(&exec);
+
+  EventLogger el;
+  Master m(&el);
+  PID master = Process::spawn(&m);
+
+  Slave s(Resources(2, 1 * Gigabyte), true, &isolationModule);
+  PID slave = Process::spawn(&s);
+
+  BasicMasterDetector detector(master, slave, true);
+
+  MockScheduler sched;
+  MesosSchedulerDriver driver(&sched, master);
+
+  OfferID offerId;
+  vector<SlaveOffer> offers;
+
+  trigger resourceOfferCall, statusUpdateCall, secondAckMsg, resentAckMsg;
+
+  EXPECT_CALL(sched, getFrameworkName(&driver))
+    .WillOnce(Return(""));
+
+  EXPECT_CALL(sched, getExecutorInfo(&driver))
+    .WillOnce(Return(ExecutorInfo("noexecutor", "")));
+
+  EXPECT_CALL(sched, registered(&driver, _))
+    .Times(1);
+
+  EXPECT_CALL(sched, resourceOffer(&driver, _, _))
+    .WillOnce(DoAll(SaveArg<1>(&offerId), SaveArg<2>(&offers),
+                    Trigger(&resourceOfferCall)));
+
+  // The resent status update is a duplicate, which the scheduler
+  // acknowledges but doesn't pass on.
+  EXPECT_CALL(sched, statusUpdate(&driver, _))
+    .WillOnce(Return())
+    .WillOnce(Trigger(&statusUpdateCall));
+
+  // Drop the ack for the first status update. The ack for the second
+  // one doesn't cover it, so the slave has to resend the first one.
+  EXPECT_MSG(filter, Eq(MSGID(RELIABLE_ACK)), _, Eq(slave))
+    .WillOnce(Return(true))
+    .WillOnce(DoAll(Trigger(&secondAckMsg), Return(false)))
+    .WillOnce(DoAll(Trigger(&resentAckMsg), Return(false)))
+    .RetiresOnSaturation();
+
+  driver.start();
+
+  WAIT_UNTIL(resourceOfferCall);
+
+  EXPECT_NE(0, offers.size());
+
+  map<string, string> params;
+  params["cpus"] = "1";
+  params["mem"] = lexical_cast<string>(512 * Megabyte);
+
+  vector<TaskDescription> tasks;
+  tasks.push_back(TaskDescription(1, offers[0].slaveId, "", params, ""));
+  tasks.push_back(TaskDescription(2, offers[0].slaveId, "", params, ""));
+
+  driver.replyToOffer(offerId, tasks, map<string, string>());
+
+  WAIT_UNTIL(statusUpdateCall);
+  WAIT_UNTIL(secondAckMsg);
+
+  SlaveStateGetter getter1(slave);
+  Process::wait(Process::spawn(&getter1));
+
+  ASSERT_TRUE(getter1.state != NULL);
+  EXPECT_EQ(1, getter1.state->unacknowledged_messages);
+
+  Clock::advance(RELIABLE_TIMEOUT);
+
+  WAIT_UNTIL(resentAckMsg);
+
+  SlaveStateGetter getter2(slave);
+  Process::wait(Process::spawn(&getter2));
+
+  ASSERT_TRUE(getter2.state != NULL);
+  EXPECT_EQ(0, getter2.state->unacknowledged_messages);
+
+  driver.stop();
+  driver.join();
+
+  MesosProcess::post(slave, pack<S2S_SHUTDOWN>());
+  Process::wait(slave);
+
+  MesosProcess::post(master, pack<M2M_SHUTDOWN>());
+  Process::wait(master);
+
+  Process::filter(NULL);
+
+  Clock::resume();
+}
+
+
+TEST(MasterTest, BatchedStatusUpdates)
+{
+  ASSERT_TRUE(GTEST_IS_THREADSAFE);
+
+  const int numTasks = 8;
+
+  MockFilter filter;
+  Process::filter(&filter);
+
+  EXPECT_MSG(filter, _, _, _)
+    .WillRepeatedly(Return(false));
+
+  MockExecutor exec;
+
+  EXPECT_CALL(exec, init(_, _))
+    .Times(1);
+
+  EXPECT_CALL(exec, launchTask(_, _))
+    .Times(numTasks);
+
+  EXPECT_CALL(exec, shutdown(_))
+    .Times(1);
+
+  LocalIsolationModule isolationModule(&exec);
+
+  EventLogger el;
+  Master m(&el);
+  PID master = Process::spawn(&m);
+
+  // Batches only get sent once they're full (long before the window
+  // closes), so every update should go in a batch of four.
+  Params conf;
+  conf.set("cpus", numTasks);
+  conf.set("mem", 1 * Gigabyte);
+  conf.set("status_update_batch_window", 60);
+  conf.set("status_update_batch_size", 4);
+
+  Slave s(conf, true, &isolationModule);
+  PID slave = Process::spawn(&s);
+
+  BasicMasterDetector detector(master, slave, true);
+
+  MockScheduler sched;
+  MesosSchedulerDriver driver(&sched, master);
+
+  OfferID offerId;
+  vector<SlaveOffer> offers;
+
+  trigger resourceOfferCall, statusUpdateCalls, ackMsgs;
+
+  EXPECT_CALL(sched, getFrameworkName(&driver))
+    .WillOnce(Return(""));
+
+  EXPECT_CALL(sched, getExecutorInfo(&driver))
+    .WillOnce(Return(ExecutorInfo("noexecutor", "")));
+
+  EXPECT_CALL(sched, registered(&driver, _))
+    .Times(1);
+
+  EXPECT_CALL(sched, resourceOffer(&driver, _, _))
+    .WillOnce(DoAll(SaveArg<1>(&offerId), SaveArg<2>(&offers),
+                    Trigger(&resourceOfferCall)));
+
+  Sequence updates;
+
+  EXPECT_CALL(sched, statusUpdate(&driver, _))
+    .Times(numTasks - 1)
+    .InSequence(updates);
+
+  EXPECT_CALL(sched, statusUpdate(&driver, _))
+    .InSequence(updates)
+    .WillOnce(Trigger(&statusUpdateCalls));
+
+  // One acknowledgement per batch.
+  EXPECT_MSG(filter, Eq(MSGID(RELIABLE_ACK)), _, Eq(slave))
+    .WillOnce(Return(false))
+    .WillOnce(DoAll(Trigger(&ackMsgs), Return(false)))
+    .RetiresOnSaturation();
+
+  driver.start();
+
+  WAIT_UNTIL(resourceOfferCall);
+
+  EXPECT_NE(0, offers.size());
+
+  map<string, string> params;
+  params["cpus"] = "1";
+  params["mem"] = lexical_cast<string>(64 * Megabyte);
+
+  vector<TaskDescription> tasks;
+  for (int i = 0; i < numTasks; i++)
+    tasks.push_back(TaskDescription(i, offers[0].slaveId, "", params, ""));
+
+  driver.replyToOffer(offerId, tasks, map<string, string>());
+
+  WAIT_UNTIL(statusUpdateCalls);
+  WAIT_UNTIL(ackMsgs);
+
+  SlaveStateGetter slaveGetter(slave);
+  Process::wait(Process::spawn(&slaveGetter));
+
+  ASSERT_TRUE(slaveGetter.state != NULL);
+  EXPECT_EQ(2, slaveGetter.state->status_update_batches);
+  EXPECT_EQ(numTasks, slaveGetter.state->batched_status_updates);
+  EXPECT_EQ(0, slaveGetter.state->unacknowledged_messages);
+
+  MasterStateGetter masterGetter(master);
+  Process::wait(Process::spawn(&masterGetter));
+
+  ASSERT_TRUE(masterGetter.state != NULL);
+  EXPECT_EQ(2, masterGetter.state->status_update_batches);
+  EXPECT_EQ(numTasks, masterGetter.state->batched_status_updates);
+
+  driver.stop();
+  driver.join();
+
+  MesosProcess::post(slave, pack<S2S_SHUTDOWN>());
+  Process::wait(slave);
+
+  MesosProcess::post(master, pack<M2M_SHUTDOWN>());
+  Process::wait(master);
+
+  Process::filter(NULL);
+}
+
+
+TEST(MasterTest, CachedExecutorInfo)
+{
+  ASSERT_TRUE(GTEST_IS_THREADSAFE);
+
+  const int numTasks = 4;
+
+  MockExecutor exec;
+
+  trigger launchTaskCalls;
+
+  EXPECT_CALL(exec, init(_, _))
+    .Times(1);
+
+  Sequence launches;
+
+  EXPECT_CALL(exec, launchTask(_, _))
+    .Times(numTasks - 1)
+    .InSequence(launches);
+
+  EXPECT_CALL(exec, launchTask(_, _))
+    .InSequence(launches)
+    .WillOnce(Trigger(&launchTaskCalls));
+
+  EXPECT_CALL(exec, shutdown(_))
+    .Times(1);
+
+  LocalIsolationModule isolationModule(&exec);
+
+  EventLogger el;
+  Master m(&el);
+  PID master = Process::spawn(&m);
+
+  Params conf;
+  conf.set("cpus", numTasks);
+  conf.set("mem", 1 * Gigabyte);
+
+  Slave s(conf, true, &isolationModule);
+  PID slave = Process::spawn(&s);
+
+  BasicMasterDetector detector(master, slave, true);
+
+  MockScheduler sched;
+  MesosSchedulerDriver driver(&sched, master);
+
+  OfferID offerId;
+  vector<SlaveOffer> offers;
+
+  trigger resourceOfferCall;
+
+  EXPECT_CALL(sched, getFrameworkName(&driver))
+    .WillOnce(Return(""));
+
+  EXPECT_CALL(sched, getExecutorInfo(&driver))
+    .WillOnce(Return(ExecutorInfo("noexecutor", string(1024, 'x'))));
+
+  EXPECT_CALL(sched, registered(&driver, _))
+    .Times(1);
+
+  EXPECT_CALL(sched, resourceOffer(&driver, _, _))
+    .WillOnce(DoAll(SaveArg<1>(&offerId), SaveArg<2>(&offers),
+                    Trigger(&resourceOfferCall)));
+
+  EXPECT_CALL(sched, statusUpdate(&driver, _))
+    .Times(AnyNumber());
+
+  driver.start();
+
+  WAIT_UNTIL(resourceOfferCall);
+
+  EXPECT_NE(0, offers.size());
+
+  map<string, string> params;
+  params["cpus"] = "1";
+  params["mem"] = lexical_cast<string>(64 * Megabyte);
+
+  vector<TaskDescription> tasks;
+  for (int i = 0; i < numTasks; i++)
+    tasks.push_back(TaskDescription(i, offers[0].slaveId, "", params, ""));
+
+  driver.replyToOffer(offerId, tasks, map<string, string>());
+
+  WAIT_UNTIL(launchTaskCalls);
+
+  // Only the first task carried the executor info.
+  MasterStateGetter masterGetter(master);
+  Process::wait(Process::spawn(&masterGetter));
+
+  ASSERT_TRUE(masterGetter.state != NULL);
+  EXPECT_EQ(numTasks - 1, masterGetter.state->cached_executor_infos);
+  EXPECT_LE((numTasks - 1) * 1024,
+            masterGetter.state->executor_info_bytes_saved);
+
+  driver.stop();
+  driver.join();
+
+  MesosProcess::post(slave, pack<S2S_SHUTDOWN>());
+  Process::wait(slave);
+
+  MesosProcess::post(master, pack<M2M_SHUTDOWN>());
+  Process::wait(master);
+}
+
+
+TEST(MasterTest, PublishedStateSharesUnchangedFrameworks)
+{
+  ASSERT_TRUE(GTEST_IS_THREADSAFE);
+
+  EventLogger el;
+  Master m(&el);
+  PID master = Process::spawn(&m);
+
+  BasicMasterDetector detector(master);
+
+  MockScheduler sched1;
+  MesosSchedulerDriver driver1(&sched1, master);
+
+  MockScheduler sched2;
+  MesosSchedulerDriver driver2(&sched2, master);
+
+  trigger sched1RegisteredCall, sched2RegisteredCall;
+
+  EXPECT_CALL(sched1, getFrameworkName(&driver1))
+    .WillOnce(Return("framework1"));
+
+  EXPECT_CALL(sched1, getExecutorInfo(&driver1))
+    .WillOnce(Return(ExecutorInfo("noexecutor", "")));
+
+  EXPECT_CALL(sched1, registered(&driver1, _))
+    .WillOnce(Trigger(&sched1RegisteredCall));
+
+  EXPECT_CALL(sched2, getFrameworkName(&driver2))
+    .WillOnce(Return("framework2"));
+
+  EXPECT_CALL(sched2, getExecutorInfo(&driver2))
+    .WillOnce(Return(ExecutorInfo("noexecutor", "")));
+
+  EXPECT_CALL(sched2, registered(&driver2, _))
+    .WillOnce(Trigger(&sched2RegisteredCall));
+
+  driver1.start();
+
+  WAIT_UNTIL(sched1RegisteredCall);
+
+  // Asking for the state makes the master publish it right away ...
+  MasterStateGetter getter1(master);
+  Process::wait(Process::spawn(&getter1));
+
+  // ... after which it can be read without going through the master.
+  mesos::internal::master::state::MasterState *state1 = m.getState();
+  ASSERT_EQ(1, state1->frameworks.size());
+  EXPECT_EQ("framework1", state1->frameworks[0]->name);
+
+  driver2.start();
+
+  WAIT_UNTIL(sched2RegisteredCall);
+
+  MasterStateGetter getter2(master);
+  Process::wait(Process::spawn(&getter2));
+
+  // The first framework hasn't changed, so it wasn't rebuilt.
+  mesos::internal::master::state::MasterState *state2 = m.getState();
+  ASSERT_EQ(2, state2->frameworks.size());
+  EXPECT_TRUE(state2->frameworks[0] == state1->frameworks[0] ||
+              state2->frameworks[1] == state1->frameworks[0]);
+
+  mesos::internal::master::state::Framework *framework1 =
+    state1->frameworks[0];
+  delete state1;
+  EXPECT_EQ("framework1", framework1->name);
+  delete state2;
+
+  driver1.stop();
+  driver2.stop();
+
+  driver1.join();
+  driver2.join();
+
+  MesosProcess::post(master, pack<M2M_SHUTDOWN>());
+  Process::wait(master);
+}
+
+
+TEST(MasterTest, OffersMadeOnTimeoutArePublished)
+{
+  ASSERT_TRUE(GTEST_IS_THREADSAFE);
+
+  Clock::pause();
+
+  MockFilter filter;
+  Process::filter(&filter);
+
+  EXPECT_MSG(filter, _, _, _)
+    .WillRepeatedly(Return(false));
+
+  // (Everything below happens in less than the second after which the
+  // master's allocator timer would send it a message.)
+  Params conf;
+  conf.set("offer_batch_interval", 0.4);
+  conf.set("state_publish_interval", 0.2);
+
+  EventLogger el;
+  Master m(conf, &el);
+  PID master = Process::spawn(&m);
+
+  BasicMasterDetector masterDetector(master);
+
+  MockScheduler sched;
+  MesosSchedulerDriver driver(&sched, master);
+
+  trigger registeredCall, slaveRegisteredMsg, resourceOfferCall;
+
+  EXPECT_CALL(sched, getFrameworkName(&driver))
+    .WillOnce(Return(""));
+
+  EXPECT_CALL(sched, getExecutorInfo(&driver))
+    .WillOnce(Return(ExecutorInfo("noexecutor", "")));
+
+  EXPECT_CALL(sched, registered(&driver, _))
+    .WillOnce(Trigger(&registeredCall));
+
+  EXPECT_CALL(sched, resourceOffer(&driver, _, _))
+    .WillOnce(Trigger(&resourceOfferCall));
+
+  EXPECT_MSG(filter, Eq(M2S_REGISTER_REPLY), _, _)
+    .WillOnce(DoAll(Trigger(&slaveRegisteredMsg), Return(false)));
+
+  driver.start();
+
+  WAIT_UNTIL(registeredCall);
+
+  ProcessBasedIsolationModule isolationModule;
+  Slave s(Resources(2, 1 * Gigabyte), true, &isolationModule);
+  PID slave = Process::spawn(&s);
+
+  BasicMasterDetector slaveDetector(master, slave, true);
+
+  WAIT_UNTIL(slaveRegisteredMsg);
+
+  // The slave's registration gets published before its resources are
+  // offered (at the end of the offer batch interval) ...
+  Clock::advance(0.2);
+
+  mesos::internal::master::state::MasterState *state =
+    waitForPublishedState(&m, 1, 0);
+  EXPECT_EQ(1, state->slaves.size());
+  delete state;
+
+  Clock::advance(0.2);
+
+  WAIT_UNTIL(resourceOfferCall);
+
+  // ... and the offer, which the master made on a timeout rather than
+  // a message, gets published after another publish interval.
+  Clock::advance(0.2);
+
+  state = waitForPublishedState(&m, 1, 1);
+  ASSERT_EQ(1, state->frameworks.size());
+  EXPECT_EQ(1, state->frameworks[0]->offers.size());
+  delete state;
+
+  driver.stop();
+  driver.join();
+
+  MesosProcess::post(slave, pack<S2S_SHUTDOWN>());
+  Process::wait(slave);
+
+  MesosProcess::post(master, pack<M2M_SHUTDOWN>());
+  Process::wait(master);
+
+  Process::filter(NULL);
+
+  Clock::resume();
+}
+
+
 TEST(MasterTest, FrameworkMessage)
 {
   ASSERT_TRUE(GTEST_IS_THREADSAFE);
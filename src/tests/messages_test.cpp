@@ -0,0 +1,230 @@
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include <local/local.hpp>
+
+#include <master/state.hpp>
+
+#include <messaging/messages.hpp>
+
+using namespace mesos;
+using namespace mesos::internal;
+
+using process::tuples::deserializer;
+using process::tuples::serializer;
+using process::tuples::view;
+
+using std::string;
+
+
+namespace {
+
+struct Point
+{
+  int32_t x;
+  int32_t y;
+  int32_t z;
+};
+
+
+// How a newer peer might serialize a point, with a field appended.
+void newerFields(serializer &s, const Point &p)
+{
+  s & p.x;
+  s & p.y;
+  s & p.z;
+}
+
+
+void olderFields(deserializer &d, Point &p)
+{
+  d & p.x;
+  d & p.y;
+}
+
+
+// The registration a slave from before capabilities were advertised
+// would send, byte for byte: the legacy "0|" prefix, then its hostname
+// and web UI URL, then its cpus and mem as two plain ints.
+string oldRegistration(int32_t cpus, int32_t mem)
+{
+  const string hostname = "localhost";
+  const string webUIUrl = "";
+
+  serializer counter;
+  counter & hostname;
+  counter & webUIUrl;
+  counter & cpus;
+  counter & mem;
+
+  string data = "0|";
+  size_t prefix = data.size();
+  data.resize(prefix + counter.size);
+
+  serializer s(&data[prefix]);
+  s & hostname;
+  s & webUIUrl;
+  s & cpus;
+  s & mem;
+  return data;
+}
+
+
+/**
+ * A process that pretends to be a slave advertising the given
+ * capabilities, or an old slave if they're 0. It registers with the
+ * master, records how the master encoded its reply, and unregisters
+ * again.
+ */
+class RegisteringSlave : public MesosProcess
+{
+public:
+  RegisteringSlave(const PID &_master, int32_t _capabilities)
+    : compactReply(false), legacyReply(false), masterCapabilities(0),
+      registeredCpus(-1), registeredMem(-1), slavesLeft(-1),
+      master(_master), capabilities(_capabilities) {}
+
+  bool compactReply;
+  bool legacyReply; // Whether the reply started with the "0|" prefix.
+  int32_t masterCapabilities;
+  int32_t registeredCpus; // Resources the master registered us with.
+  int64_t registeredMem;
+  int slavesLeft; // Slaves the master still knows about at the end.
+
+protected:
+  void operator () ()
+  {
+    Resources resources(1, 32 * Megabyte);
+    if (capabilities == 0) {
+      const string &data = oldRegistration(resources[CPUS], resources[MEM]);
+      ReliableProcess::send(master, S2M_REGISTER_SLAVE,
+                            data.data(), data.size());
+    } else {
+      send(master, pack<S2M_REGISTER_SLAVE>("localhost", "", resources,
+                                            capabilities,
+                                            otherResourceAmounts(resources)));
+    }
+    while (receive() != M2S_REGISTER_REPLY);
+
+    size_t size;
+    const char *reply = ReliableProcess::body(&size);
+    compactReply = reply[0] == MESOS_BINARY_VERSION;
+    legacyReply = size >= 2 && string(reply, 2) == "0|";
+
+    SlaveID sid;
+    double interval;
+    tie(sid, interval, masterCapabilities) =
+      unpack<M2S_REGISTER_REPLY>(body());
+
+    send(master, pack<M2M_GET_STATE>());
+    while (receive() != M2M_GET_STATE_REPLY);
+    master::state::MasterState *state =
+      unpack<M2M_GET_STATE_REPLY, 0>(body());
+    if (state->slaves.size() == 1) {
+      registeredCpus = state->slaves[0]->cpus;
+      registeredMem = state->slaves[0]->mem;
+    }
+    delete state;
+
+    // Unregister in the encoding an old slave would use, or in the
+    // compact one if the master can read it.
+    if (capabilities != 0)
+      recordCapabilities(master, masterCapabilities);
+    send(master, pack<S2M_UNREGISTER_SLAVE>(sid));
+
+    send(master, pack<M2M_GET_STATE>());
+    while (receive() != M2M_GET_STATE_REPLY);
+    state = unpack<M2M_GET_STATE_REPLY, 0>(body());
+    slavesLeft = state->slaves.size();
+    delete state;
+  }
+
+private:
+  const PID master;
+  const int32_t capabilities;
+};
+
+}
+
+
+TEST(MessagesTest, CompactEncodingRoundTrips)
+{
+  tuple<M2F_ERROR> error = pack<M2F_ERROR>(-1, "error");
+
+  string data(error.serialized_size(true), '\0');
+  error.serialize_to(&data[0], true);
+  EXPECT_GT(string(error).size(), data.size());
+
+  int32_t code;
+  string message;
+  tie(code, message) =
+    unpack<M2F_ERROR>(view(data.data(), data.size(), true));
+  EXPECT_EQ(-1, code);
+  EXPECT_EQ("error", message);
+
+  PID pid("slave@127.0.0.1:5051");
+  tuple<M2S_UPDATE_FRAMEWORK_PID> update =
+    pack<M2S_UPDATE_FRAMEWORK_PID>("framework", pid, MESOS_CAPABILITIES);
+
+  data.assign(update.serialized_size(true), '\0');
+  update.serialize_to(&data[0], true);
+  EXPECT_EQ(pid, (unpack<M2S_UPDATE_FRAMEWORK_PID, 1>(
+                    view(data.data(), data.size(), true))));
+}
+
+
+TEST(MessagesTest, CompactEncodingSkipsFieldsAddedToNestedTypes)
+{
+  Point p = { 1, -2, 3 };
+
+  serializer counter(NULL, true);
+  counter.delimited(p, newerFields);
+  counter & string("after");
+
+  string data(counter.size, '\0');
+  serializer s(&data[0], true);
+  s.delimited(p, newerFields);
+  s & string("after");
+  ASSERT_EQ(counter.size, s.size);
+
+  Point q = { 0, 0, 0 };
+  string after;
+  deserializer d(data.data(), data.size(), true);
+  d.delimited(q, olderFields);
+  d & after;
+
+  EXPECT_EQ(1, q.x);
+  EXPECT_EQ(-2, q.y);
+  EXPECT_EQ(0, q.z);
+  EXPECT_EQ("after", after);
+}
+
+
+TEST(MessagesTest, MasterUsesCompactEncodingOnlyWithCapablePeers)
+{
+  ASSERT_TRUE(GTEST_IS_THREADSAFE);
+
+  PID master = local::launch(0, 0, 0, false, false);
+
+  // A slave from before capabilities were advertised.
+  RegisteringSlave old(master, 0);
+  Process::wait(Process::spawn(&old));
+  EXPECT_FALSE(old.compactReply);
+  EXPECT_TRUE(old.legacyReply);
+  EXPECT_EQ(MESOS_CAPABILITIES, old.masterCapabilities);
+  EXPECT_EQ(1, old.registeredCpus);
+  EXPECT_EQ(32 * Megabyte, old.registeredMem);
+  EXPECT_EQ(0, old.slavesLeft);
+
+  RegisteringSlave capable(master, MESOS_CAPABILITIES);
+  Process::wait(Process::spawn(&capable));
+  EXPECT_TRUE(capable.compactReply);
+  EXPECT_FALSE(capable.legacyReply);
+  EXPECT_EQ(MESOS_CAPABILITIES, capable.masterCapabilities);
+  EXPECT_EQ(1, capable.registeredCpus);
+  EXPECT_EQ(32 * Megabyte, capable.registeredMem);
+  EXPECT_EQ(0, capable.slavesLeft);
+
+  local::shutdown();
+}
@@ -0,0 +1,53 @@
+#include <gtest/gtest.h>
+
+#include <boost/unordered_set.hpp>
+
+#include <common/pool.hpp>
+
+using namespace mesos;
+using namespace mesos::internal;
+
+
+TEST(PoolTest, ObjectPoolReusesFreedObjects)
+{
+  ObjectPool<int64_t> pool(4);
+  ASSERT_EQ(0, pool.capacity());
+
+  int64_t *a = new (pool.allocate()) int64_t(1);
+  int64_t *b = new (pool.allocate()) int64_t(2);
+  ASSERT_EQ(2, pool.inUse());
+  ASSERT_EQ(4, pool.capacity());
+
+  pool.destroy(a);
+  ASSERT_EQ(1, pool.inUse());
+
+  int64_t *c = new (pool.allocate()) int64_t(3);
+  ASSERT_EQ(a, c);
+  ASSERT_EQ(2, *b);
+
+  pool.destroy(b);
+  pool.destroy(c);
+  ASSERT_EQ(0, pool.inUse());
+  ASSERT_EQ(4, pool.capacity());
+}
+
+
+TEST(PoolTest, PoolAllocatorTakesSetNodesFromPools)
+{
+  typedef boost::unordered_set<int, boost::hash<int>, std::equal_to<int>,
+                               PoolAllocator<int> > Set;
+
+  SlabPools pools;
+  Set set((PoolAllocator<int>(&pools)));
+  for (int i = 0; i < 100; i++)
+    set.insert(i);
+  ASSERT_EQ(100, pools.inUse());
+
+  Set copy = set;
+  ASSERT_EQ(200, pools.inUse());
+
+  set.clear();
+  copy.clear();
+  ASSERT_EQ(0, pools.inUse());
+  ASSERT_LE(100, pools.capacity());
+}
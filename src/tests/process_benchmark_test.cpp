@@ -0,0 +1,420 @@
+#include <gtest/gtest.h>
+
+#include <ucontext.h>
+
+#include <sys/time.h>
+
+#include <iostream>
+#include <list>
+#include <map>
+#include <vector>
+
+#include <context.hpp>
+#include <process.hpp>
+#include <timers.hpp>
+
+#include <common/foreach.hpp>
+
+using std::cout;
+using std::endl;
+using std::list;
+using std::map;
+using std::vector;
+
+
+namespace {
+
+enum { PING = PROCESS_MSGID, PONG, STOP };
+
+
+double now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+
+/**
+ * A process that receives a given number of messages (from any number
+ * of senders).
+ */
+class Receiver : public Process
+{
+public:
+  Receiver(int _numMessages) : numMessages(_numMessages) {}
+
+protected:
+  void operator () ()
+  {
+    for (int i = 0; i < numMessages; i++)
+      while (receive() != PING);
+  }
+
+private:
+  const int numMessages;
+};
+
+
+/**
+ * A process that sends a given number of messages to a receiver as
+ * fast as it can.
+ */
+class Sender : public Process
+{
+public:
+  Sender(const PID &_receiver, int _numMessages)
+    : receiver(_receiver), numMessages(_numMessages) {}
+
+protected:
+  void operator () ()
+  {
+    for (int i = 0; i < numMessages; i++)
+      send(receiver, PING);
+  }
+
+private:
+  const PID receiver;
+  const int numMessages;
+};
+
+
+/**
+ * A process that answers every ping with a pong until it is stopped
+ * (receiving with a timeout if given one).
+ */
+class Ponger : public Process
+{
+public:
+  Ponger(double _timeout = 0) : timeout(_timeout) {}
+
+protected:
+  void operator () ()
+  {
+    while (true) {
+      switch (receive(timeout)) {
+        case PING:
+          send(from(), PONG);
+          break;
+        case STOP:
+          return;
+      }
+    }
+  }
+
+private:
+  const double timeout;
+};
+
+
+/**
+ * A process that pings a ponger a given number of times, waiting for
+ * each pong (with a timeout if given one) before sending the next ping.
+ */
+class Pinger : public Process
+{
+public:
+  Pinger(const PID &_ponger, int _numPings, double _timeout = 0)
+    : ponger(_ponger), numPings(_numPings), timeout(_timeout) {}
+
+protected:
+  void operator () ()
+  {
+    for (int i = 0; i < numPings; i++) {
+      send(ponger, PING);
+      while (receive(timeout) != PONG);
+    }
+  }
+
+private:
+  const PID ponger;
+  const int numPings;
+  const double timeout;
+};
+
+
+/**
+ * A process that waits until it is stopped, keeping a timeout far in
+ * the future pending all along.
+ */
+class Waiter : public Process
+{
+protected:
+  void operator () ()
+  {
+    while (receive(3600) != STOP);
+  }
+};
+
+
+/* Contexts that switch back and forth between a test and a bouncer. */
+context testContext, bouncerContext;
+ucontext_t testUcontext, bouncerUcontext;
+
+
+void bounce(void *)
+{
+  while (true)
+    context_swap(&bouncerContext, &testContext);
+}
+
+
+void ubounce()
+{
+  while (true)
+    swapcontext(&bouncerUcontext, &testUcontext);
+}
+
+}
+
+
+TEST(ProcessBenchmark, MessageThroughputWithManySenders)
+{
+  const int numMessages = 200000;
+
+  vector<double> times;
+
+  int senders[] = { 1, 4, 16 };
+  for (size_t i = 0; i < sizeof(senders) / sizeof(senders[0]); i++) {
+    Receiver receiver(numMessages);
+    PID pid = Process::spawn(&receiver);
+
+    // Time everything from the first send to the last receive.
+    double start = now();
+
+    vector<Sender *> processes;
+    for (int j = 0; j < senders[i]; j++) {
+      Sender *sender = new Sender(pid, numMessages / senders[i]);
+      Process::spawn(sender);
+      processes.push_back(sender);
+    }
+
+    Process::wait(pid);
+    double time = now() - start;
+
+    foreach (Sender *sender, processes) {
+      Process::wait(sender->self());
+      delete sender;
+    }
+
+    times.push_back(time);
+
+    cout << "Delivered " << numMessages << " messages from " << senders[i]
+         << " senders in " << time << " seconds ("
+         << (numMessages / time) << " messages/sec)" << endl;
+  }
+
+  // Senders don't contend for the receiver's lock, so many of them
+  // should deliver about as fast as one.
+  EXPECT_LT(times.back(), 3 * times.front());
+}
+
+
+TEST(ProcessBenchmark, MessageThroughputWithManyReceivers)
+{
+  const int numMessages = 200000;
+
+  vector<double> times;
+
+  int pairs[] = { 16, 256, 1024 };
+  for (size_t i = 0; i < sizeof(pairs) / sizeof(pairs[0]); i++) {
+    const int numMessagesPerPair = numMessages / pairs[i];
+
+    vector<Receiver *> receivers;
+    vector<PID> pids;
+    for (int j = 0; j < pairs[i]; j++) {
+      Receiver *receiver = new Receiver(numMessagesPerPair);
+      pids.push_back(Process::spawn(receiver));
+      receivers.push_back(receiver);
+    }
+
+    // Time everything from the first send to the last receive.
+    double start = now();
+
+    vector<Sender *> senders;
+    for (int j = 0; j < pairs[i]; j++) {
+      Sender *sender = new Sender(pids[j], numMessagesPerPair);
+      Process::spawn(sender);
+      senders.push_back(sender);
+    }
+
+    foreach (const PID &pid, pids)
+      Process::wait(pid);
+    double time = now() - start;
+
+    foreach (Sender *sender, senders) {
+      Process::wait(sender->self());
+      delete sender;
+    }
+
+    foreach (Receiver *receiver, receivers)
+      delete receiver;
+
+    times.push_back(time);
+
+    cout << "Delivered " << numMessagesPerPair * pairs[i] << " messages to "
+         << pairs[i] << " receivers in " << time << " seconds ("
+         << (numMessagesPerPair * pairs[i] / time) << " messages/sec)" << endl;
+  }
+
+  // Lookups in the (sharded) process table shouldn't get much slower
+  // with more processes in it; this leaves room for the cost of
+  // switching between many more processes' stacks.
+  EXPECT_LT(times.back(), 5 * times.front());
+}
+
+
+TEST(ProcessBenchmark, PingPongBetweenLocalProcesses)
+{
+  const int numPings = 100000;
+
+  Ponger ponger;
+  PID pid = Process::spawn(&ponger);
+
+  Pinger pinger(pid, numPings);
+
+  double start = now();
+  Process::wait(Process::spawn(&pinger));
+  double time = now() - start;
+
+  Process::post(pid, STOP);
+  Process::wait(pid);
+
+  // Every round trip resumes (and suspends) both processes.
+  cout << "Ping-ponged " << numPings << " times in " << time
+       << " seconds (" << (4 * numPings / time) << " context switches/sec)"
+       << endl;
+}
+
+
+TEST(ProcessBenchmark, ContextSwitches)
+{
+  const int numSwitches = 200000;
+  const size_t stackSize = 64 * 1024;
+
+  char *stack = new char[stackSize];
+  context_init(&bouncerContext, stack, stackSize, bounce, NULL);
+
+  double contextTime = now();
+  for (int i = 0; i < numSwitches; i++)
+    context_swap(&testContext, &bouncerContext);
+  contextTime = now() - contextTime;
+
+  char *ustack = new char[stackSize];
+  getcontext(&bouncerUcontext);
+  bouncerUcontext.uc_stack.ss_sp = ustack;
+  bouncerUcontext.uc_stack.ss_size = stackSize;
+  bouncerUcontext.uc_link = NULL;
+  makecontext(&bouncerUcontext, ubounce, 0);
+
+  double ucontextTime = now();
+  for (int i = 0; i < numSwitches; i++)
+    swapcontext(&testUcontext, &bouncerUcontext);
+  ucontextTime = now() - ucontextTime;
+
+  // (The bouncers never get to run again.)
+  delete[] stack;
+  delete[] ustack;
+
+  cout << "Switched contexts " << 2 * numSwitches << " times in "
+       << contextTime << " seconds and " << ucontextTime
+       << " seconds with swapcontext" << endl;
+
+#ifdef CONTEXT_X86_64
+  // Not saving and restoring the signal mask spares two system calls
+  // per switch, which should more than make up for any difference in
+  // the registers saved.
+  EXPECT_LT(contextTime, ucontextTime);
+#endif
+}
+
+
+TEST(ProcessBenchmark, TimeoutsWith100kTimers)
+{
+  const int numTimers = 100000;
+  const double start = now();
+
+  // Timeouts spread over a minute; every other one gets canceled (as
+  // when a message arrives before a receive times out).
+  vector<double> tstamps;
+  for (int i = 0; i < numTimers; i++)
+    tstamps.push_back(start + (i * 7919 % numTimers) * 60.0 / numTimers);
+
+  // The timer wheel.
+  double wheelTime = now();
+  {
+    TimerWheel<int> timers(0.001, start);
+    vector<TimerWheel<int>::Handle> handles;
+    for (int i = 0; i < numTimers; i++)
+      handles.push_back(timers.add(tstamps[i], i));
+    for (int i = 0; i < numTimers; i += 2)
+      timers.cancel(handles[i]);
+
+    vector<int> expired;
+    for (double t = start; t <= start + 60; t += 0.01)
+      timers.expire(t, &expired);
+    ASSERT_EQ(numTimers / 2, expired.size());
+  }
+  wheelTime = now() - wheelTime;
+
+  // A sorted map of lists of timers (which libprocess used to use).
+  double mapTime = now();
+  {
+    map<double, list<int> > timers;
+    for (int i = 0; i < numTimers; i++)
+      timers[tstamps[i]].push_back(i);
+    for (int i = 0; i < numTimers; i += 2) {
+      timers[tstamps[i]].remove(i);
+      if (timers[tstamps[i]].empty())
+        timers.erase(tstamps[i]);
+    }
+
+    vector<int> expired;
+    for (double t = start; t <= start + 60; t += 0.01) {
+      map<double, list<int> >::iterator end = timers.upper_bound(t);
+      for (map<double, list<int> >::iterator it = timers.begin();
+           it != end; ++it)
+        expired.insert(expired.end(), it->second.begin(), it->second.end());
+      timers.erase(timers.begin(), end);
+    }
+    ASSERT_EQ(numTimers / 2, expired.size());
+  }
+  mapTime = now() - mapTime;
+
+  cout << "Added, canceled half of and expired " << numTimers
+       << " timers in " << wheelTime << " seconds with a timer wheel and "
+       << mapTime << " seconds with a map" << endl;
+
+  // The same number of timeouts started and canceled by libprocess: a
+  // pinger and a ponger receive with timeouts (each of which the next
+  // message cancels) while many waiters keep later timeouts pending.
+  const int numWaiters = 1000;
+
+  vector<Waiter *> waiters;
+  for (int i = 0; i < numWaiters; i++) {
+    waiters.push_back(new Waiter());
+    Process::spawn(waiters.back());
+  }
+
+  Ponger ponger(60);
+  PID pid = Process::spawn(&ponger);
+
+  Pinger pinger(pid, numTimers / 2, 60);
+
+  double processTime = now();
+  Process::wait(Process::spawn(&pinger));
+  processTime = now() - processTime;
+
+  Process::post(pid, STOP);
+  Process::wait(pid);
+
+  foreach (Waiter *waiter, waiters) {
+    Process::post(waiter->self(), STOP);
+    Process::wait(waiter->self());
+    delete waiter;
+  }
+
+  cout << "Started and canceled " << numTimers << " receive timeouts with "
+       << numWaiters << " other timers in " << processTime << " seconds"
+       << endl;
+}
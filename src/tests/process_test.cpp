@@ -0,0 +1,239 @@
+#include <gtest/gtest.h>
+
+#include <string.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+
+#include <netinet/in.h>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include <vector>
+
+#include <process.hpp>
+#include <reliable.hpp>
+
+#include <tests/utils.hpp>
+
+using mesos::internal::test::trigger;
+
+
+namespace {
+
+/**
+ * A process that uses a given amount of its stack and records how
+ * many bytes of stacks were in use while it ran.
+ */
+class DeepProcess : public Process
+{
+public:
+  DeepProcess(size_t _depth) : liveStacks(0), depth(_depth) {}
+
+  int64_t liveStacks;
+
+protected:
+  void operator () ()
+  {
+    liveStacks = Stacks::live();
+    descend(depth);
+  }
+
+private:
+  void descend(size_t bytes)
+  {
+    volatile char frame[4096];
+    memset((char *) frame, 0, sizeof(frame));
+    if (bytes > sizeof(frame))
+      descend(bytes - sizeof(frame));
+  }
+
+  const size_t depth;
+};
+
+
+/**
+ * A process that receives messages until it gets PROCESS_MSGID.
+ */
+class Idler : public Process
+{
+protected:
+  void operator () ()
+  {
+    while (receive() != PROCESS_MSGID);
+  }
+};
+
+
+/**
+ * A process that counts the reliable messages it receives (without
+ * acknowledging them) until it gets RELIABLE_MSGID.
+ */
+class Counter : public Process
+{
+public:
+  Counter() : received(0) {}
+
+  int received;
+  trigger sent;   // Got the messages sent the first time.
+  trigger resent; // Got the ones still unacknowledged once more.
+
+protected:
+  void operator () ()
+  {
+    while (receive() != RELIABLE_MSGID) {
+      received++;
+      if (received == 3)
+        sent.value = true;
+      if (received == 5)
+        resent.value = true;
+    }
+  }
+};
+
+
+/**
+ * A process that reliably sends three messages to a given process,
+ * cancels the second one and then waits (retransmitting the others)
+ * until it gets RELIABLE_MSGID.
+ */
+class ReliableSender : public ReliableProcess
+{
+public:
+  ReliableSender(const PID &_to) : unacked(0), to(_to) {}
+
+  size_t unacked; // Messages still unacknowledged at the end.
+
+protected:
+  void operator () ()
+  {
+    rsend(to, RELIABLE_MSGID);
+    int seq = rsend(to, RELIABLE_MSGID);
+    rsend(to, RELIABLE_MSGID);
+    cancel(seq);
+    while (receive() != RELIABLE_MSGID);
+    unacked = unacknowledged();
+  }
+
+private:
+  const PID to;
+};
+
+}
+
+
+TEST(ProcessTest, SpawnWithLargerStack)
+{
+  const size_t stack = 1024 * 1024;
+
+  // Would run off the end of a default (64 KB) stack.
+  DeepProcess process(stack / 2);
+  Process::wait(Process::spawn(&process, stack));
+
+  EXPECT_LE((int64_t) stack, process.liveStacks);
+}
+
+
+TEST(ProcessTest, SpawnWithSmallerStack)
+{
+  DeepProcess process(4096);
+  Process::wait(Process::spawn(&process, 16 * 1024));
+
+  EXPECT_LT(0, process.liveStacks);
+}
+
+
+TEST(ProcessTest, StackCacheStaysWithinLimit)
+{
+  // Enough processes running at once that their stacks can't all be
+  // kept for reuse once they exit.
+  const size_t stack = 64 * 1024;
+  const size_t count = 2 * Stacks::cacheLimit() / stack + 1;
+
+  std::vector<Idler *> idlers;
+  std::vector<PID> pids;
+  for (size_t i = 0; i < count; i++) {
+    idlers.push_back(new Idler());
+    pids.push_back(Process::spawn(idlers.back(), stack));
+  }
+
+  EXPECT_LT(Stacks::cacheLimit(), Stacks::live());
+
+  for (size_t i = 0; i < count; i++) {
+    Process::post(pids[i], PROCESS_MSGID);
+    Process::wait(pids[i]);
+    delete idlers[i];
+  }
+
+  EXPECT_LT(0, Stacks::cached());
+  EXPECT_LE(Stacks::cached(), Stacks::cacheLimit());
+}
+
+
+TEST(ProcessTest, ConnectionSendingTooLongMessageIsClosed)
+{
+  Idler idler;
+  PID pid = Process::spawn(&idler);
+
+  int s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  ASSERT_LE(0, s);
+
+  struct timeval timeout = { 10, 0 };
+  setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(pid.port);
+  addr.sin_addr.s_addr = pid.ip;
+  ASSERT_EQ(0, connect(s, (struct sockaddr *) &addr, sizeof(addr)));
+
+  // A header claiming a body far longer than libprocess accepts.
+  struct msg header;
+  memset(&header, 0, sizeof(header));
+  header.to = pid;
+  header.id = PROCESS_MSGID;
+  header.len = 0xffffffff;
+  ASSERT_EQ(sizeof(header), send(s, &header, sizeof(header), 0));
+
+  // The other end closes the connection rather than waiting for (or
+  // trying to make room for) the body.
+  char c;
+  EXPECT_EQ(0, recv(s, &c, 1, 0));
+
+  close(s);
+
+  Process::post(pid, PROCESS_MSGID);
+  Process::wait(pid);
+}
+
+
+TEST(ProcessTest, ReliableMessagesRetransmittedUntilCanceled)
+{
+  Clock::pause();
+
+  Counter counter;
+  PID pid = Process::spawn(&counter);
+
+  ReliableSender sender(pid);
+  Process::spawn(&sender);
+
+  WAIT_UNTIL(counter.sent);
+
+  // Only the two messages that weren't canceled get resent.
+  Clock::advance(RELIABLE_TIMEOUT);
+
+  WAIT_UNTIL(counter.resent);
+
+  Process::post(sender.self(), RELIABLE_MSGID);
+  Process::wait(sender.self());
+
+  Process::post(pid, RELIABLE_MSGID);
+  Process::wait(pid);
+
+  EXPECT_EQ(5, counter.received);
+  EXPECT_EQ(2, sender.unacked);
+
+  Clock::resume();
+}
@@ -13,8 +13,8 @@ using namespace mesos::internal::master;
 TEST(ResourcesTest, InitializedWithZero)
 {
   Resources r;
-  EXPECT_EQ(0, r.cpus);
-  EXPECT_EQ(0, r.mem);
+  EXPECT_EQ(0, r[CPUS]);
+  EXPECT_EQ(0, r[MEM]);
 }
 
 
@@ -23,15 +23,15 @@ TEST(ResourcesTest, Addition)
   Resources r1(1, 5);
   Resources r2(2, 10);
   Resources sum = r1 + r2;
-  EXPECT_EQ(3, sum.cpus);
-  EXPECT_EQ(15, sum.mem);
+  EXPECT_EQ(3, sum[CPUS]);
+  EXPECT_EQ(15, sum[MEM]);
   Resources r;
   r += r1;
-  EXPECT_EQ(1, r.cpus);
-  EXPECT_EQ(5, r.mem);
+  EXPECT_EQ(1, r[CPUS]);
+  EXPECT_EQ(5, r[MEM]);
   r += r2;
-  EXPECT_EQ(3, r.cpus);
-  EXPECT_EQ(15, r.mem);
+  EXPECT_EQ(3, r[CPUS]);
+  EXPECT_EQ(15, r[MEM]);
 }
 
 
@@ -40,15 +40,15 @@ TEST(ResourcesTest, Subtraction)
   Resources r1(1, 5);
   Resources r2(2, 10);
   Resources dif = r1 - r2;
-  EXPECT_EQ(-1, dif.cpus);
-  EXPECT_EQ(-5, dif.mem);
+  EXPECT_EQ(-1, dif[CPUS]);
+  EXPECT_EQ(-5, dif[MEM]);
   Resources r;
   r -= r1;
-  EXPECT_EQ(-1, r.cpus);
-  EXPECT_EQ(-5, r.mem);
+  EXPECT_EQ(-1, r[CPUS]);
+  EXPECT_EQ(-5, r[MEM]);
   r -= r2;
-  EXPECT_EQ(-3, r.cpus);
-  EXPECT_EQ(-15, r.mem);
+  EXPECT_EQ(-3, r[CPUS]);
+  EXPECT_EQ(-15, r[MEM]);
 }
 
 
@@ -59,3 +59,53 @@ TEST(ResourcesTest, PrettyPrinting)
   oss << r;
   EXPECT_EQ("<3 CPUs, 1001001001 MEM>", oss.str());
 }
+
+
+TEST(ResourcesTest, PrettyPrintingOtherDimensions)
+{
+  Resources r(3, 1024);
+  r[DISK] = 200;
+  ostringstream oss;
+  oss << r;
+  EXPECT_EQ("<3 CPUs, 1024 MEM, 200 disk>", oss.str());
+}
+
+
+TEST(ResourcesTest, FitsIn)
+{
+  Resources r1(1, 5);
+  Resources r2(2, 10);
+  EXPECT_TRUE(r1.fitsIn(r2));
+  EXPECT_FALSE(r2.fitsIn(r1));
+  r1[NET] = 1;
+  EXPECT_FALSE(r1.fitsIn(r2));
+}
+
+
+TEST(ResourcesTest, DominantShare)
+{
+  Resources total(10, 100);
+  total[DISK] = 1000;
+  Resources r(1, 20);
+  EXPECT_DOUBLE_EQ(0.2, r.dominantShare(total));
+  r[DISK] = 500;
+  EXPECT_DOUBLE_EQ(0.5, r.dominantShare(total));
+}
+
+
+TEST(ResourcesTest, Params)
+{
+  Params params;
+  params.set("cpus", 2);
+  params.set("disk", 100);
+  Resources r = paramsToResources(params);
+  EXPECT_EQ(2, r[CPUS]);
+  EXPECT_EQ(-1, r[MEM]);
+  EXPECT_EQ(100, r[DISK]);
+  EXPECT_EQ(0, r[NET]);
+
+  Params out;
+  resourcesToParams(r, &out);
+  EXPECT_EQ("100", out.get<string>("disk", ""));
+  EXPECT_EQ("0", out.get<string>("net", ""));
+}
@@ -0,0 +1,199 @@
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/time.h>
+
+#include <iostream>
+
+#include <boost/lexical_cast.hpp>
+
+#include <messaging/messages.hpp>
+
+using namespace mesos;
+using namespace mesos::internal;
+
+using boost::lexical_cast;
+
+using std::cout;
+using std::endl;
+using std::map;
+using std::string;
+using std::vector;
+
+
+namespace {
+
+double now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+
+// Sends and receives a tuple the way MesosProcess used to: serialized
+// into a string, prefixed with the messaging version, copied into the
+// message and copied back out of it again to be unpacked.
+template <MSGID ID>
+tuple<ID> roundTripThroughStrings(const tuple<ID> &t)
+{
+  const string &data = MESOS_MESSAGING_VERSION + "|" + string(t);
+  char *msg = (char *) malloc(data.size());
+  memcpy(msg, data.data(), data.size());
+
+  const string body(msg, data.size());
+  size_t index = body.find('|');
+  tuple<ID> result = unpack<ID>(body.substr(index + 1));
+
+  free(msg);
+  return result;
+}
+
+
+// Sends and receives a tuple the way MesosProcess does: written
+// straight into the message (in the original or the compact encoding)
+// and unpacked from it in place.
+template <MSGID ID>
+tuple<ID> roundTripInPlace(const tuple<ID> &t, bool compact = false)
+{
+  TupleBody<ID> body(t, compact);
+  size_t length = body.length();
+  char *msg = (char *) malloc(length);
+  body.write(msg);
+
+  bool binary = msg[0] == MESOS_BINARY_VERSION;
+  const char *data =
+    binary ? msg + 1 : (const char *) memchr(msg, '|', length) + 1;
+  tuple<ID> result =
+    unpack<ID>(process::tuples::view(data, length - (data - msg), binary));
+
+  free(msg);
+  return result;
+}
+
+
+template <MSGID ID>
+void benchmark(const string &name, const tuple<ID> &t, int iterations)
+{
+  double start = now();
+  for (int i = 0; i < iterations; i++)
+    roundTripThroughStrings(t);
+  double strings = now() - start;
+
+  start = now();
+  for (int i = 0; i < iterations; i++)
+    roundTripInPlace(t);
+  double inPlace = now() - start;
+
+  cout << "Sent and received " << iterations << " " << name << " messages ("
+       << string(t).size() << " bytes) in " << strings << " seconds "
+       << "through strings and " << inPlace << " seconds in place" << endl;
+}
+
+
+template <MSGID ID>
+void compareEncodings(const string &name, const tuple<ID> &t, int iterations)
+{
+  double start = now();
+  for (int i = 0; i < iterations; i++)
+    roundTripInPlace(t);
+  double original = now() - start;
+
+  start = now();
+  for (int i = 0; i < iterations; i++)
+    roundTripInPlace(t, true);
+  double compact = now() - start;
+
+  cout << "Sent and received " << iterations << " " << name << " messages in "
+       << original << " seconds (" << TupleBody<ID>(t).length()
+       << " bytes) in the original encoding and " << compact << " seconds ("
+       << TupleBody<ID>(t, true).length() << " bytes) in the compact encoding"
+       << endl;
+}
+
+}
+
+
+TEST(SerializationBenchmark, RunTaskAndSlotOffer)
+{
+  const int iterations = 10000;
+
+  map<string, string> params;
+  params["cpus"] = "1";
+  params["mem"] = lexical_cast<string>(1024 * Megabyte);
+
+  // A task for an executor with a sizeable init argument.
+  tuple<M2S_RUN_TASK> runTask =
+    pack<M2S_RUN_TASK>("201010180000-0-0001", 42, "framework", "user",
+                       ExecutorInfo("hdfs://namenode/executor.tgz",
+                                    string(1024, 'x'), params),
+                       "task-42", string(256, 'y'), Params(params),
+                       PID("master@127.0.0.1:5050"),
+                       RunTaskExtras(MESOS_CAPABILITIES,
+                                     Resources(1, 1024 * Megabyte)));
+
+  // An offer for a hundred slaves.
+  vector<SlaveOffer> offers;
+  map<SlaveID, PID> pids;
+  for (int i = 0; i < 100; i++) {
+    SlaveID sid = "201010180000-0-" + lexical_cast<string>(i);
+    SlaveOffer offer(sid, "host" + lexical_cast<string>(i), params);
+    offer.cpus = 1;
+    offer.mem = 1024 * Megabyte;
+    offers.push_back(offer);
+    pids[sid] = PID("slave@127.0.0.1:" + lexical_cast<string>(5051 + i));
+  }
+
+  tuple<M2F_SLOT_OFFER> slotOffer =
+    pack<M2F_SLOT_OFFER>("201010180000-0-7", offers, pids);
+
+  // All ways give back the same tuples.
+  tuple<M2S_RUN_TASK> runTaskCopy = roundTripInPlace(runTask);
+  EXPECT_EQ(runTask.get<1>(), runTaskCopy.get<1>());
+  EXPECT_EQ(runTask.get<4>().initArg, runTaskCopy.get<4>().initArg);
+  EXPECT_EQ(runTask.get<6>(), runTaskCopy.get<6>());
+  EXPECT_EQ(runTask.get<8>(), runTaskCopy.get<8>());
+  EXPECT_EQ(string(runTask), string(roundTripThroughStrings(runTask)));
+  EXPECT_EQ(string(runTask), string(roundTripInPlace(runTask, true)));
+
+  tuple<M2F_SLOT_OFFER> slotOfferCopy = roundTripInPlace(slotOffer);
+  ASSERT_EQ(100, slotOfferCopy.get<1>().size());
+  EXPECT_EQ("host99", slotOfferCopy.get<1>()[99].host);
+  EXPECT_TRUE(pids == slotOfferCopy.get<2>());
+  EXPECT_EQ(string(slotOffer), string(roundTripThroughStrings(slotOffer)));
+  EXPECT_EQ(string(slotOffer), string(roundTripInPlace(slotOffer, true)));
+
+  benchmark("M2S_RUN_TASK", runTask, iterations);
+  benchmark("M2F_SLOT_OFFER", slotOffer, iterations / 10);
+}
+
+
+TEST(SerializationBenchmark, SmallMessagesInBothEncodings)
+{
+  const int iterations = 100000;
+
+  tuple<SH2M_HEARTBEAT> heartbeat =
+    pack<SH2M_HEARTBEAT>("201010180000-0-42");
+
+  tuple<S2M_STATUS_UPDATE> statusUpdate =
+    pack<S2M_STATUS_UPDATE>("201010180000-0-42", "201010180000-0-0001", 42,
+                            TASK_RUNNING, "");
+
+  tuple<M2S_KILL_TASK> killTask =
+    pack<M2S_KILL_TASK>("201010180000-0-0001", 42);
+
+  // The compact encoding gives back the same tuples, in fewer bytes.
+  EXPECT_EQ(string(heartbeat), string(roundTripInPlace(heartbeat, true)));
+  EXPECT_EQ(string(statusUpdate),
+            string(roundTripInPlace(statusUpdate, true)));
+  EXPECT_EQ(string(killTask), string(roundTripInPlace(killTask, true)));
+
+  EXPECT_GT(TupleBody<S2M_STATUS_UPDATE>(statusUpdate).length(),
+            TupleBody<S2M_STATUS_UPDATE>(statusUpdate, true).length());
+
+  compareEncodings("SH2M_HEARTBEAT", heartbeat, iterations);
+  compareEncodings("S2M_STATUS_UPDATE", statusUpdate, iterations);
+  compareEncodings("M2S_KILL_TASK", killTask, iterations);
+}
@@ -0,0 +1,122 @@
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include <timers.hpp>
+
+using std::vector;
+
+
+TEST(TimerWheelTest, ExpiresTimersOnlyOnceTheirTimeHasCome)
+{
+  TimerWheel<int> timers(0.001, 100);
+
+  timers.add(100.0005, 1);
+  timers.add(100.2, 2);
+  timers.add(130, 3);      // A level up
+  timers.add(100000, 4);   // Beyond all levels
+
+  double next;
+  ASSERT_TRUE(timers.next(&next));
+  EXPECT_EQ(100.0005, next);
+
+  vector<int> expired;
+  timers.expire(100.0004, &expired);
+  EXPECT_EQ(0, expired.size());
+
+  timers.expire(100.0005, &expired);
+  ASSERT_EQ(1, expired.size());
+  EXPECT_EQ(1, expired[0]);
+
+  ASSERT_TRUE(timers.next(&next));
+  EXPECT_EQ(100.2, next);
+
+  timers.expire(129.999, &expired);
+  ASSERT_EQ(2, expired.size());
+  EXPECT_EQ(2, expired[1]);
+
+  ASSERT_TRUE(timers.next(&next));
+  EXPECT_EQ(130, next);
+
+  timers.expire(99999, &expired);
+  ASSERT_EQ(3, expired.size());
+  EXPECT_EQ(3, expired[2]);
+
+  timers.expire(100000, &expired);
+  ASSERT_EQ(4, expired.size());
+  EXPECT_EQ(4, expired[3]);
+
+  EXPECT_TRUE(timers.empty());
+  EXPECT_FALSE(timers.next(&next));
+}
+
+
+TEST(TimerWheelTest, CanceledTimersDontExpire)
+{
+  TimerWheel<int> timers(0.001, 0);
+
+  TimerWheel<int>::Handle first = timers.add(1, 1);
+  TimerWheel<int>::Handle second = timers.add(2, 2);
+  EXPECT_EQ(2, timers.size());
+
+  EXPECT_TRUE(timers.cancel(first));
+  EXPECT_FALSE(timers.cancel(first));
+  EXPECT_EQ(1, timers.size());
+
+  double next;
+  ASSERT_TRUE(timers.next(&next));
+  EXPECT_EQ(2, next);
+
+  // A timer that reuses the canceled one's memory keeps its handle
+  // from canceling the new timer.
+  timers.add(3, 3);
+  EXPECT_FALSE(timers.cancel(first));
+
+  vector<int> expired;
+  timers.expire(10, &expired);
+  ASSERT_EQ(2, expired.size());
+  EXPECT_EQ(2, expired[0]);
+  EXPECT_EQ(3, expired[1]);
+
+  EXPECT_FALSE(timers.cancel(second));
+}
+
+
+TEST(TimerWheelTest, BoundIsNoLaterThanEarliestTimer)
+{
+  TimerWheel<int> timers(0.001, 0);
+
+  double bound;
+  EXPECT_FALSE(timers.bound(&bound));
+
+  TimerWheel<int>::Handle first = timers.add(1, 1);
+  timers.add(3, 3);
+  ASSERT_TRUE(timers.bound(&bound));
+  EXPECT_EQ(1, bound);
+
+  // Canceling the earliest timer leaves the bound where it was ...
+  timers.cancel(first);
+  ASSERT_TRUE(timers.bound(&bound));
+  EXPECT_EQ(1, bound);
+
+  // ... a later timer doesn't change it ...
+  timers.add(5, 5);
+  ASSERT_TRUE(timers.bound(&bound));
+  EXPECT_EQ(1, bound);
+
+  // ... and an earlier one becomes the earliest timer.
+  timers.add(0.5, 0);
+  ASSERT_TRUE(timers.bound(&bound));
+  EXPECT_EQ(0.5, bound);
+
+  double next;
+  ASSERT_TRUE(timers.next(&next));
+  EXPECT_EQ(0.5, next);
+
+  vector<int> expired;
+  timers.expire(0.5, &expired);
+  ASSERT_TRUE(timers.next(&next));
+  EXPECT_EQ(3, next);
+  ASSERT_TRUE(timers.bound(&bound));
+  EXPECT_EQ(3, bound);
+}
@@ -18,6 +18,22 @@ Started: {{format_time(start_time)}}<br />
 PID: {{master.pid}}<br />
 Slaves: {{master.slaves.size()}}<br />
 Frameworks: {{master.frameworks.size()}}<br />
+Allocation passes: {{master.allocation_passes}}
+(last examined {{master.last_pass_slaves}} slaves,
+{{master.slaves_examined}} in total)<br />
+Pools in use: {{master.task_pool_in_use}}/{{master.task_pool_capacity}} tasks,
+{{master.offer_pool_in_use}}/{{master.offer_pool_capacity}} offers,
+{{master.offer_set_node_pool_in_use}}/{{master.offer_set_node_pool_capacity}}
+offer set nodes<br />
+Broadcast messages saved: {{master.broadcast_messages_saved}}<br />
+Status update batches: {{master.status_update_batches}}
+({{master.batched_status_updates}} updates)<br />
+Cached executor infos used: {{master.cached_executor_infos}}
+({{master.executor_info_bytes_saved}} bytes saved)<br />
+Connections made: {{master.connections_made}}
+({{master.connections_reused}} more avoided by reusing idle ones)<br />
+Messages written: {{master.messages_written}}
+({{master.bytes_written}} bytes in {{master.socket_writes}} writes)<br />
 </p>
 
 <p>
@@ -76,6 +92,7 @@ Idle: {{idle_cpus}} CPUs, {{format_mem(idle_mem)}} MEM<br />
   <th>Running Tasks</th>
   <th>CPUs</th>
   <th>MEM</th>
+  <th>Other</th>
   <th>Max Share</th>
   <th>Connected</th>
   </tr>
@@ -96,6 +113,7 @@ Idle: {{idle_cpus}} CPUs, {{format_mem(idle_mem)}} MEM<br />
     <td>{{framework.tasks.size()}}</td>
     <td>{{framework.cpus}}</td>
     <td>{{format_mem(framework.mem)}}</td>
+    <td>{{framework.other_resources}}</td>
     <td>{{'%.2f' % max_share}}</td>
     <td>{{format_time(framework.connect_time)}}</td>
     </tr>
@@ -115,6 +133,7 @@ Idle: {{idle_cpus}} CPUs, {{format_mem(idle_mem)}} MEM<br />
   <th>Hostname</th>
   <th>CPUs</th>
   <th>MEM</th>
+  <th>Other</th>
   <th>Connected</th>
   </tr>
   %for s in master.slaves:
@@ -123,6 +142,7 @@ Idle: {{idle_cpus}} CPUs, {{format_mem(idle_mem)}} MEM<br />
     <td><a href="http://{{s.web_ui_url}}/">{{s.web_ui_url}}</a></td>
     <td>{{s.cpus}}</td>
     <td>{{format_mem(s.mem)}}</td>
+    <td>{{s.other_resources}}</td>
     <td>{{format_time(s.connect_time)}}</td>
     </tr>
   %end
@@ -17,12 +17,18 @@ Started: {{format_time(start_time)}}<br />
 PID: {{slave.pid}}<br />
 CPUs: {{slave.cpus}}<br />
 MEM: {{format_mem(slave.mem)}}<br />
+%if slave.other_resources != '':
+  Other resources: {{slave.other_resources}}<br />
+%end
 %if slave.id == -1:
   Slave ID: unassigned (not yet registered)<br />
 %else:
   Slave ID: {{slave.id}}<br />
 %end
 Frameworks: {{slave.frameworks.size()}}<br />
+Unacknowledged status updates: {{slave.unacknowledged_messages}}<br />
+Status update batches: {{slave.status_update_batches}}
+({{slave.batched_status_updates}} updates)<br />
 </p>
 
 <p>
@@ -43,6 +49,7 @@ Log:
   <th>Running Tasks</th>
   <th>CPUs</th>
   <th>MEM</th>
+  <th>Other</th>
   <th>Executor Status</th>
   <th>Logs</th>
   </tr>
@@ -55,6 +62,7 @@ Log:
     <td>{{framework.tasks.size()}}</td>
     <td>{{framework.cpus}}</td>
     <td>{{format_mem(framework.mem)}}</td>
+    <td>{{framework.other_resources}}</td>
     <td>{{framework.executor_status}}</td>
     <td><a href="/framework-logs/{{framework.id}}/stdout">[stdout]</a>
         <a href="/framework-logs/{{framework.id}}/stderr">[stderr]</a></td>
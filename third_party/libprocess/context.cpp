@@ -0,0 +1,136 @@
+#include <assert.h>
+#include <stdint.h>
+
+#include "context.hpp"
+#include "fatal.hpp"
+
+
+#ifdef CONTEXT_X86_64
+
+/*
+ * Saves the callee-saved registers, the x87 control word and the
+ * MXCSR on the current stack, stores the stack pointer in *from and
+ * restores the same from the stack pointer 'to' (the System V ABI
+ * leaves everything else up to the caller to save).
+ */
+extern "C" void context_switch(void **from, void *to);
+
+/*
+ * Where a new context first "returns" to: calls the entry function
+ * (in r12) with its argument (in r13).
+ */
+extern "C" void context_start();
+
+asm(".text\n"
+    ".globl context_switch\n"
+    ".type context_switch, @function\n"
+    "context_switch:\n"
+    "  pushq %rbp\n"
+    "  pushq %rbx\n"
+    "  pushq %r12\n"
+    "  pushq %r13\n"
+    "  pushq %r14\n"
+    "  pushq %r15\n"
+    "  subq $16, %rsp\n"
+    "  fnstcw (%rsp)\n"
+    "  stmxcsr 8(%rsp)\n"
+    "  movq %rsp, (%rdi)\n"
+    "  movq %rsi, %rsp\n"
+    "  fldcw (%rsp)\n"
+    "  ldmxcsr 8(%rsp)\n"
+    "  addq $16, %rsp\n"
+    "  popq %r15\n"
+    "  popq %r14\n"
+    "  popq %r13\n"
+    "  popq %r12\n"
+    "  popq %rbx\n"
+    "  popq %rbp\n"
+    "  ret\n"
+    ".size context_switch, .-context_switch\n"
+    ".globl context_start\n"
+    ".type context_start, @function\n"
+    "context_start:\n"
+    "  movq %r13, %rdi\n"
+    "  callq *%r12\n"
+    "  ud2\n"
+    ".size context_start, .-context_start\n");
+
+
+void context_init(context *ctx, void *stack, size_t size,
+                  void (*entry)(void *), void *arg)
+{
+  ctx->stack = stack;
+  ctx->size = size;
+
+  /*
+   * Lay out the stack as context_switch would have left it, so that
+   * switching to it "returns" to context_start with the stack aligned
+   * the way a call expects it.
+   */
+  uint64_t *sp = (uint64_t *) (((uintptr_t) stack + size) & ~(uintptr_t) 15);
+  *--sp = 0;                            /* Padding. */
+  *--sp = 0;                            /* Padding. */
+  *--sp = (uint64_t) context_start;     /* Return address. */
+  *--sp = 0;                            /* rbp */
+  *--sp = 0;                            /* rbx */
+  *--sp = (uint64_t) entry;             /* r12 */
+  *--sp = (uint64_t) arg;               /* r13 */
+  *--sp = 0;                            /* r14 */
+  *--sp = 0;                            /* r15 */
+  *--sp = 0x1f80;                       /* MXCSR (the default). */
+  *--sp = 0x037f;                       /* x87 control word (the default). */
+
+  ctx->sp = sp;
+}
+
+
+void context_swap(context *from, context *to)
+{
+  context_switch(&from->sp, to->sp);
+}
+
+#else
+
+/* Arguments to makecontext are ints, so pointers get passed in halves. */
+static void context_start(int entry0, int entry1, int arg0, int arg1)
+{
+  void (*entry)(void *) = (void (*)(void *))
+    (((uint64_t) (unsigned int) entry1 << 32) | (unsigned int) entry0);
+  void *arg = (void *)
+    (((uint64_t) (unsigned int) arg1 << 32) | (unsigned int) arg0);
+
+  entry(arg);
+
+  assert(false);
+}
+
+
+void context_init(context *ctx, void *stack, size_t size,
+                  void (*entry)(void *), void *arg)
+{
+  ctx->stack = stack;
+  ctx->size = size;
+
+  if (getcontext(&ctx->uctx) < 0)
+    fatalerror("getcontext failed (context_init)");
+
+  ctx->uctx.uc_stack.ss_sp = stack;
+  ctx->uctx.uc_stack.ss_size = size;
+  ctx->uctx.uc_link = 0;
+
+  uint64_t e = (uintptr_t) entry;
+  uint64_t a = (uintptr_t) arg;
+
+  makecontext(&ctx->uctx, (void (*)()) context_start, 4,
+              (int) (unsigned int) e, (int) (unsigned int) (e >> 32),
+              (int) (unsigned int) a, (int) (unsigned int) (a >> 32));
+}
+
+
+void context_swap(context *from, context *to)
+{
+  if (swapcontext(&from->uctx, &to->uctx) < 0)
+    fatalerror("swapcontext failed");
+}
+
+#endif /* CONTEXT_X86_64 */
@@ -0,0 +1,48 @@
+/*
+ * Switching between process contexts.
+ *
+ * On x86-64 (ELF) a context is just a saved stack pointer: switching
+ * pushes the callee-saved registers (and the floating point control
+ * words) on the current stack, saves it and pops the same from the
+ * other. Unlike swapcontext this doesn't save and restore the signal
+ * mask, which costs a system call on every switch. Elsewhere (or if
+ * LIBPROCESS_UCONTEXT is defined) contexts are ucontexts.
+ */
+
+#ifndef CONTEXT_HPP
+#define CONTEXT_HPP
+
+#include <stddef.h>
+
+#if defined(__x86_64__) && defined(__ELF__) && !defined(LIBPROCESS_UCONTEXT)
+#define CONTEXT_X86_64
+#else
+#include <ucontext.h>
+#endif
+
+
+struct context
+{
+  void *stack;         /* Stack the context was initialized with. */
+  size_t size;
+#ifdef CONTEXT_X86_64
+  void *sp;            /* Saved stack pointer (when not running). */
+#else
+  ucontext_t uctx;
+#endif
+};
+
+
+/*
+ * Initializes a context that calls entry(arg) on the specified stack
+ * the first time it gets switched to. The entry function must never
+ * return (it should switch away for the last time instead).
+ */
+void context_init(context *ctx, void *stack, size_t size,
+                  void (*entry)(void *), void *arg);
+
+
+/* Saves the current context in 'from' and switches to 'to'. */
+void context_swap(context *from, context *to);
+
+#endif /* CONTEXT_HPP */
@@ -5,12 +5,12 @@
 #include <limits.h>
 #include <netdb.h>
 #include <pthread.h>
+#include <sched.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ucontext.h>
 #include <unistd.h>
 
 #include <arpa/inet.h>
@@ -24,6 +24,9 @@
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+
+#include <tr1/unordered_map>
 
 #include <boost/tuple/tuple.hpp>
 
@@ -36,14 +39,16 @@
 #include <queue>
 #include <set>
 #include <sstream>
-#include <stack>
 #include <stdexcept>
+#include <vector>
 
 #include "config.hpp"
+#include "context.hpp"
 #include "fatal.hpp"
 #include "foreach.hpp"
 #include "gate.hpp"
 #include "process.hpp"
+#include "timers.hpp"
 #include "synchronized.hpp"
 
 using boost::tuple;
@@ -55,20 +60,56 @@ using std::find;
 using std::list;
 using std::map;
 using std::max;
+using std::min;
 using std::ostream;
 using std::queue;
 using std::set;
-using std::stack;
+using std::vector;
 
 using std::tr1::function;
+using std::tr1::unordered_map;
 
 
 #define Byte (1)
 #define Kilobyte (1024*Byte)
 #define Megabyte (1024*Kilobyte)
 #define Gigabyte (1024*Megabyte)
+
+/* Default size of a process stack (set LIBPROCESS_STACK_SIZE to change). */
 #define PROCESS_STACK_SIZE (64*Kilobyte)
 
+/* Most bytes of stacks kept around for reuse after their processes exit. */
+#define STACK_CACHE_SIZE (8*Megabyte)
+
+/* Bytes at the top of a cached stack left committed (the rest is given back). */
+#define STACK_RESIDENT_SIZE (16*Kilobyte)
+
+/* Seconds an unused outbound connection is kept open for reuse. */
+#define CONNECTION_IDLE_TIMEOUT 30
+
+/* Seconds between ticks of the timer wheel holding process timeouts. */
+#define TIMEOUT_RESOLUTION 0.001
+
+/* Most outbound connections (to nodes without a link) kept open. */
+#define MAX_POOLED_CONNECTIONS 64
+
+/*
+ * Bytes buffered for an inbound connection at first, and at most once
+ * reads keep filling the buffer (bigger messages grow it further).
+ */
+#define READ_BUFFER_INITIAL_SIZE (4*Kilobyte)
+#define READ_BUFFER_SIZE (64*Kilobyte)
+
+/* Longest message body accepted (a longer one closes the connection). */
+#define MAX_MESSAGE_LENGTH (64*Megabyte)
+
+/* Slices of the process table that get locked separately. */
+#define PROCESS_TABLE_SHARDS 64
+
+/* Most messages (and, roughly, bytes) gathered into one socket write. */
+#define WRITE_BATCH_MSGS 64
+#define WRITE_BATCH_BYTES (64*Kilobyte)
+
 
 #define malloc(bytes)                                               \
   ({ void *tmp;                                                     \
@@ -83,6 +124,32 @@ using std::tr1::function;
    })
 
 
+/*
+ * Messages get allocated with room after their data for the link used
+ * by a process's message queue (which is never sent or recorded).
+ */
+static inline size_t msg_link_offset(size_t length)
+{
+  size_t offset = sizeof(struct msg) + length;
+  return (offset + sizeof(struct msg *) - 1) & ~(sizeof(struct msg *) - 1);
+}
+
+
+static inline struct msg * msg_new(size_t length)
+{
+  struct msg *msg = (struct msg *)
+    malloc(msg_link_offset(length) + sizeof(struct msg *));
+  msg->len = length;
+  return msg;
+}
+
+
+static inline struct msg * volatile * msg_link(struct msg *msg)
+{
+  return (struct msg * volatile *) ((char *) msg + msg_link_offset(msg->len));
+}
+
+
 struct node
 {
   uint32_t ip;
@@ -120,14 +187,6 @@ struct timeout
 };
 
 
-bool operator == (const timeout &left, const timeout &right)
-{
-  return left.tstamp == right.tstamp &&
-    left.pid == right.pid &&
-    left.generation == right.generation;
-}
-
-
 class ProcessReference
 {
 public:
@@ -194,11 +253,17 @@ public:
   void send(struct msg *msg);
 
   struct msg * next(int s);
-  struct msg * next_or_close(int s);
+  struct msg * next_or_idle(int s);
   struct msg * next_or_sleep(int s);
 
   void closed(int s);
 
+  /* Closes pooled connections that have been idle for too long. */
+  void expire();
+
+  int64_t connects();
+  int64_t reuses();
+
   void exited(const node &n);
   void exited(Process *process);
 
@@ -216,6 +281,17 @@ private:
   /* Map from socket to outgoing messages. */
   map<int, queue<struct msg *> > outgoing;
 
+  /*
+   * Sockets in temps with nothing to send, and since when. These get
+   * reused by the next send to the same node instead of connecting
+   * again, until they have been idle for CONNECTION_IDLE_TIMEOUT.
+   */
+  map<int, ev_tstamp> idles;
+
+  /* Connections made by send, and sends that reused an idle one. */
+  int64_t connected;
+  int64_t reused;
+
   /* Protects instance variables. */
   synchronizable(this);
 };
@@ -234,7 +310,7 @@ public:
 
   void deliver(struct msg *msg, Process *sender = NULL);
 
-  void spawn(Process *process);
+  void spawn(Process *process, size_t stack);
   void link(Process *process, const PID &to);
   void receive(Process *process, double secs);
   void pause(Process *process, double secs);
@@ -244,6 +320,7 @@ public:
 
   void enqueue(Process *process);
   Process * dequeue();
+  bool queued(Process *process);
 
   void timedout(const PID &pid, int generation);
   void awaited(const PID &pid, int generation);
@@ -255,19 +332,119 @@ public:
 
 private:
   timeout create_timeout(Process *process, double secs);
-  void start_timeout(const timeout &timeout);
-  void cancel_timeout(const timeout &timeout);
+  TimerWheel<timeout>::Handle start_timeout(const timeout &timeout);
+  void cancel_timeout(const TimerWheel<timeout>::Handle &handle);
+
+  /*
+   * A slice of the table of all local spawned and running processes
+   * (by pipe), along with the processes and gates for non-libprocess
+   * threads waiting on them. Each shard has its own lock, so looking
+   * up processes in different shards doesn't contend.
+   */
+  struct Shard
+  {
+    Shard() { pthread_mutex_init(&m, NULL); }
+
+    unordered_map<uint32_t, Process *> processes;
+
+    /* Waiting processes. */
+    map<Process *, set<Process *> > waiters;
+
+    /* Map of gates for waiting threads. */
+    map<Process *, Gate *> gates;
+
+    /* Lock/mutex protecting the above. */
+    pthread_mutex_t m;
+    void lock() { pthread_mutex_lock(&m); }
+    void unlock() { pthread_mutex_unlock(&m); }
+  };
+
+  Shard * shard(uint32_t pipe) { return &shards[pipe % PROCESS_TABLE_SHARDS]; }
+
+  Shard shards[PROCESS_TABLE_SHARDS];
+
+  /* Serializes recording and replaying messages. */
+  synchronizable(records);
+};
+
+
+/*
+ * A thread that runs processes. Each processing thread has its own
+ * queue of runnable processes: the thread itself takes processes from
+ * the front, and other processing threads that have run out of work
+ * steal them from the back. A process is only ever in one queue at a
+ * time, and whichever thread dequeues it has to acquire the process's
+ * lock before switching to it, which the thread the process last ran
+ * on only releases once it has switched away from the process. So a
+ * process never runs on two threads at once, although it may run on a
+ * different thread each time it gets scheduled.
+ */
+class ProcessingThread
+{
+public:
+  ProcessingThread()
+    : id(0), process(NULL), legacy(false), legacy_thunk(NULL),
+      recyclable(NULL), recyclable_size(0)
+  {
+    synchronizer(runq) = SYNCHRONIZED_INITIALIZER;
+  }
 
-  /* Map of all local spawned and running processes. */
-  map<uint32_t, Process *> processes;
-  synchronizable(processes);
+  /* Adds a process to the back of the run queue. */
+  void push(Process *process)
+  {
+    synchronized(runq) {
+      runq.push_back(process);
+    }
+  }
 
-  /* Waiting processes (protected by synchronizable(processes)). */
-  map<Process *, set<Process *> > waiters;
+  /* Takes a process from the front (or back if stealing) of the run queue. */
+  Process * pop(bool steal = false)
+  {
+    Process *process = NULL;
+    synchronized(runq) {
+      if (!runq.empty()) {
+        if (!steal) {
+          process = runq.front();
+          runq.pop_front();
+        } else {
+          process = runq.back();
+          runq.pop_back();
+        }
+      }
+    }
+    return process;
+  }
+
+  bool queued(Process *process)
+  {
+    bool found = false;
+    synchronized(runq) {
+      found = find(runq.begin(), runq.end(), process) != runq.end();
+    }
+    return found;
+  }
 
-  /* Map of gates for waiting threads. */
-  map<Process *, Gate *> gates;
+  int id;
 
+  pthread_t thread;
+
+  /* Scheduling context, switched back to when a process blocks or exits. */
+  context running;
+
+  /* Current process. */
+  Process *process;
+
+  /* Flag indicating if performing safe call into legacy. */
+  bool legacy;
+
+  /* Thunk to safely call into legacy. */
+  const function<void (void)> *legacy_thunk;
+
+  /* Last exited process's stack to be recycled. */
+  void *recyclable;
+  size_t recyclable_size;
+
+private:
   /* Queue of runnable processes (implemented as deque). */
   deque<Process *> runq;
   synchronizable(runq);
@@ -367,6 +544,9 @@ static ev_async async_watcher;
 /* Timeouts watcher for process timeouts. */
 static ev_timer timeouts_watcher;
 
+/* Watcher for closing idle outbound connections. */
+static ev_timer connections_watcher;
+
 /* Server watcher for accepting connections. */
 static ev_io server_watcher;
 
@@ -375,14 +555,13 @@ static queue<ev_io *> *io_watchersq = new queue<ev_io *>();
 static synchronizable(io_watchersq) = SYNCHRONIZED_INITIALIZER;
 
 /**
- * We store the timeouts in a map of lists indexed by the time stamp
- * of the timeout so that we can have two timeouts that have the same
- * time stamp. Note however, that we should never have two identical
- * timeouts because a process should only ever have one outstanding
- * timeout at a time. Also, we exploit that the map is SORTED!
+ * We store the timeouts in a timer wheel so that starting and
+ * canceling one (which happens for most every receive with a timeout)
+ * takes constant time. Note that a process should only ever have one
+ * outstanding timeout at a time.
  */
-static map<ev_tstamp, list<timeout> > *timeouts =
-  new map<ev_tstamp, list<timeout> >();
+static TimerWheel<timeout> *timeouts =
+  new TimerWheel<timeout>(TIMEOUT_RESOLUTION, ev_time());
 static synchronizable(timeouts) = SYNCHRONIZED_INITIALIZER;
 
 /* Flag to indicate whether or to update the timer on async interrupt. */
@@ -391,36 +570,32 @@ static bool update_timer = false;
 /* I/O thread. */
 static pthread_t io_thread;
 
-/* Processing thread. */
-static pthread_t proc_thread;
-
-/* Scheduling context for processing thread. */
-static ucontext_t proc_uctx_schedule;
-
-/* Running context for processing thread. */
-static ucontext_t proc_uctx_running;
+/* Processing threads (set LIBPROCESS_THREADS to run more than one). */
+static ProcessingThread *processing_threads = NULL;
+static int num_processing_threads = 0;
 
-/* Current process of processing thread. */
-//static __thread Process *proc_process = NULL;
-static Process *proc_process = NULL;
+/* Number of processing threads waiting at the scheduler gate. */
+static int idle_processing_threads = 0;
 
-/* Flag indicating if performing safe call into legacy. */
-// static __thread bool legacy = false;
-static bool legacy = false;
+/* Used to spread processes enqueued by other threads across queues. */
+static unsigned int next_processing_thread = 0;
 
-/* Thunk to safely call into legacy. */
-// static __thread function<void (void)> *legacy_thunk;
-static const function<void (void)> *legacy_thunk;
+/* Key for the processing thread of the calling thread (if any). */
+static pthread_key_t processing_thread_key;
 
 /* Scheduler gate. */
 static Gate *gate = new Gate();
 
-/* Stack of recycled stacks. */
-static stack<void *> *stacks = new stack<void *>();
+/* Size of a stack when none is asked for. */
+static size_t default_stack_size = PROCESS_STACK_SIZE;
+
+/* Stacks kept for reuse, by size. */
+static map<size_t, vector<void *> > *stacks = new map<size_t, vector<void *> >();
 static synchronizable(stacks) = SYNCHRONIZED_INITIALIZER;
 
-/* Last exited process's stack to be recycled (global variable hack!). */
-static void *recyclable = NULL;
+/* Bytes of stacks in use by processes and kept for reuse. */
+static int64_t live_stack_bytes = 0;
+static int64_t cached_stack_bytes = 0;
 
 /* Record? */
 static bool recording = false;
@@ -450,6 +625,20 @@ static synchronizable(filterer) = SYNCHRONIZED_INITIALIZER_RECURSIVE;
 
 
 
+/*
+ * Returns the processing thread of the calling thread, or NULL if the
+ * calling thread isn't a processing thread. N.B. This deliberately
+ * isn't a __thread variable: a process may block on one thread and
+ * get resumed on another, and the compiler is free to reuse the
+ * address of a thread-local variable computed before a context
+ * switch after it.
+ */
+static ProcessingThread * current_processing_thread()
+{
+  return (ProcessingThread *) pthread_getspecific(processing_thread_key);
+}
+
+
 int set_nbio(int fd)
 {
   int flags;
@@ -480,8 +669,9 @@ void handle_async(struct ev_loop *loop, ev_async *w, int revents)
   }
 
   synchronized(timeouts) {
+    ev_tstamp next_tstamp;
     if (update_timer) {
-      if (!timeouts->empty()) {
+      if (timeouts->next(&next_tstamp)) {
 	// Determine the current time.
 	ev_tstamp current_tstamp;
 	if (clk != NULL) {
@@ -491,7 +681,7 @@ void handle_async(struct ev_loop *loop, ev_async *w, int revents)
 	  current_tstamp = ev_time();
 	}
 
-	timeouts_watcher.repeat = timeouts->begin()->first - current_tstamp;
+	timeouts_watcher.repeat = next_tstamp - current_tstamp;
 
 	// Check when the timer event should fire.
         if (timeouts_watcher.repeat <= 0) {
@@ -516,7 +706,7 @@ void handle_async(struct ev_loop *loop, ev_async *w, int revents)
 
 void handle_timeout(struct ev_loop *loop, ev_timer *w, int revents)
 {
-  list<timeout> timedout;
+  vector<timeout> timedout;
 
   synchronized(timeouts) {
     ev_tstamp current_tstamp;
@@ -528,36 +718,31 @@ void handle_timeout(struct ev_loop *loop, ev_timer *w, int revents)
       current_tstamp = ev_time();
     }
 
-    foreachpair (ev_tstamp tstamp, const list<timeout> &timedouts, *timeouts) {
-      if (tstamp > current_tstamp)
-        break;
+    // TODO(benh): Ensure deterministic order for testing?
+    timeouts->expire(current_tstamp, &timedout);
 
-      foreach (const timeout &timeout, timedouts) {
-        if (clk != NULL) {
-          // Update current time of process (if it's still
-          // valid). Note that current time may be greater than the
-          // timeout if a local message was received (and
-          // happens-before kicks in), hence we use max.
-          if (ProcessReference process = process_manager->use(timeout.pid)) {
-            clk->setCurrent(process, max(clk->getCurrent(process),
-                                         timeout.tstamp));
-          }
+    if (clk != NULL) {
+      foreach (const timeout &timeout, timedout) {
+        // Update current time of process (if it's still
+        // valid). Note that current time may be greater than the
+        // timeout if a local message was received (and
+        // happens-before kicks in), hence we use max.
+        if (ProcessReference process = process_manager->use(timeout.pid)) {
+          clk->setCurrent(process, max(clk->getCurrent(process),
+                                       timeout.tstamp));
         }
-        // TODO(benh): Ensure deterministic order for testing?
-        timedout.push_back(timeout);
       }
     }
 
-    // Now erase the range of time stamps that timed out.
-    timeouts->erase(timeouts->begin(), timeouts->upper_bound(current_tstamp));
-
     // Okay, so the time stamp for the next timeout should not have fired.
-    assert(timeouts->empty() || (timeouts->begin()->first > current_tstamp));
+    ev_tstamp next_tstamp;
+    bool pending = timeouts->next(&next_tstamp);
+    assert(!pending || next_tstamp > current_tstamp);
 
     // Update the timer as necessary.
     // TODO(benh): Make this code look like the code in handle_async.
-    if (!timeouts->empty() && clk == NULL) {
-      timeouts_watcher.repeat = timeouts->begin()->first - current_tstamp;
+    if (pending && clk == NULL) {
+      timeouts_watcher.repeat = next_tstamp - current_tstamp;
       assert(timeouts_watcher.repeat > 0);
       ev_timer_again(loop, &timeouts_watcher);
     } else {
@@ -573,6 +758,12 @@ void handle_timeout(struct ev_loop *loop, ev_timer *w, int revents)
 }
 
 
+void handle_connections(struct ev_loop *loop, ev_timer *w, int revents)
+{
+  link_manager->expire();
+}
+
+
 void handle_await(struct ev_loop *loop, ev_io *w, int revents)
 {
   tuple<PID, int> *t = reinterpret_cast<tuple<PID, int> *>(w->data);
@@ -584,76 +775,76 @@ void handle_await(struct ev_loop *loop, ev_io *w, int revents)
 
 
 /* Socket reading .... */
-void read_data(struct ev_loop *loop, ev_io *w, int revents);
-void read_msg(struct ev_loop *loop, ev_io *w, int revents);
+void read_msgs(struct ev_loop *loop, ev_io *w, int revents);
 
 struct read_ctx {
-  int len;
-  struct msg *msg;
+  char *buf;                         /* Received but not yet delivered. */
+  size_t size;                       /* Capacity of buf. */
+  size_t len;                        /* Bytes in buf. */
 };
 
 
-void read_data(struct ev_loop *loop, ev_io *w, int revents)
+struct read_ctx * read_ctx_new()
 {
-  int c = w->fd;
+  /* The buffer gets allocated on the first read. */
+  struct read_ctx *ctx = (struct read_ctx *) malloc(sizeof(struct read_ctx));
+  ctx->buf = NULL;
+  ctx->size = 0;
+  ctx->len = 0;
+  return ctx;
+}
 
-  struct read_ctx *ctx = (struct read_ctx *) w->data;
 
-  /* Read the data starting from the last read. */
-  int len = recv(c,
-		 (char *) ctx->msg + sizeof(struct msg) + ctx->len,
-		 ctx->msg->len - ctx->len,
-		 0);
+/*
+ * Resizes the buffer of a read context, returning false (and leaving
+ * the buffer as it was) if there isn't enough memory.
+ */
+bool read_ctx_resize(struct read_ctx *ctx, size_t size)
+{
+  /* Call realloc itself rather than the macro that aborts on failure. */
+  char *buf = (char *) (realloc)(ctx->buf, size);
+  if (buf == NULL)
+    return false;
+  ctx->buf = buf;
+  ctx->size = size;
+  return true;
+}
 
-  if (len > 0) {
-    ctx->len += len;
-  } else if (len < 0 && errno == EWOULDBLOCK) {
-    return;
-  } else if (len == 0 || (len < 0 &&
-			  (errno == ECONNRESET ||
-			   errno == EBADF ||
-			   errno == EHOSTUNREACH))) {
-    /* Socket has closed. */
-    link_manager->closed(c);
 
-    /* Stop receiving ... */
-    ev_io_stop (loop, w);
-    close(c);
-    free(ctx->msg);
-    free(ctx);
-    free(w);
-    return;
-  } else {
-    fatalerror("unhandled socket error: please report (read_data)");
-  }
+void read_ctx_delete(struct read_ctx *ctx)
+{
+  free(ctx->buf);
+  free(ctx);
+}
 
-  if (ctx->len == ctx->msg->len) {
-    /* Deliver message. */
-    process_manager->deliver(ctx->msg);
 
-    /* Reinitialize read context. */
-    ctx->len = 0;
-    ctx->msg = (struct msg *) malloc(sizeof(struct msg));
+void read_msgs_close(struct ev_loop *loop, ev_io *w)
+{
+  int c = w->fd;
 
-    /* Continue receiving ... */
-    ev_io_stop (loop, w);
-    ev_io_init (w, read_msg, c, EV_READ);
-    ev_io_start (loop, w);
-  }
+  link_manager->closed(c);
+
+  /* Stop receiving ... */
+  ev_io_stop (loop, w);
+  close(c);
+  read_ctx_delete((struct read_ctx *) w->data);
+  free(w);
 }
 
 
-void read_msg(struct ev_loop *loop, ev_io *w, int revents)
+void read_msgs(struct ev_loop *loop, ev_io *w, int revents)
 {
   int c = w->fd;
 
   struct read_ctx *ctx = (struct read_ctx *) w->data;
 
-  /* Read the message starting from the last read. */
-  int len = recv(c,
-		 (char *) ctx->msg + ctx->len,
-		 sizeof (struct msg) - ctx->len,
-		 0);
+  if (ctx->buf == NULL && !read_ctx_resize(ctx, READ_BUFFER_INITIAL_SIZE)) {
+    read_msgs_close(loop, w);
+    return;
+  }
+
+  /* Read as much as is available (and fits) after what we have. */
+  int len = recv(c, ctx->buf + ctx->len, ctx->size - ctx->len, 0);
 
   if (len > 0) {
     ctx->len += len;
@@ -664,129 +855,123 @@ void read_msg(struct ev_loop *loop, ev_io *w, int revents)
 			   errno == EBADF ||
 			   errno == EHOSTUNREACH))) {
     /* Socket has closed. */
-    link_manager->closed(c);
-
-    /* Stop receiving ... */
-    ev_io_stop (loop, w);
-    close(c);
-    free(ctx->msg);
-    free(ctx);
-    free(w);
+    read_msgs_close(loop, w);
     return;
   } else {
-    fatalerror("unhandled socket error: please report (read_msg)");
+    fatalerror("unhandled socket error: please report (read_msgs)");
   }
 
-  if (ctx->len == sizeof(struct msg)) {
-    /* Check and see if we need to receive data. */
-    if (ctx->msg->len > 0) {
-      /* Allocate enough space for data. */
-      ctx->msg = (struct msg *)
-	realloc (ctx->msg, sizeof(struct msg) + ctx->msg->len);
+  /* A busy connection gets a bigger buffer (up to the normal size). */
+  bool filled = ctx->len == ctx->size;
 
-      /* TODO(benh): Optimize ... try doing a read first! */
-      ctx->len = 0;
+  /* Deliver every complete message in the buffer. */
+  size_t offset = 0;
 
-      /* Start receiving data ... */
-      ev_io_stop (loop, w);
-      ev_io_init (w, read_data, c, EV_READ);
-      ev_io_start (loop, w);
-    } else {
-      /* Deliver message. */
-      process_manager->deliver(ctx->msg);
+  while (ctx->len - offset >= sizeof(struct msg)) {
+    struct msg *header = (struct msg *) (ctx->buf + offset);
 
-      /* Reinitialize read context. */
-      ctx->len = 0;
-      ctx->msg = (struct msg *) malloc(sizeof(struct msg));
+    if (header->len > MAX_MESSAGE_LENGTH) {
+      cerr << "libprocess: closing connection that sent a message of "
+           << header->len << " bytes" << endl;
+      read_msgs_close(loop, w);
+      return;
+    }
+
+    size_t size = sizeof(struct msg) + header->len;
+
+    if (ctx->len - offset < size)
+      break;
 
-      /* Continue receiving ... */
-      ev_io_stop (loop, w);
-      ev_io_init (w, read_msg, c, EV_READ);
-      ev_io_start (loop, w);
+    struct msg *msg = msg_new(header->len);
+    memcpy(msg, header, size);
+    process_manager->deliver(msg);
+
+    offset += size;
+  }
+
+  /* Move what is left of the next message to the front. */
+  ctx->len -= offset;
+  memmove(ctx->buf, ctx->buf + offset, ctx->len);
+
+  if (ctx->len >= sizeof(struct msg)) {
+    /* Make room for all of a message bigger than the buffer. */
+    size_t size = sizeof(struct msg) + ((struct msg *) ctx->buf)->len;
+    if (size > ctx->size && !read_ctx_resize(ctx, size)) {
+      cerr << "libprocess: closing connection for lack of memory to read a "
+           << size << " byte message" << endl;
+      read_msgs_close(loop, w);
+      return;
     }
+  } else if (ctx->size > READ_BUFFER_SIZE) {
+    /* Go back to a normal sized buffer after a big message. */
+    read_ctx_resize(ctx, READ_BUFFER_SIZE);
   }
+
+  if (filled && ctx->size < READ_BUFFER_SIZE)
+    read_ctx_resize(ctx, min(2 * ctx->size, (size_t) READ_BUFFER_SIZE));
 }
 
 
 /* Socket writing .... */
-void write_data(struct ev_loop *loop, ev_io *w, int revents);
-void write_msg(struct ev_loop *loop, ev_io *w, int revents);
+void write_msgs(struct ev_loop *loop, ev_io *w, int revents);
 
 struct write_ctx {
-  int len;
-  struct msg *msg;
+  size_t len;                        /* Bytes of msgs[0] already written. */
+  int count;                         /* Messages in msgs. */
+  struct msg *msgs[WRITE_BATCH_MSGS];
   bool close;
 };
 
 
-void write_data(struct ev_loop *loop, ev_io *w, int revents)
+/* Messages and bytes written to sockets, and the writes it took. */
+static int64_t written_msgs = 0;
+static int64_t written_bytes = 0;
+static int64_t write_calls = 0;
+
+
+void write_msgs(struct ev_loop *loop, ev_io *w, int revents)
 {
   int c = w->fd;
 
   struct write_ctx *ctx = (struct write_ctx *) w->data;
 
-  int len = send(c,
-		 (char *) ctx->msg + sizeof(struct msg) + ctx->len,
-		 ctx->msg->len - ctx->len,
-		 MSG_NOSIGNAL);
-
-  if (len > 0) {
-    ctx->len += len;
-  } else if (len < 0 && errno == EWOULDBLOCK) {
-    return;
-  } else if (len == 0 || (len < 0 &&
-			  (errno == ECONNRESET ||
-			   errno == EBADF ||
-			   errno == EHOSTUNREACH ||
-			   errno == EPIPE))) {
-    /* Socket has closed. */
-    link_manager->closed(c);
+  /*
+   * Gather whatever else is queued for this socket so that it all goes
+   * out in one write (as long as it is below the batch limits).
+   */
+  size_t bytes = 0;
+  for (int i = 0; i < ctx->count; i++)
+    bytes += sizeof(struct msg) + ctx->msgs[i]->len;
+  bytes -= ctx->len;
 
-    /* Stop receiving ... */
-    ev_io_stop (loop, w);
-    close(c);
-    free(ctx->msg);
-    free(ctx);
-    free(w);
-    return;
-  } else {
-    fatalerror("unhandled socket error: please report (write_data)");
+  while (ctx->count < WRITE_BATCH_MSGS && bytes < WRITE_BATCH_BYTES) {
+    struct msg *msg = link_manager->next(c);
+    if (msg == NULL)
+      break;
+    ctx->msgs[ctx->count++] = msg;
+    bytes += sizeof(struct msg) + msg->len;
   }
 
-  if (ctx->len == ctx->msg->len) {
-    ev_io_stop (loop, w);
-    free(ctx->msg);
-
-    if (ctx->close)
-      ctx->msg = link_manager->next_or_close(c);
-    else
-      ctx->msg = link_manager->next_or_sleep(c);
-
-    if (ctx->msg != NULL) {
-      ctx->len = 0;
-      ev_io_init(w, write_msg, c, EV_WRITE);
-      ev_io_start(loop, w);
-    } else {
-      free(ctx);
-      free(w);
-    }
+  /* Each message is a header immediately followed by its data. */
+  struct iovec iov[WRITE_BATCH_MSGS];
+  for (int i = 0; i < ctx->count; i++) {
+    iov[i].iov_base = (char *) ctx->msgs[i];
+    iov[i].iov_len = sizeof(struct msg) + ctx->msgs[i]->len;
   }
-}
-
 
-void write_msg(struct ev_loop *loop, ev_io *w, int revents)
-{
-  int c = w->fd;
+  iov[0].iov_base = (char *) iov[0].iov_base + ctx->len;
+  iov[0].iov_len -= ctx->len;
 
-  struct write_ctx *ctx = (struct write_ctx *) w->data;
+  struct msghdr mh;
+  memset(&mh, 0, sizeof(mh));
+  mh.msg_iov = iov;
+  mh.msg_iovlen = ctx->count;
 
-  int len = send(c,
-		 (char *) ctx->msg + ctx->len,
-		 sizeof (struct msg) - ctx->len,
-		 MSG_NOSIGNAL);
+  ssize_t len = sendmsg(c, &mh, MSG_NOSIGNAL);
 
   if (len > 0) {
-    ctx->len += len;
+    __sync_fetch_and_add(&written_bytes, len);
+    __sync_fetch_and_add(&write_calls, 1);
   } else if (len < 0 && errno == EWOULDBLOCK) {
     return;
   } else if (len == 0 || (len < 0 &&
@@ -800,42 +985,48 @@ void write_msg(struct ev_loop *loop, ev_io *w, int revents)
     /* Stop receiving ... */
     ev_io_stop (loop, w);
     close(c);
-    free(ctx->msg);
+    for (int i = 0; i < ctx->count; i++)
+      free(ctx->msgs[i]);
     free(ctx);
     free(w);
     return;
   } else {
-    fatalerror("unhandled socket error: please report (write_msg)");
+    fatalerror("unhandled socket error: please report (write_msgs)");
   }
 
-  if (ctx->len == sizeof(struct msg)) {
-    /* Check and see if we need to write data. */
-    if (ctx->msg->len > 0) {
-      
-      /* TODO(benh): Optimize ... try doing a write first! */
-      ctx->len = 0;
+  /* Free the messages that have been written completely. */
+  ctx->len += len;
 
-      /* Start writing data ... */
-      ev_io_stop(loop, w);
-      ev_io_init(w, write_data, c, EV_WRITE);
-      ev_io_start(loop, w);
-    } else {
-      ev_io_stop(loop, w);
-      free(ctx->msg);
+  int done = 0;
+  while (done < ctx->count &&
+	 ctx->len >= sizeof(struct msg) + ctx->msgs[done]->len) {
+    ctx->len -= sizeof(struct msg) + ctx->msgs[done]->len;
+    free(ctx->msgs[done]);
+    done++;
+  }
 
-      if (ctx->close)
-	ctx->msg = link_manager->next_or_close(c);
-      else
-	ctx->msg = link_manager->next_or_sleep(c);
+  __sync_fetch_and_add(&written_msgs, done);
 
-      if (ctx->msg != NULL) {
-	ctx->len = 0;
-	ev_io_init(w, write_msg, c, EV_WRITE);
-	ev_io_start(loop, w);
-      } else {
-	free(ctx);
-	free(w);
-      }
+  ctx->count -= done;
+  memmove(ctx->msgs, ctx->msgs + done, ctx->count * sizeof(struct msg *));
+
+  /* Keep writing once the socket is ready again, or get the next message. */
+  if (ctx->count == 0) {
+    struct msg *msg;
+
+    if (ctx->close)
+      msg = link_manager->next_or_idle(c);
+    else
+      msg = link_manager->next_or_sleep(c);
+
+    if (msg != NULL) {
+      ctx->len = 0;
+      ctx->count = 1;
+      ctx->msgs[0] = msg;
+    } else {
+      ev_io_stop(loop, w);
+      free(ctx);
+      free(w);
     }
   }
 }
@@ -855,7 +1046,7 @@ void write_connect(struct ev_loop *loop, ev_io *w, int revents)
 
   if (getsockopt(s, SOL_SOCKET, SO_ERROR, &opt, &optlen) < 0) {
     link_manager->closed(s);
-    free(ctx->msg);
+    free(ctx->msgs[0]);
     free(ctx);
     free(w);
     return;
@@ -863,7 +1054,7 @@ void write_connect(struct ev_loop *loop, ev_io *w, int revents)
 
   if (opt != 0) {
     link_manager->closed(s);
-    free(ctx->msg);
+    free(ctx->msgs[0]);
     free(ctx);
     free(w);
     return;
@@ -871,7 +1062,7 @@ void write_connect(struct ev_loop *loop, ev_io *w, int revents)
 
   /* TODO(benh): Optimize ... try doing a write first. */
 
-  ev_io_init(w, write_msg, s, EV_WRITE);
+  ev_io_init(w, write_msgs, s, EV_WRITE);
   ev_io_start(loop, w);
 }
 
@@ -900,16 +1091,10 @@ void link_connect(struct ev_loop *loop, ev_io *w, int revents)
   }
 
   /* Reuse/Initialize the watcher. */
-  w->data = malloc(sizeof(struct read_ctx));
-
-  /* Initialize read context. */
-  struct read_ctx *ctx = (struct read_ctx *) w->data;
-
-  ctx->len = 0;
-  ctx->msg = (struct msg *) malloc(sizeof(struct msg));
+  w->data = read_ctx_new();
 
   /* Initialize watcher for reading. */
-  ev_io_init(w, read_msg, s, EV_READ);
+  ev_io_init(w, read_msgs, s, EV_READ);
 
   ev_io_start(loop, w);
 }
@@ -946,16 +1131,11 @@ void do_accept(struct ev_loop *loop, ev_io *w, int revents)
   /* Allocate the watcher. */
   ev_io *io_watcher = (ev_io *) malloc (sizeof (ev_io));
 
-  io_watcher->data = malloc(sizeof(struct read_ctx));
-
   /* Initialize the read context */
-  struct read_ctx *ctx = (struct read_ctx *) io_watcher->data;
-
-  ctx->len = 0;
-  ctx->msg = (struct msg *) malloc(sizeof(struct msg));
+  io_watcher->data = read_ctx_new();
 
   /* Initialize watcher for reading. */
-  ev_io_init(io_watcher, read_msg, c, EV_READ);
+  ev_io_init(io_watcher, read_msgs, c, EV_READ);
 
   ev_io_start(loop, io_watcher);
 }
@@ -969,47 +1149,102 @@ void * serve(void *arg)
 }
 
 
-void trampoline(int stack0, int stack1, int process0, int process1)
+/*
+ * Returns a stack of the specified size (a multiple of the page size),
+ * reusing a cached one if possible. New stacks only reserve address
+ * space; pages get committed as the process touches them. The lowest
+ * page is a guard page.
+ */
+void * allocate_stack(size_t size)
 {
-  /* Unpackage the arguments. */
-#ifdef __x86_64__
-  assert (sizeof(unsigned long) == sizeof(Process *));
-  void *stack = (void *)
-    (((unsigned long) stack1 << 32) + (unsigned int) stack0);
-  Process *process = (Process *)
-    (((unsigned long) process1 << 32) + (unsigned int) process0);
-#else
-  assert (sizeof(unsigned int) == sizeof(Process *));
-  void *stack = (void *) (unsigned int) stack0;
-  Process *process = (Process *) (unsigned int) process0;
-#endif /* __x86_64__ */
+  void *stack = NULL;
+
+  synchronized(stacks) {
+    map<size_t, vector<void *> >::iterator it = stacks->find(size);
+    if (it != stacks->end() && !it->second.empty()) {
+      stack = it->second.back();
+      it->second.pop_back();
+      cached_stack_bytes -= size;
+    }
+    live_stack_bytes += size;
+  }
+
+  if (stack == NULL) {
+    const int protection = (PROT_READ | PROT_WRITE);
+    const int flags = (MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE);
+
+    stack = mmap(NULL, size, protection, flags, -1, 0);
+
+    if (stack == MAP_FAILED)
+      fatalerror("mmap failed (allocate_stack)");
+
+    /* Disallow all memory access to the last page. */
+    if (mprotect(stack, getpagesize(), PROT_NONE) != 0)
+      fatalerror("mprotect failed (allocate_stack)");
+  }
+
+  return stack;
+}
+
+
+/*
+ * Caches a stack that is no longer used, or unmaps it if the cache is
+ * full. All but the top of a cached stack is given back to the system
+ * so that a process that went deep doesn't keep memory committed.
+ */
+void release_stack(void *stack, size_t size)
+{
+  bool cached = false;
+
+  synchronized(stacks) {
+    live_stack_bytes -= size;
+    if (cached_stack_bytes + size <= STACK_CACHE_SIZE) {
+      (*stacks)[size].push_back(stack);
+      cached_stack_bytes += size;
+      cached = true;
+    }
+  }
+
+  if (!cached) {
+    if (munmap(stack, size) != 0)
+      fatalerror("munmap failed (release_stack)");
+  } else if (size > STACK_RESIDENT_SIZE) {
+    /* Anything touched below the top gets zero pages when reused. */
+    madvise(stack, size - STACK_RESIDENT_SIZE, MADV_DONTNEED);
+  }
+}
+
+
+void trampoline(void *arg)
+{
+  Process *process = (Process *) arg;
+
+  /* The process may be gone once it has run, so get its stack now. */
+  void *stack = process->ctx.stack;
+  size_t size = process->ctx.size;
 
   /* Run the process. */
   process_manager->run(process);
 
-  /* Prepare to recycle this stack (global variable hack!). */
-  assert(recyclable == NULL);
-  recyclable = stack;
+  /* Prepare to recycle this stack (on whichever thread we exited on). */
+  ProcessingThread *thread = current_processing_thread();
+  assert(thread->recyclable == NULL);
+  thread->recyclable = stack;
+  thread->recyclable_size = size;
 
-  proc_process = NULL;
-  setcontext(&proc_uctx_schedule);
+  /* Switch back to the scheduler for good. */
+  thread->process = NULL;
+  context exited;
+  context_swap(&exited, &thread->running);
 }
 
 
 void * schedule(void *arg)
 {
-  // Context for the entry into the schedule routine, used when a
-  // process exits, so that other processes can get scheduled!
-  if (getcontext(&proc_uctx_schedule) < 0)
-    fatalerror("getcontext failed (schedule)");
+  ProcessingThread *thread = (ProcessingThread *) arg;
 
-  // Recycle the stack from an exited process.
-  if (recyclable != NULL) {
-    synchronized(stacks) {
-      stacks->push(recyclable);
-    }
-    recyclable = NULL;
-  }
+  if (pthread_setspecific(processing_thread_key, thread) != 0)
+    fatalerror("failed to initialize (pthread_setspecific)");
 
   do {
     if (replaying)
@@ -1028,10 +1263,11 @@ void * schedule(void *arg)
         // drastically advanced current time then it may try send
         // messages to another process that, due to the happens-before
         // relationship, will inherit it's drastically advanced
-        // current time. If the processing thread gets to this point
-        // (i.e., the point where no other processes are runnable)
-        // with the manual clock means that all of the processes have
-        // been run which could be run up to the current time. The
+        // current time. If the last busy processing thread gets to
+        // this point (i.e., the point where no other processes are
+        // runnable) with the manual clock means that all of the
+        // processes have been run which could be run up to the
+        // current time. The
         // only way another process could become runnable is if (1) it
         // receives a message from another node, (2) a file descriptor
         // it is awaiting has become ready, or (3) if it has a
@@ -1047,12 +1283,14 @@ void * schedule(void *arg)
         // move the current time to the next timeout value, and tell
         // the timer to update itself.
 
+        int idle = __sync_add_and_fetch(&idle_processing_threads, 1);
+
         synchronized(timeouts) {
-          if (clk != NULL) {
-            if (!timeouts->empty()) {
+          ev_tstamp tstamp;
+          if (clk != NULL && idle == num_processing_threads) {
+            if (timeouts->next(&tstamp)) {
               // Adjust the current time to the next timeout, provided
               // it is not past the elapsed time.
-              ev_tstamp tstamp = timeouts->begin()->first;
               if (tstamp <= clk->getElapsed())
                 clk->setCurrent(tstamp);
               
@@ -1071,6 +1309,7 @@ void * schedule(void *arg)
 
 	/* Wait at gate if idle. */
 	gate->arrive(old);
+        __sync_sub_and_fetch(&idle_processing_threads, 1);
 	continue;
       } else {
 	gate->leave();
@@ -1085,15 +1324,25 @@ void * schedule(void *arg)
 	     process->state == Process::TIMEDOUT);
 
       /* Continue process. */
-      assert(proc_process == NULL);
-      proc_process = process;
-      swapcontext(&proc_uctx_running, &process->uctx);
-      while (legacy) {
-	(*legacy_thunk)();
-	swapcontext(&proc_uctx_running, &process->uctx);
+      assert(thread->process == NULL);
+      thread->process = process;
+      context_swap(&thread->running, &process->ctx);
+      while (thread->legacy) {
+	(*thread->legacy_thunk)();
+	context_swap(&thread->running, &process->ctx);
+      }
+
+      /*
+       * If the process exited it has already been unlocked (and may
+       * have been deleted), so just recycle its stack.
+       */
+      if (thread->process == NULL) {
+        release_stack(thread->recyclable, thread->recyclable_size);
+        thread->recyclable = NULL;
+        continue;
       }
-      assert(proc_process != NULL);
-      proc_process = NULL;
+
+      thread->process = NULL;
     }
     process->unlock();
   } while (true);
@@ -1179,10 +1428,6 @@ void initialize()
   process_manager = new ProcessManager();
   link_manager = new LinkManager();
 
-  /* Setup processing thread. */
-  if (pthread_create (&proc_thread, NULL, schedule, NULL) != 0)
-    fatalerror("failed to initialize (pthread_create)");
-
   ip = 0;
   port = 0;
 
@@ -1209,10 +1454,47 @@ void initialize()
     port = result;
   }
 
+  /* Check environment for number of processing threads. */
+  num_processing_threads = 1;
+  value = getenv("LIBPROCESS_THREADS");
+  if (value != NULL) {
+    num_processing_threads = atoi(value);
+    if (num_processing_threads < 1) {
+      fatal("LIBPROCESS_THREADS=%s is not a valid number of threads", value);
+    }
+  }
+
+  /* Check environment for default stack size. */
+  value = getenv("LIBPROCESS_STACK_SIZE");
+  if (value != NULL) {
+    long size = atol(value);
+    if (size < 2 * getpagesize()) {
+      fatal("LIBPROCESS_STACK_SIZE=%s is not a valid stack size", value);
+    }
+    default_stack_size = size;
+  }
+
   /* Check environment for replay. */
   value = getenv("LIBPROCESS_REPLAY");
   replaying = value != NULL;
 
+  /* Recording and replaying rely on processes running one at a time. */
+  if (recording || replaying)
+    num_processing_threads = 1;
+
+  /* Setup processing threads. */
+  if (pthread_key_create(&processing_thread_key, NULL) != 0)
+    fatalerror("failed to initialize (pthread_key_create)");
+
+  processing_threads = new ProcessingThread[num_processing_threads];
+
+  for (int i = 0; i < num_processing_threads; i++) {
+    ProcessingThread *thread = &processing_threads[i];
+    thread->id = i;
+    if (pthread_create(&thread->thread, NULL, schedule, thread) != 0)
+      fatalerror("failed to initialize (pthread_create)");
+  }
+
   /* Setup for recording or replaying. */
   if (recording && !replaying) {
     /* Setup record. */
@@ -1321,6 +1603,10 @@ void initialize()
   ev_timer_init(&timeouts_watcher, handle_timeout, 0., 2100000.0);
   ev_timer_again(loop, &timeouts_watcher);
 
+  ev_timer_init(&connections_watcher, handle_connections,
+                CONNECTION_IDLE_TIMEOUT, CONNECTION_IDLE_TIMEOUT / 2.0);
+  ev_timer_start(loop, &connections_watcher);
+
   ev_io_init(&server_watcher, do_accept, s, EV_READ);
   ev_io_start(loop, &server_watcher);
 
@@ -1346,7 +1632,7 @@ void initialize()
 }
 
 
-LinkManager::LinkManager()
+LinkManager::LinkManager() : connected(0), reused(0)
 {
   synchronizer(this) = SYNCHRONIZED_INITIALIZER_RECURSIVE;
 }
@@ -1408,15 +1694,9 @@ void LinkManager::link(Process *process, const PID &to)
         ev_io_init(io_watcher, link_connect, s, EV_WRITE);
       } else {
         /* Initialize watcher for reading. */
-        io_watcher->data = malloc(sizeof(struct read_ctx));
-
-        /* Initialize read context. */
-        struct read_ctx *ctx = (struct read_ctx *) io_watcher->data;
+        io_watcher->data = read_ctx_new();
 
-        ctx->len = 0;
-        ctx->msg = (struct msg *) malloc(sizeof(struct msg));
-
-        ev_io_init(io_watcher, read_msg, s, EV_READ);
+        ev_io_init(io_watcher, read_msgs, s, EV_READ);
       }
 
       /* Enqueue the watcher. */
@@ -1440,14 +1720,34 @@ void LinkManager::send(struct msg *msg)
   node n = { msg->to.ip, msg->to.port };
 
   synchronized(this) {
-    // Check if there is already a link.
+    // Check if an idle pooled connection is still usable (the other
+    // end might have closed it in the mean time).
     map<node, int>::iterator it;
+    if (persists.find(n) == persists.end() &&
+        (it = temps.find(n)) != temps.end() &&
+        idles.count(it->second) > 0) {
+      char c;
+      int s = it->second;
+      int len = recv(s, &c, 1, MSG_PEEK);
+      if (len == 0 || (len < 0 && errno != EWOULDBLOCK)) {
+        idles.erase(s);
+        temps.erase(n);
+        sockets.erase(s);
+        close(s);
+      }
+    }
+
+    // Check if there is already a link (or a pooled connection).
     if ((it = persists.find(n)) != persists.end() ||
         (it = temps.find(n)) != temps.end()) {
       int s = it->second;
       if (outgoing.count(s) == 0) {
-        assert(persists.count(n) != 0);
-        assert(temps.count(n) == 0 || temps[n] != s);
+        assert(persists.count(n) != 0 || idles.count(s) != 0);
+
+        if (idles.count(s) > 0) {
+          idles.erase(s);
+          reused++;
+        }
 
         /* Initialize the outgoing queue. */
         outgoing[s];
@@ -1461,10 +1761,11 @@ void LinkManager::send(struct msg *msg)
         struct write_ctx *ctx = (struct write_ctx *) io_watcher->data;
 
         ctx->len = 0;
-        ctx->msg = msg;
-        ctx->close = false;
+        ctx->count = 1;
+        ctx->msgs[0] = msg;
+        ctx->close = persists.count(n) == 0;
 
-        ev_io_init(io_watcher, write_msg, s, EV_WRITE);
+        ev_io_init(io_watcher, write_msgs, s, EV_WRITE);
 
         /* Enqueue the watcher. */
         synchronized(io_watchersq) {
@@ -1479,6 +1780,21 @@ void LinkManager::send(struct msg *msg)
     } else {
       int s;
 
+      /* Make room in the pool by closing the longest idle connection. */
+      if (temps.size() >= MAX_POOLED_CONNECTIONS && !idles.empty()) {
+        map<int, ev_tstamp>::iterator oldest = idles.begin();
+        for (map<int, ev_tstamp>::iterator it = idles.begin();
+             it != idles.end(); ++it) {
+          if (it->second < oldest->second)
+            oldest = it;
+        }
+        int idle = oldest->first;
+        idles.erase(oldest);
+        temps.erase(sockets[idle]);
+        sockets.erase(idle);
+        close(idle);
+      }
+
       /* Create socket for communicating with remote process. */
       if ((s = socket(AF_INET, SOCK_STREAM, IPPROTO_IP)) < 0)
         fatalerror("failed to send (socket)");
@@ -1493,6 +1809,8 @@ void LinkManager::send(struct msg *msg)
       /* Record node. */
       temps[n] = s;
 
+      connected++;
+
       /* Initialize the outgoing queue. */
       outgoing[s];
 
@@ -1505,7 +1823,8 @@ void LinkManager::send(struct msg *msg)
       struct write_ctx *ctx = (struct write_ctx *) io_watcher->data;
 
       ctx->len = 0;
-      ctx->msg = msg;
+      ctx->count = 1;
+      ctx->msgs[0] = msg;
       ctx->close = true;
 
       struct sockaddr_in addr;
@@ -1524,7 +1843,7 @@ void LinkManager::send(struct msg *msg)
         ev_io_init(io_watcher, write_connect, s, EV_WRITE);
       } else {
         /* Initialize watcher for writing. */
-        ev_io_init(io_watcher, write_msg, s, EV_WRITE);
+        ev_io_init(io_watcher, write_msgs, s, EV_WRITE);
       }
 
       /* Enqueue the watcher. */
@@ -1544,10 +1863,14 @@ struct msg * LinkManager::next(int s)
   struct msg *msg = NULL;
 
   synchronized(this) {
-    assert(outgoing.find(s) != outgoing.end());
-    if (!outgoing[s].empty()) {
-      msg = outgoing[s].front();
-      outgoing[s].pop();
+    /*
+     * The socket might have been closed (e.g., by its reader) since the
+     * writer last looked, in which case there is nothing more to send.
+     */
+    map<int, queue<struct msg *> >::iterator it = outgoing.find(s);
+    if (it != outgoing.end() && !it->second.empty()) {
+      msg = it->second.front();
+      it->second.pop();
     }
   }
 
@@ -1555,18 +1878,21 @@ struct msg * LinkManager::next(int s)
 }
 
 
-struct msg * LinkManager::next_or_close(int s)
+struct msg * LinkManager::next_or_idle(int s)
 {
   struct msg *msg;
 
   synchronized(this) {
+    /* See next: the socket might have been closed in the meantime. */
+    if (sockets.count(s) == 0)
+      return NULL;
+
     if ((msg = next(s)) == NULL) {
       assert(outgoing[s].empty());
       outgoing.erase(s);
       assert(temps.count(sockets[s]) > 0);
-      temps.erase(sockets[s]);
-      sockets.erase(s);
-      close(s);
+      /* Keep the connection around for the next send to the node. */
+      idles[s] = ev_time();
     }
   }
 
@@ -1579,6 +1905,10 @@ struct msg * LinkManager::next_or_sleep(int s)
   struct msg *msg;
 
   synchronized(this) {
+    /* See next: the socket might have been closed in the meantime. */
+    if (sockets.count(s) == 0)
+      return NULL;
+
     if ((msg = next(s)) == NULL) {
       assert(outgoing[s].empty());
       outgoing.erase(s);
@@ -1607,12 +1937,54 @@ void LinkManager::closed(int s)
 
       sockets.erase(s);
       outgoing.erase(s);
+      idles.erase(s);
       close(s);
     }
   }
 }
 
 
+void LinkManager::expire()
+{
+  synchronized(this) {
+    ev_tstamp now = ev_time();
+    map<int, ev_tstamp>::iterator it = idles.begin();
+    while (it != idles.end()) {
+      int s = it->first;
+      if (now - it->second >= CONNECTION_IDLE_TIMEOUT) {
+        assert(outgoing.count(s) == 0);
+        temps.erase(sockets[s]);
+        sockets.erase(s);
+        close(s);
+        idles.erase(it++);
+      } else {
+        ++it;
+      }
+    }
+  }
+}
+
+
+int64_t LinkManager::connects()
+{
+  int64_t result;
+  synchronized(this) {
+    result = connected;
+  }
+  return result;
+}
+
+
+int64_t LinkManager::reuses()
+{
+  int64_t result;
+  synchronized(this) {
+    result = reused;
+  }
+  return result;
+}
+
+
 void LinkManager::exited(const node &n)
 {
   // TODO(benh): It would be cleaner if this routine could call back
@@ -1628,7 +2000,7 @@ void LinkManager::exited(const node &n)
         /* Deliver PROCESS_EXIT messages (if we aren't replaying). */
         if (!replaying) {
           foreach (Process *process, processes) {
-            struct msg *msg = (struct msg *) malloc(sizeof(struct msg));
+            struct msg *msg = msg_new(0);
             msg->from.pipe = pid.pipe;
             msg->from.ip = pid.ip;
             msg->from.port = pid.port;
@@ -1667,7 +2039,7 @@ void LinkManager::exited(Process *process)
       if (!replaying) {
         foreach (Process *p, processes) {
           assert(process != p);
-          struct msg *msg = (struct msg *) malloc(sizeof(struct msg));
+          struct msg *msg = msg_new(0);
           msg->from.pipe = pid.pipe;
           msg->from.ip = pid.ip;
           msg->from.port = pid.port;
@@ -1688,8 +2060,7 @@ void LinkManager::exited(Process *process)
 
 ProcessManager::ProcessManager()
 {
-  synchronizer(processes) = SYNCHRONIZED_INITIALIZER;
-  synchronizer(runq) = SYNCHRONIZED_INITIALIZER;
+  synchronizer(records) = SYNCHRONIZED_INITIALIZER;
 }
 
 
@@ -1699,13 +2070,20 @@ ProcessManager::~ProcessManager() {}
 ProcessReference ProcessManager::use(const PID &pid)
 {
   if (pid.ip == ip && pid.port == port) {
-    synchronized(processes) {
-      if (processes.count(pid.pipe) > 0) {
+    Shard *shard = this->shard(pid.pipe);
+    shard->lock();
+    {
+      unordered_map<uint32_t, Process *>::iterator it =
+        shard->processes.find(pid.pipe);
+      if (it != shard->processes.end()) {
         // Note that the ProcessReference constructor MUST get called
-        // while holding the lock on processes.
-        return ProcessReference(processes[pid.pipe]);
+        // while holding the lock on the process's shard.
+        ProcessReference reference(it->second);
+        shard->unlock();
+        return reference;
       }
     }
+    shard->unlock();
   }
 
   return ProcessReference(NULL);
@@ -1715,7 +2093,7 @@ ProcessReference ProcessManager::use(const PID &pid)
 void ProcessManager::record(struct msg *msg)
 {
   assert(recording && !replaying);
-  synchronized(processes) {
+  synchronized(records) {
     record_msgs.write((char *) msg, sizeof(struct msg) + msg->len);
     if (record_msgs.fail())
       fatalerror("failed to write to messages record");
@@ -1726,27 +2104,24 @@ void ProcessManager::record(struct msg *msg)
 void ProcessManager::replay()
 {
   assert(!recording && replaying);
-  synchronized(processes) {
+  synchronized(records) {
     if (!record_msgs.eof()) {
-      struct msg *msg = (struct msg *) malloc(sizeof(struct msg));
+      struct msg header;
 
       /* Read a message worth of data. */
-      record_msgs.read((char *) msg, sizeof(struct msg));
+      record_msgs.read((char *) &header, sizeof(struct msg));
 
-      if (record_msgs.eof()) {
-        free(msg);
+      if (record_msgs.eof())
         return;
-      }
 
       if (record_msgs.fail())
         fatalerror("failed to read from messages record");
 
+      struct msg *msg = msg_new(header.len);
+      memcpy(msg, &header, sizeof(struct msg));
+
       /* Read the body of the message if necessary. */
       if (msg->len != 0) {
-        struct msg *temp = msg;
-        msg = (struct msg *) malloc(sizeof(struct msg) + msg->len);
-        memcpy(msg, temp, sizeof(struct msg));
-        free(temp);
         record_msgs.read((char *) msg + sizeof(struct msg), msg->len);
         if (record_msgs.fail())
           fatalerror("failed to read from messages record");
@@ -1757,13 +2132,19 @@ void ProcessManager::replay()
     }
 
     /* Deliver any messages to available processes. */
-    foreachpair (uint32_t pipe, Process *process, processes) {
-      queue<struct msg *> &msgs = (*replay_msgs)[pipe];
-      while (!msgs.empty()) {
-        struct msg *msg = msgs.front();
-        msgs.pop();
-        process->enqueue(msg);
+    for (int i = 0; i < PROCESS_TABLE_SHARDS; i++) {
+      shards[i].lock();
+      {
+        foreachpair (uint32_t pipe, Process *process, shards[i].processes) {
+          queue<struct msg *> &msgs = (*replay_msgs)[pipe];
+          while (!msgs.empty()) {
+            struct msg *msg = msgs.front();
+            msgs.pop();
+            process->enqueue(msg);
+          }
+        }
       }
+      shards[i].unlock();
     }
   }
 }
@@ -1797,66 +2178,32 @@ void ProcessManager::deliver(struct msg *msg, Process *sender)
 }
 
 
-void ProcessManager::spawn(Process *process)
+void ProcessManager::spawn(Process *process, size_t size)
 {
   assert(process != NULL);
 
   process->state = Process::INIT;
 
   /* Record process. */
-  synchronized(processes) {
-    processes[process->pid.pipe] = process;
-  }
-
-  void *stack = NULL;
-
-  // Reuse a stack if any are available.
-  synchronized(stacks) {
-    if (!stacks->empty()) {
-      stack = stacks->top();
-      stacks->pop();
-    }
+  Shard *shard = this->shard(process->pid.pipe);
+  shard->lock();
+  {
+    shard->processes[process->pid.pipe] = process;
   }
+  shard->unlock();
 
-  if (stack == NULL) {
-    const int protection = (PROT_READ | PROT_WRITE);
-    const int flags = (MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT);
-
-    stack = mmap(NULL, PROCESS_STACK_SIZE, protection, flags, -1, 0);
-
-    if (stack == MAP_FAILED)
-      fatalerror("mmap failed (spawn)");
-
-    /* Disallow all memory access to the last page. */
-    if (mprotect(stack, getpagesize(), PROT_NONE) != 0)
-      fatalerror("mprotect failed (spawn)");
-  }
+  /* Round the stack up to whole pages (plus the guard page). */
+  if (size == 0)
+    size = default_stack_size;
+  size_t page = getpagesize();
+  size = ((size + page - 1) / page) * page;
+  if (size < 2 * page)
+    size = 2 * page;
 
-  /* Set up the ucontext. */
-  if (getcontext(&process->uctx) < 0)
-    fatalerror("getcontext failed (spawn)");
-    
-  process->uctx.uc_stack.ss_sp = stack;
-  process->uctx.uc_stack.ss_size = PROCESS_STACK_SIZE;
-  process->uctx.uc_link = 0;
-
-  /* Package the arguments. */
-#ifdef __x86_64__
-  assert(sizeof(unsigned long) == sizeof(Process *));
-  int stack0 = (unsigned int) (unsigned long) stack;
-  int stack1 = (unsigned long) stack >> 32;
-  int process0 = (unsigned int) (unsigned long) process;
-  int process1 = (unsigned long) process >> 32;
-#else
-  assert(sizeof(unsigned int) == sizeof(Process *));
-  int stack0 = (unsigned int) stack;
-  int stack1 = 0;
-  int process0 = (unsigned int) process;
-  int process1 = 0;
-#endif /* __x86_64__ */
+  void *stack = allocate_stack(size);
 
-  makecontext(&process->uctx, (void (*)()) trampoline,
-              4, stack0, stack1, process0, process1);
+  /* Set up the context. */
+  context_init(&process->ctx, stack, size, trampoline, process);
 
   /* Add process to the run queue. */
   enqueue(process);
@@ -1878,7 +2225,7 @@ void ProcessManager::link(Process *process, const PID &to)
     } else {
       // Since the pid isn't valid it's process must have already died
       // (or hasn't been spawned yet) so send a process exit message.
-      struct msg *msg = (struct msg *) malloc(sizeof(struct msg));
+      struct msg *msg = msg_new(0);
       msg->from.pipe = to.pipe;
       msg->from.ip = to.ip;
       msg->from.port = to.port;
@@ -1898,18 +2245,19 @@ void ProcessManager::receive(Process *process, double secs)
   assert(process != NULL);
   process->lock();
   {
-    /* Ensure nothing enqueued since check in Process::receive. */
-    if (process->msgs.empty()) {
+    /*
+     * Ensure nothing enqueued since check in Process::receive (the
+     * state has to be set first, see Process::enqueue).
+     */
+    process->state = Process::RECEIVING;
+    if (process->empty()) {
       if (secs > 0) {
-        /* Create timeout. */
-        const timeout &timeout = create_timeout(process, secs);
-
-        /* Start the timeout. */
-        start_timeout(timeout);
+        /* Create/Start the timeout. */
+        TimerWheel<timeout>::Handle timeout =
+          start_timeout(create_timeout(process, secs));
 
         /* Context switch. */
-        process->state = Process::RECEIVING;
-        swapcontext(&process->uctx, &proc_uctx_running);
+        context_swap(&process->ctx, &current_processing_thread()->running);
 
         assert(process->state == Process::READY ||
                process->state == Process::TIMEDOUT);
@@ -1926,11 +2274,12 @@ void ProcessManager::receive(Process *process, double secs)
         process->generation++;
       } else {
         /* Context switch. */
-        process->state = Process::RECEIVING;
-        swapcontext(&process->uctx, &proc_uctx_running);
+        context_swap(&process->ctx, &current_processing_thread()->running);
         assert(process->state == Process::READY);
         process->state = Process::RUNNING;
       }
+    } else {
+      process->state = Process::RUNNING;
     }
   }
   process->unlock();
@@ -1949,14 +2298,14 @@ void ProcessManager::pause(Process *process, double secs)
 
       /* Context switch. */
       process->state = Process::PAUSED;
-      swapcontext(&process->uctx, &proc_uctx_running);
+      context_swap(&process->ctx, &current_processing_thread()->running);
       assert(process->state == Process::TIMEDOUT);
       process->state = Process::RUNNING;
     } else {
       /* Modified context switch (basically a yield). */
       process->state = Process::READY;
       enqueue(process);
-      swapcontext(&process->uctx, &proc_uctx_running);
+      context_swap(&process->ctx, &current_processing_thread()->running);
       assert(process->state == Process::READY);
       process->state = Process::RUNNING;
     }
@@ -1970,13 +2319,18 @@ bool ProcessManager::wait(Process *process, const PID &pid)
   bool waited = false;
 
   /* Now we can add the process to the waiters. */
-  synchronized(processes) {
-    if (processes.count(pid.pipe) > 0) {
-      assert(processes[pid.pipe]->state != Process::EXITED);
-      waiters[processes[pid.pipe]].insert(process);
+  Shard *shard = this->shard(pid.pipe);
+  shard->lock();
+  {
+    unordered_map<uint32_t, Process *>::iterator it =
+      shard->processes.find(pid.pipe);
+    if (it != shard->processes.end()) {
+      assert(it->second->state != Process::EXITED);
+      shard->waiters[it->second].insert(process);
       waited = true;
     }
   }
+  shard->unlock();
 
   /* If we waited then we should context switch. */
   if (waited) {
@@ -1985,7 +2339,7 @@ bool ProcessManager::wait(Process *process, const PID &pid)
       if (process->state == Process::RUNNING) {
         /* Context switch. */
         process->state = Process::WAITING;
-        swapcontext(&process->uctx, &proc_uctx_running);
+        context_swap(&process->ctx, &current_processing_thread()->running);
         assert(process->state == Process::READY);
         process->state = Process::RUNNING;
       } else {
@@ -2016,18 +2370,23 @@ bool ProcessManager::external_wait(const PID &pid)
   Gate::state_t old;
 
   /* Try and approach the gate if necessary. */
-  synchronized(processes) {
-    if (processes.count(pid.pipe) > 0) {
-      Process *process = processes[pid.pipe];
+  Shard *shard = this->shard(pid.pipe);
+  shard->lock();
+  {
+    unordered_map<uint32_t, Process *>::iterator it =
+      shard->processes.find(pid.pipe);
+    if (it != shard->processes.end()) {
+      Process *process = it->second;
       assert(process->state != Process::EXITED);
 
       /* Check and see if a gate already exists. */
-      if (gates.find(process) == gates.end())
-        gates[process] = new Gate();
-      gate = gates[process];
+      if (shard->gates.find(process) == shard->gates.end())
+        shard->gates[process] = new Gate();
+      gate = shard->gates[process];
       old = gate->approach();
     }
   }
+  shard->unlock();
 
   /* Now arrive at the gate and wait until it opens. */
   if (gate != NULL) {
@@ -2049,8 +2408,13 @@ bool ProcessManager::await(Process *process, int fd, int op, double secs, bool i
 
   process->lock();
   {
-    /* Consider a non-empty message queue as an immediate interrupt. */
-    if (!ignore && !process->msgs.empty()) {
+    /*
+     * Consider a non-empty message queue as an immediate interrupt
+     * (the state has to be set first, see Process::enqueue).
+     */
+    process->state = Process::AWAITING;
+    if (!ignore && !process->empty()) {
+      process->state = Process::RUNNING;
       process->unlock();
       return false;
     }
@@ -2084,16 +2448,13 @@ bool ProcessManager::await(Process *process, int fd, int op, double secs, bool i
 
     assert(secs >= 0);
 
-    timeout timeout;
+    TimerWheel<timeout>::Handle timeout;
 
-    if (secs != 0) {
-      timeout = create_timeout(process, secs);
-      start_timeout(timeout);
-    }
+    if (secs != 0)
+      timeout = start_timeout(create_timeout(process, secs));
 
     /* Context switch. */
-    process->state = Process::AWAITING;
-    swapcontext(&process->uctx, &proc_uctx_running);
+    context_swap(&process->ctx, &current_processing_thread()->running);
     assert(process->state == Process::READY ||
            process->state == Process::TIMEDOUT ||
            process->state == Process::INTERRUPTED);
@@ -2120,31 +2481,50 @@ bool ProcessManager::await(Process *process, int fd, int op, double secs, bool i
 void ProcessManager::enqueue(Process *process)
 {
   assert(process != NULL);
-  synchronized(runq) {
-    assert(find(runq.begin(), runq.end(), process) == runq.end());
-    runq.push_back(process);
+  assert(!queued(process));
+
+  // Keep processes made runnable by a processing thread on that
+  // thread (they are likely to be talking to the process that just
+  // ran there), and spread out the rest.
+  ProcessingThread *thread = current_processing_thread();
+  if (thread == NULL) {
+    unsigned int next = __sync_fetch_and_add(&next_processing_thread, 1);
+    thread = &processing_threads[next % num_processing_threads];
   }
-    
-  /* Wake up the processing thread if necessary. */
-  gate->open();
+
+  thread->push(process);
+
+  /* Wake up a processing thread if necessary. */
+  gate->open(false);
 }
 
 
 Process * ProcessManager::dequeue()
 {
-  Process *process = NULL;
+  ProcessingThread *thread = current_processing_thread();
+  assert(thread != NULL);
 
-  synchronized(runq) {
-    if (!runq.empty()) {
-      process = runq.front();
-      runq.pop_front();
-    }
+  Process *process = thread->pop();
+
+  // Steal work from the other processing threads if we have none.
+  for (int i = 1; process == NULL && i < num_processing_threads; i++) {
+    int victim = (thread->id + i) % num_processing_threads;
+    process = processing_threads[victim].pop(true);
   }
 
   return process;
 }
 
 
+bool ProcessManager::queued(Process *process)
+{
+  for (int i = 0; i < num_processing_threads; i++)
+    if (processing_threads[i].queued(process))
+      return true;
+  return false;
+}
+
+
 void ProcessManager::timedout(const PID &pid, int generation)
 {
   if (ProcessReference process = use(pid)) {
@@ -2165,8 +2545,11 @@ void ProcessManager::timedout(const PID &pid, int generation)
                process->state == Process::INTERRUPTED ||
                process->state == Process::PAUSED);
 
-        if (process->state != Process::RUNNING ||
-            process->state != Process::INTERRUPTED ||
+        // A process that is RUNNING must not get enqueued (another
+        // processing thread might pick it up while it still runs),
+        // and an INTERRUPTED one has been enqueued already.
+        if (process->state != Process::RUNNING &&
+            process->state != Process::INTERRUPTED &&
             process->state != Process::EXITING)
           process_manager->enqueue(process);
 
@@ -2237,7 +2620,9 @@ void ProcessManager::cleanup(Process *process)
   process->state = Process::EXITING;
 
   /* Remove process. */
-  synchronized(processes) {
+  Shard *shard = this->shard(process->pid.pipe);
+  shard->lock();
+  {
     /* Remove from internal clock (if necessary). */
     synchronized(timeouts) {
       if (clk != NULL)
@@ -2250,51 +2635,57 @@ void ProcessManager::cleanup(Process *process)
       __sync_synchronize();
     }
 
+    /*
+     * Inform link manager. This must happen before the process gets
+     * removed, since as soon as it is a non-libprocess thread waiting
+     * on it might delete it while it is still in the links (and get
+     * sent a PROCESS_EXIT by another exiting process).
+     */
+    link_manager->exited(process);
+
     process->lock();
     {
       /* Free any pending messages. */
-      while (!process->msgs.empty()) {
-        struct msg *msg = process->msgs.front();
-        process->msgs.pop_front();
+      while (struct msg *msg = process->dequeue())
         free(msg);
-      }
 
       /* Free current message. */
       if (process->current) free(process->current);
 
-      processes.erase(process->pid.pipe);
-
       /* Confirm that the process is not in any waiting queue. */
-      foreachpair (_, set<Process *> &waiting, waiters)
+      foreachpair (_, set<Process *> &waiting, shard->waiters)
         assert(waiting.find(process) == waiting.end());
 
       /* Grab all the waiting processes that are now resumable. */
-      foreach (Process *waiter, waiters[process])
+      foreach (Process *waiter, shard->waiters[process])
         resumable.push_back(waiter);
 
-      waiters.erase(process);
+      shard->waiters.erase(process);
 
       /* Lookup gate to wake up waiting non-libprocess threads. */
-      map<Process *, Gate *>::iterator it = gates.find(process);
-      if (it != gates.end()) {
+      map<Process *, Gate *>::iterator it = shard->gates.find(process);
+      if (it != shard->gates.end()) {
         gate = it->second;
         /* N.B. The last thread that leaves the gate also free's it. */
-        gates.erase(it);
+        shard->gates.erase(it);
       }
         
       assert(process->refs == 0);
       process->state = Process::EXITED;
     }
     process->unlock();
-  }
 
-  /* Inform link manager. */
-  link_manager->exited(process);
+    /* Confirm process not in any run queue. */
+    assert(!queued(process));
 
-  /* Confirm process not in runq. */
-  synchronized(runq) {
-    assert(find(runq.begin(), runq.end(), process) == runq.end());
+    /*
+     * N.B. Once the process is removed a non-libprocess thread
+     * waiting on it can return (without going through the gate) and
+     * clean it up, so this must be the last use of 'process'.
+     */
+    shard->processes.erase(process->pid.pipe);
   }
+  shard->unlock();
 
   /*
    * N.B. After opening the gate we can no longer dereference
@@ -2311,11 +2702,8 @@ void ProcessManager::cleanup(Process *process)
     {
       // Process 'p' might be RUNNING because it is racing to become
       // WAITING while we are actually trying to get it to become
-      // running again.
-      // TODO(benh): Once we actually run multiple processes at a
-      // time (using multiple threads) this logic will need to get
-      // made thread safe (in particular, a process may be
-      // EXITING).
+      // running again (possibly on another processing thread). It
+      // can't be EXITING since it's still inside its wait.
       assert(p->state == Process::RUNNING || p->state == Process::WAITING);
       if (p->state == Process::RUNNING) {
         p->state = Process::INTERRUPTED;
@@ -2331,11 +2719,14 @@ void ProcessManager::cleanup(Process *process)
 
 void ProcessManager::invoke(const function<void (void)> &thunk)
 {
-  legacy_thunk = &thunk;
-  legacy = true;
-  assert(proc_process != NULL);
-  swapcontext(&proc_process->uctx, &proc_uctx_running);
-  legacy = false;
+  // The scheduler switches straight back to the process after calling
+  // the thunk, so we are still on the same thread afterwards.
+  ProcessingThread *thread = current_processing_thread();
+  assert(thread != NULL && thread->process != NULL);
+  thread->legacy_thunk = &thunk;
+  thread->legacy = true;
+  context_swap(&thread->process->ctx, &thread->running);
+  thread->legacy = false;
 }
 
 
@@ -2363,35 +2754,39 @@ timeout ProcessManager::create_timeout(Process *process, double secs)
 }
 
 
-void ProcessManager::start_timeout(const timeout &timeout)
+TimerWheel<timeout>::Handle ProcessManager::start_timeout(const timeout &timeout)
 {
+  TimerWheel<struct timeout>::Handle handle;
+
   /* Add the timer. */
   synchronized(timeouts) {
-    if (timeouts->size() == 0 || timeout.tstamp < timeouts->begin()->first) {
+    /*
+     * The loop's timer is set for the earliest timeout as of when it
+     * last looked, which is no later than the wheel's bound (looking up
+     * the actual earliest timeout here could mean a search through all
+     * of them every time one had been canceled or expired).
+     */
+    ev_tstamp tstamp;
+    if (!timeouts->bound(&tstamp) || timeout.tstamp < tstamp) {
       // Need to interrupt the loop to update/set timer repeat.
-      (*timeouts)[timeout.tstamp].push_back(timeout);
+      handle = timeouts->add(timeout.tstamp, timeout);
       update_timer = true;
       ev_async_send(loop, &async_watcher);
     } else {
       // Timer repeat is adequate, just add the timeout.
-      assert(timeouts->size() >= 1);
-      (*timeouts)[timeout.tstamp].push_back(timeout);
+      handle = timeouts->add(timeout.tstamp, timeout);
     }
   }
+
+  return handle;
 }
 
 
-void ProcessManager::cancel_timeout(const timeout &timeout)
+void ProcessManager::cancel_timeout(const TimerWheel<timeout>::Handle &handle)
 {
   synchronized(timeouts) {
-    // Check if the timeout is still pending, and if so, erase
-    // it. In addition, erase an empty list if we just removed the
-    // last timeout.
-    if (timeouts->count(timeout.tstamp) > 0) {
-      (*timeouts)[timeout.tstamp].remove(timeout);
-      if ((*timeouts)[timeout.tstamp].empty())
-        timeouts->erase(timeout.tstamp);
-    }
+    // Erase the timeout if it is still pending.
+    timeouts->cancel(handle);
   }
 }
 
@@ -2446,6 +2841,58 @@ void Clock::advance(double secs)
 }
 
 
+int64_t Connections::made()
+{
+  initialize();
+
+  return link_manager->connects();
+}
+
+
+int64_t Connections::reused()
+{
+  initialize();
+
+  return link_manager->reuses();
+}
+
+
+int64_t Connections::messages()
+{
+  return written_msgs;
+}
+
+
+int64_t Connections::bytes()
+{
+  return written_bytes;
+}
+
+
+int64_t Connections::writes()
+{
+  return write_calls;
+}
+
+
+int64_t Stacks::live()
+{
+  return live_stack_bytes;
+}
+
+
+int64_t Stacks::cached()
+{
+  return cached_stack_bytes;
+}
+
+
+int64_t Stacks::cacheLimit()
+{
+  return STACK_CACHE_SIZE;
+}
+
+
 Process::Process()
 {
   initialize();
@@ -2454,19 +2901,28 @@ Process::Process()
 
   refs = 0;
 
+  stub = msg_new(0);
+  *msg_link(stub) = NULL;
+  head = tail = stub;
+  injected = NULL;
+
   current = NULL;
 
   generation = 0;
 
+  /* Process (if any) creating this one. */
+  ProcessingThread *thread = current_processing_thread();
+  Process *parent = thread != NULL ? thread->process : NULL;
+
   /* Initialize the PID associated with the process. */
   if (!replaying) {
     /* Get a new unique pipe identifier. */
     pid.pipe = __sync_add_and_fetch(&global_pipe, 1);
   } else {
     /* Lookup pipe from record. */
-    map<uint32_t, deque<uint32_t> >::iterator it = proc_process == NULL
+    map<uint32_t, deque<uint32_t> >::iterator it = parent == NULL
       ? replay_pipes->find(0)
-      : replay_pipes->find(proc_process->pid.pipe);
+      : replay_pipes->find(parent->pid.pipe);
 
     /* Check that this is an expected process creation. */
     if (it == replay_pipes->end() && !it->second.empty())
@@ -2478,7 +2934,7 @@ Process::Process()
 
   if (recording) {
     assert(!replaying);
-    record_pipes << " " << (proc_process == NULL ? 0 : proc_process->pid.pipe);
+    record_pipes << " " << (parent == NULL ? 0 : parent->pid.pipe);
     record_pipes << " " << pid.pipe;
   }
 
@@ -2489,9 +2945,9 @@ Process::Process()
   // using happens before relationship between creator and createe!
   synchronized(timeouts) {
     if (clk != NULL) {
-      if (pthread_self() == proc_thread) {
-        assert(proc_process != NULL);
-        clk->setCurrent(this, clk->getCurrent(proc_process));
+      if (thread != NULL) {
+        assert(parent != NULL);
+        clk->setCurrent(this, clk->getCurrent(parent));
       } else {
         clk->setCurrent(this, clk->getCurrent());
       }
@@ -2500,7 +2956,10 @@ Process::Process()
 }
 
 
-Process::~Process() {}
+Process::~Process()
+{
+  free(stub);
+}
 
 
 void Process::enqueue(struct msg *msg)
@@ -2510,39 +2969,46 @@ void Process::enqueue(struct msg *msg)
   // TODO(benh): Put filter inside lock statement below so that we can
   // guarantee the order of the messages seen by a filter are the same
   // as the order of messages seen by the process.
-  synchronized(filterer) {
-    if (filterer != NULL) {
-      if (filterer->filter(msg)) {
-        free(msg);
-        return;
+  if (filterer != NULL) {
+    synchronized(filterer) {
+      if (filterer != NULL) {
+        if (filterer->filter(msg)) {
+          free(msg);
+          return;
+        }
       }
     }
   }
 
-  lock();
-  {
-    assert(state != EXITED);
+  assert(state != EXITED);
 
-    msgs.push_back(msg);
+  /* Link the message in after the last one. */
+  *msg_link(msg) = NULL;
+  struct msg *prev = __sync_lock_test_and_set(&head, msg);
+  __sync_synchronize();
+  *msg_link(prev) = msg;
 
-    if (state == RECEIVING) {
-      state = READY;
-      process_manager->enqueue(this);
-    } else if (state == AWAITING) {
-      state = INTERRUPTED;
-      process_manager->enqueue(this);
-    }
+  /*
+   * Only a process that is blocked needs to be made runnable (which
+   * takes its lock). A process about to block sets its state before
+   * checking for messages, and we check its state after linking ours,
+   * so between the two of us one will see the other.
+   */
+  __sync_synchronize();
 
-    assert(state == INIT ||
-           state == READY ||
-           state == RUNNING ||
-           state == PAUSED ||
-           state == WAITING ||
-           state == INTERRUPTED ||
-           state == TIMEDOUT ||
-           state == EXITING);
+  if (state == RECEIVING || state == AWAITING) {
+    lock();
+    {
+      if (state == RECEIVING) {
+        state = READY;
+        process_manager->enqueue(this);
+      } else if (state == AWAITING) {
+        state = INTERRUPTED;
+        process_manager->enqueue(this);
+      }
+    }
+    unlock();
   }
-  unlock();
 }
 
 
@@ -2550,20 +3016,61 @@ struct msg * Process::dequeue()
 {
   struct msg *msg = NULL;
 
-  lock();
-  {
-    assert (state == RUNNING);
-    if (!msgs.empty()) {
-      msg = msgs.front();
-      msgs.pop_front();
+  /* Injected messages come first. */
+  if (injected != NULL) {
+    msg = injected;
+    injected = *msg_link(msg);
+    return msg;
+  }
+
+  struct msg *next = *msg_link(tail);
+
+  /* Skip over the stub. */
+  if (tail == stub) {
+    if (next == NULL) {
+      if (head == stub)
+        return NULL;
+
+      /* A message is being linked in right now, wait for it. */
+      while ((next = *msg_link(stub)) == NULL)
+        sched_yield();
+    }
+
+    tail = next;
+    next = *msg_link(next);
+  }
+
+  /*
+   * Don't dequeue the last message without putting the stub back in
+   * behind it (so the queue never has to be emptied out from under
+   * a thread that is enqueueing).
+   */
+  if (next == NULL) {
+    if (tail == head) {
+      *msg_link(stub) = NULL;
+      struct msg *prev = __sync_lock_test_and_set(&head, stub);
+      __sync_synchronize();
+      *msg_link(prev) = stub;
     }
+
+    while ((next = *msg_link(tail)) == NULL)
+      sched_yield();
   }
-  unlock();
+
+  msg = tail;
+  tail = next;
 
   return msg;
 }
 
 
+bool Process::empty()
+{
+  __sync_synchronize();
+  return injected == NULL && tail == stub && head == stub;
+}
+
+
 void Process::inject(const PID &from, MSGID id, const char *data, size_t length)
 {
   if (replaying)
@@ -2577,7 +3084,7 @@ void Process::inject(const PID &from, MSGID id, const char *data, size_t length)
     return;
 
   /* Allocate/Initialize outgoing message. */
-  struct msg *msg = (struct msg *) malloc(sizeof(struct msg) + length);
+  struct msg *msg = msg_new(length);
 
   msg->from.pipe = from.pipe;
   msg->from.ip = from.ip;
@@ -2594,24 +3101,30 @@ void Process::inject(const PID &from, MSGID id, const char *data, size_t length)
   // TODO(benh): Put filter inside lock statement below so that we can
   // guarantee the order of the messages seen by a filter are the same
   // as the order of messages seen by the process.
-  synchronized(filterer) {
-    if (filterer != NULL) {
-      if (filterer->filter(msg)) {
-        free(msg);
-        return;
+  if (filterer != NULL) {
+    synchronized(filterer) {
+      if (filterer != NULL) {
+        if (filterer->filter(msg)) {
+          free(msg);
+          return;
+        }
       }
     }
   }
 
-  lock();
-  {
-    msgs.push_front(msg);
-  }
-  unlock();
+  /* Only the process itself injects, so no other thread touches this. */
+  *msg_link(msg) = injected;
+  injected = msg;
 }
 
 
 void Process::send(const PID &to, MSGID id, const char *data, size_t length)
+{
+  send(to, id, CopiedBody(data, length));
+}
+
+
+void Process::send(const PID &to, MSGID id, const MessageBody &body)
 {
   if (replaying)
     return;
@@ -2624,7 +3137,8 @@ void Process::send(const PID &to, MSGID id, const char *data, size_t length)
     return;
 
   /* Allocate/Initialize outgoing message. */
-  struct msg *msg = (struct msg *) malloc(sizeof(struct msg) + length);
+  size_t length = body.length();
+  struct msg *msg = msg_new(length);
 
   msg->from.pipe = pid.pipe;
   msg->from.ip = pid.ip;
@@ -2635,8 +3149,7 @@ void Process::send(const PID &to, MSGID id, const char *data, size_t length)
   msg->id = id;
   msg->len = length;
 
-  if (length > 0)
-    memcpy((char *) msg + sizeof(struct msg), data, length);
+  body.write((char *) msg + sizeof(struct msg));
 
   if (to.ip == ip && to.port == port)
     /* Local message. */
@@ -2659,7 +3172,7 @@ MSGID Process::receive(double secs)
   if ((current = dequeue()) != NULL)
     goto found;
 
-  if (pthread_self() == proc_thread) {
+  if (current_processing_thread() != NULL) {
     // Avoid blocking if negative seconds.
     if (secs >= 0)
       process_manager->receive(this, secs);
@@ -2755,7 +3268,7 @@ const char * Process::body(size_t *length) const
 
 void Process::pause(double secs)
 {
-  if (pthread_self() == proc_thread) {
+  if (current_processing_thread() != NULL) {
     if (replaying)
       process_manager->pause(this, 0);
     else
@@ -2783,7 +3296,7 @@ bool Process::await(int fd, int op, double secs, bool ignore)
     return true;
 
   /* TODO(benh): Handle invoking await from "outside" thread. */
-  if (pthread_self() != proc_thread)
+  if (current_processing_thread() == NULL)
     fatal("unimplemented");
 
   return process_manager->await(this, fd, op, secs, ignore);
@@ -2836,7 +3349,7 @@ double Process::elapsed()
 }
 
 
-PID Process::spawn(Process *process)
+PID Process::spawn(Process *process, size_t stack)
 {
   initialize();
 
@@ -2845,16 +3358,17 @@ PID Process::spawn(Process *process)
     // using happens before relationship between spawner and spawnee!
     synchronized(timeouts) {
       if (clk != NULL) {
-        if (pthread_self() == proc_thread) {
-          assert(proc_process != NULL);
-          clk->setCurrent(process, clk->getCurrent(proc_process));
+        ProcessingThread *thread = current_processing_thread();
+        if (thread != NULL) {
+          assert(thread->process != NULL);
+          clk->setCurrent(process, clk->getCurrent(thread->process));
         } else {
           clk->setCurrent(process, clk->getCurrent());
         }
       }
     }
 
-    process_manager->spawn(process);
+    process_manager->spawn(process, stack);
 
     return process->self();
   } else {
@@ -2870,10 +3384,12 @@ bool Process::wait(const PID &pid)
   if (!pid)
     return false;
 
+  ProcessingThread *thread = current_processing_thread();
+
   // N.B. This could result in a deadlock! We could check if such was
   // the case by doing:
   //
-  //   if (proc_process && proc_process->pid == pid) {
+  //   if (thread && thread->process->pid == pid) {
   //     handle deadlock here;
   //   }
   //
@@ -2882,10 +3398,10 @@ bool Process::wait(const PID &pid)
   // has waited on a process and it is now finished (and can be
   // cleaned up).
 
-  if (pthread_self() != proc_thread)
+  if (thread == NULL)
     return process_manager->external_wait(pid);
   else
-    return process_manager->wait(proc_process, pid);
+    return process_manager->wait(thread->process, pid);
 }
 
 
@@ -2907,6 +3423,12 @@ void Process::filter(Filter *filter)
 
 
 void Process::post(const PID &to, MSGID id, const char *data, size_t length)
+{
+  post(to, id, CopiedBody(data, length));
+}
+
+
+void Process::post(const PID &to, MSGID id, const MessageBody &body)
 {
   initialize();
 
@@ -2921,7 +3443,8 @@ void Process::post(const PID &to, MSGID id, const char *data, size_t length)
     return;
 
   /* Allocate/Initialize outgoing message. */
-  struct msg *msg = (struct msg *) malloc(sizeof(struct msg) + length);
+  size_t length = body.length();
+  struct msg *msg = msg_new(length);
 
   msg->from.pipe = 0;
   msg->from.ip = 0;
@@ -2932,8 +3455,7 @@ void Process::post(const PID &to, MSGID id, const char *data, size_t length)
   msg->id = id;
   msg->len = length;
 
-  if (length > 0)
-    memcpy((char *) msg + sizeof(struct msg), data, length);
+  body.write((char *) msg + sizeof(struct msg));
 
   if (to.ip == ip && to.port == port)
     /* Local message. */
@@ -2950,7 +3472,7 @@ void Process::dispatcher(Process *process, function<void (void)> *delegator)
     return;
 
   /* Allocate/Initialize outgoing message. */
-  struct msg *msg = (struct msg *) malloc(sizeof(struct msg) + sizeof(delegator));
+  struct msg *msg = msg_new(sizeof(delegator));
 
   msg->from.pipe = 0;
   msg->from.ip = 0;
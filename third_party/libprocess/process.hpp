@@ -4,7 +4,7 @@
 #include <assert.h>
 #include <stdint.h>
 #include <stdlib.h>
-#include <ucontext.h>
+#include <string.h>
 
 #include <sys/time.h>
 
@@ -12,6 +12,7 @@
 
 #include <tr1/functional>
 
+#include "context.hpp"
 #include "pid.hpp"
 
 
@@ -46,12 +47,78 @@ public:
 };
 
 
+/* Counts of outbound connections and of what was written to them. */
+class Connections {
+public:
+  /* Connections made for sending messages (to nodes without a link). */
+  static int64_t made();
+
+  /* Sends that went over an already open (idle) connection instead. */
+  static int64_t reused();
+
+  /* Messages and bytes written to remote nodes, and the writes it took. */
+  static int64_t messages();
+  static int64_t bytes();
+  static int64_t writes();
+};
+
+
+class Stacks {
+public:
+  /* Bytes of stacks in use by processes. */
+  static int64_t live();
+
+  /* Bytes of stacks kept for reuse by processes spawned later. */
+  static int64_t cached();
+
+  /* Most bytes of stacks that get kept for reuse. */
+  static int64_t cacheLimit();
+};
+
+
 class Filter {
 public:
   virtual bool filter(msg *) = 0;
 };
 
 
+/*
+ * The body of a message to send, written straight into the message
+ * (so a body that has to be built, e.g., serialized, doesn't have to
+ * be built somewhere else first and then copied).
+ */
+class MessageBody {
+public:
+  virtual ~MessageBody() {}
+
+  /* Returns the length of the body. */
+  virtual size_t length() const = 0;
+
+  /* Writes the body (length() bytes) to data. */
+  virtual void write(char *data) const = 0;
+};
+
+
+/* A message body that is a copy of some data. */
+class CopiedBody : public MessageBody {
+public:
+  CopiedBody(const char *_data, size_t _length)
+    : data(_data), size(_length) {}
+
+  virtual size_t length() const { return size; }
+
+  virtual void write(char *to) const
+  {
+    if (size > 0)
+      memcpy(to, data, size);
+  }
+
+private:
+  const char *data;
+  const size_t size;
+};
+
+
 template <typename T>
 struct Future
 {
@@ -156,6 +223,9 @@ protected:
   /* Sends a message with data to PID. */
   virtual void send(const PID &to, MSGID id, const char *data = NULL, size_t length = 0);
 
+  /* Sends a message with the specified body to PID. */
+  virtual void send(const PID &to, MSGID id, const MessageBody &body);
+
   /* Blocks for message at most specified seconds (0 implies forever). */
   virtual MSGID receive(double secs = 0);
 
@@ -185,8 +255,9 @@ public:
    * Spawn a new process.
    *
    * @param process process to be spawned
+   * @param stack bytes of stack for the process (0 implies the default)
    */
-  static PID spawn(Process *process);
+  static PID spawn(Process *process, size_t stack = 0);
 
   /**
    * Wait for process to exit (returns true if actually waited on a process).
@@ -220,6 +291,16 @@ public:
    */
   static void post(const PID &to, MSGID id, const char *data = NULL, size_t length = 0);
 
+  /**
+   * Sends a message with a body written in place without a return
+   * address.
+   *
+   * @param to receiver
+   * @param id message id
+   * @param body body of the message
+   */
+  static void post(const PID &to, MSGID id, const MessageBody &body);
+
   /**
    * Dispatches a void method on a process.
    *
@@ -488,6 +569,7 @@ private:
   friend class ProcessManager;
   friend class ProcessReference;
   friend void * schedule(void *);
+  friend void trampoline(void *);
 
   /* Flag indicating state of process. */
   enum { INIT,
@@ -505,8 +587,16 @@ private:
   /* Active references. */
   int refs;
 
-  /* Queue of received messages. */
-  std::deque<msg *> msgs;
+  /*
+   * Queue of received messages. Any thread may enqueue without
+   * locking (messages are linked through space allocated after their
+   * data), but only the process itself dequeues (see Process::enqueue
+   * and Process::dequeue).
+   */
+  msg * volatile head;  /* Last message enqueued. */
+  msg *tail;            /* Next message to dequeue. */
+  msg *stub;            /* Placeholder when there are no messages. */
+  msg *injected;        /* Injected messages, dequeued before the rest. */
 
   /* Current message. */
   msg *current;
@@ -518,7 +608,7 @@ private:
   PID pid;
 
   /* Continuation/Context of process. */
-  ucontext_t uctx;
+  context ctx;
 
   /* Lock/mutex protecting internals. */
   pthread_mutex_t m;
@@ -531,6 +621,9 @@ private:
   /* Dequeues a message or returns NULL. */
   msg * dequeue();
 
+  /* Returns true if there are no messages to dequeue. */
+  bool empty();
+
   /* Dispatches the delegator to the specified process. */
   static void dispatcher(Process *, std::tr1::function<void (void)> *delegator);
 };
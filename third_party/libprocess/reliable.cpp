@@ -6,6 +6,7 @@
 
 using std::make_pair;
 using std::map;
+using std::multimap;
 using std::pair;
 
 
@@ -34,53 +35,6 @@ struct rmsg
 };
 
 
-class ReliableSender : public Process
-{
-public:
-  PID via;
-  struct rmsg *rmsg;
-
-  ReliableSender(const PID &_via, struct rmsg *_rmsg)
-    : via(_via), rmsg(_rmsg) {}
-
-  ~ReliableSender()
-  {
-    if (rmsg != NULL) {
-      free(rmsg);
-      rmsg = NULL;
-    }
-  }
-
-protected:
-  void operator () ()
-  {
-    do {
-      send(via, RELIABLE_MSG, (char *) rmsg,
-	   sizeof(struct rmsg) + rmsg->msg.len);
-
-      switch (receive(RELIABLE_TIMEOUT)) {
-	case RELIABLE_ACK: {
-	  // All done!
-	  return;
-	}
-        case RELIABLE_REDIRECT_VIA: {
-	  via = *reinterpret_cast<const PID *>(body(NULL));
-	  break;
-	}
-        case RELIABLE_REDIRECT_TO: {
-	  rmsg->msg.to = *reinterpret_cast<const PID *>(body(NULL));
-	  break;
-	}
-        case PROCESS_TIMEOUT: {
-	  // Retry!
-	  break;
-	}
-      }
-    } while (true);
-  }
-};
-
-
 ReliableProcess::ReliableProcess()
   : current(NULL) {}
 
@@ -92,13 +46,8 @@ ReliableProcess::~ReliableProcess()
     current = NULL;
   }
 
-  foreachpair (const PID &pid, ReliableSender *sender, senders) {
-    assert(pid == sender->self());
-    // Shut it down by sending it an ack.
-    send(pid, RELIABLE_ACK);
-    wait(pid);
-    delete sender;
-  }
+  foreach (const unacked &u, unacks)
+    free(u.rmsg);
 }
 
 
@@ -167,8 +116,15 @@ bool ReliableProcess::forward(const PID &to)
 
 
 bool ReliableProcess::forward(const PID &to, MSGID id, const char *data, size_t length)
+{
+  return forward(to, id, CopiedBody(data, length));
+}
+
+
+bool ReliableProcess::forward(const PID &to, MSGID id, const MessageBody &body)
 {
   if (current != NULL) {
+    size_t length = body.length();
     struct rmsg *rmsg = (struct rmsg *) malloc(sizeof(struct rmsg) + length);
 
     rmsg->seq = current->seq;
@@ -182,8 +138,7 @@ bool ReliableProcess::forward(const PID &to, MSGID id, const char *data, size_t
     rmsg->msg.id = id;
     rmsg->msg.len = length;
 
-    if (length > 0)
-      memcpy((char *) rmsg + sizeof(struct rmsg), data, length);
+    body.write((char *) rmsg + sizeof(struct rmsg));
 
     send(to, RELIABLE_MSG, (char *) rmsg,
 	 sizeof(struct rmsg) + rmsg->msg.len);
@@ -198,8 +153,15 @@ bool ReliableProcess::forward(const PID &to, MSGID id, const char *data, size_t
 
 
 int ReliableProcess::rsend(const PID &to, MSGID id, const char *data, size_t length)
+{
+  return rsend(to, id, CopiedBody(data, length));
+}
+
+
+int ReliableProcess::rsend(const PID &to, MSGID id, const MessageBody &body)
 {
   // Allocate/Initialize outgoing message.
+  size_t length = body.length();
   struct rmsg *rmsg = (struct rmsg *) malloc(sizeof(struct rmsg) + length);
 
   int seq = sentSeqs[to]++;
@@ -215,20 +177,26 @@ int ReliableProcess::rsend(const PID &to, MSGID id, const char *data, size_t len
   rmsg->msg.id = id;
   rmsg->msg.len = length;
 
-  if (length > 0)
-    memcpy((char *) rmsg + sizeof(struct rmsg), data, length);
+  body.write((char *) rmsg + sizeof(struct rmsg));
+
+  send(to, RELIABLE_MSG, (char *) rmsg, sizeof(struct rmsg) + length);
 
-  ReliableSender *sender = new ReliableSender(to, rmsg);
-  PID pid = link(spawn(sender));
-  senders[pid] = sender;
+  track(to, rmsg);
 
   return seq;
 }
 
 
 int ReliableProcess::rsend(const PID &via, const PID &to, MSGID id, const char *data, size_t length)
+{
+  return rsend(via, to, id, CopiedBody(data, length));
+}
+
+
+int ReliableProcess::rsend(const PID &via, const PID &to, MSGID id, const MessageBody &body)
 {
   // Allocate/Initialize outgoing message.
+  size_t length = body.length();
   struct rmsg *rmsg = (struct rmsg *) malloc(sizeof(struct rmsg) + length);
 
   int seq = sentSeqs[to]++;
@@ -244,12 +212,11 @@ int ReliableProcess::rsend(const PID &via, const PID &to, MSGID id, const char *
   rmsg->msg.id = id;
   rmsg->msg.len = length;
 
-  if (length > 0)
-    memcpy((char *) rmsg + sizeof(struct rmsg), data, length);
+  body.write((char *) rmsg + sizeof(struct rmsg));
+
+  send(via, RELIABLE_MSG, (char *) rmsg, sizeof(struct rmsg) + length);
 
-  ReliableSender *sender = new ReliableSender(via, rmsg);
-  PID pid = link(spawn(sender));
-  senders[pid] = sender;
+  track(via, rmsg);
 
   return seq;
 }
@@ -273,8 +240,31 @@ MSGID ReliableProcess::receive(double secs)
     current = NULL;
   }
 
+  // When to give up waiting for a message (if ever).
+  double deadline = secs > 0 ? elapsed() + secs : 0;
+
   do {
-    MSGID id = Process::receive(secs);
+    // Wake up for the next retransmission if it comes before the
+    // caller wants to stop waiting.
+    double timeout = secs;
+    bool retransmitting = false;
+    if (!unacks.empty()) {
+      double now = elapsed();
+      retransmit(now);
+      double nextTimeout = unacks.front().timeout;
+      if (secs == 0 || (secs > 0 && nextTimeout < deadline)) {
+        timeout = nextTimeout - now;
+        retransmitting = true;
+      }
+    }
+
+    if (!retransmitting && secs > 0) {
+      timeout = deadline - elapsed();
+      if (timeout <= 0)
+        timeout = -1; // Just check for a message.
+    }
+
+    MSGID id = Process::receive(timeout);
     switch (id) {
       // TODO(benh): Better validation of messages!
       case RELIABLE_ACK: {
@@ -283,15 +273,13 @@ MSGID ReliableProcess::receive(double secs)
 	assert(length > 0);
 	struct rmsg *rmsg = (struct rmsg *) data;
 
-	// TODO(benh): Is this really the way we want to do acks?
-	foreachpair (const PID &pid, ReliableSender *sender, senders) {
-	  assert(pid == sender->self());
-	  // TODO(benh): Don't look into sender's class like this ... HACK!
-	  if (rmsg->seq == sender->rmsg->seq &&
-	      rmsg->msg.to == sender->rmsg->msg.to) {
-	    send(pid, RELIABLE_ACK);
-	  }
-	}
+	// An ack only covers the message it is for: a receiver with no
+	// record of a sender accepts whatever sequence number comes
+	// first, so it may never have seen earlier messages.
+	typedef multimap<pair<int, PID>, unacked_iterator>::iterator iterator;
+	iterator it = unackedSeqs.find(make_pair(rmsg->seq, rmsg->msg.to));
+	if (it != unackedSeqs.end())
+	  untrack(it);
 	continue;
       }
       case RELIABLE_MSG: {
@@ -321,13 +309,9 @@ MSGID ReliableProcess::receive(double secs)
 	// Avoid recursively invoking ourselves via receive(), use receive(0)!
 	return Process::receive(0);
       }
-      case PROCESS_EXIT: {
-	if (senders.find(from()) != senders.end()) {
-	  ReliableSender *sender = senders[from()];
-	  senders.erase(from());
-	  delete sender;
+      case PROCESS_TIMEOUT: {
+	if (retransmitting)
 	  continue;
-	}
 	break;
       }
     }
@@ -338,28 +322,74 @@ MSGID ReliableProcess::receive(double secs)
 
 void ReliableProcess::redirect(const PID &existing, const PID &updated)
 {
-  // Send a redirect to all running senders and update internal mapping.
-  foreachpair (const PID &pid, ReliableSender *sender, senders) {
-    assert(pid == sender->self());
-    // TODO(benh): Don't look into sender's class like this ... HACK!
-    if (existing == sender->via)
-      send(pid, RELIABLE_REDIRECT_VIA, (char *) &updated, sizeof(PID));
-    if (existing == sender->rmsg->msg.to)
-      send(pid, RELIABLE_REDIRECT_TO, (char *) &updated, sizeof(PID));
+  if (existing == updated)
+    return;
+
+  // Update where unacknowledged messages get sent to (and via).
+  typedef multimap<pair<int, PID>, unacked_iterator>::iterator iterator;
+  for (unacked_iterator u = unacks.begin(); u != unacks.end(); ++u) {
+    if (existing == u->via)
+      u->via = updated;
+    if (existing == u->rmsg->msg.to) {
+      u->rmsg->msg.to = updated;
+      // Re-index the message under its new destination.
+      pair<iterator, iterator> range =
+        unackedSeqs.equal_range(make_pair(u->rmsg->seq, existing));
+      for (iterator it = range.first; it != range.second; ++it) {
+        if (it->second == u) {
+          unackedSeqs.erase(it);
+          break;
+        }
+      }
+      unackedSeqs.insert(make_pair(make_pair(u->rmsg->seq, updated), u));
+    }
   }
 }
 
 
 void ReliableProcess::cancel(int seq)
 {
-  foreachpair (const PID &pid, ReliableSender *sender, senders) {
-    assert(pid == sender->self());
-    // Shut it down by sending it an ack. It will get cleaned up via
-    // the PROCESS_EXIT above.
-    // TODO(benh): Don't look into sender's class like this ... HACK!
-    if (seq == sender->rmsg->seq) {
-      send(pid, RELIABLE_ACK);
-      break;
-    }
+  // The smallest PID is the default one, so this finds the first
+  // message with this sequence number (whatever its destination).
+  typedef multimap<pair<int, PID>, unacked_iterator>::iterator iterator;
+  iterator it = unackedSeqs.lower_bound(make_pair(seq, PID()));
+  if (it != unackedSeqs.end() && it->first.first == seq)
+    untrack(it);
+}
+
+
+size_t ReliableProcess::unacknowledged() const
+{
+  return unacks.size();
+}
+
+
+void ReliableProcess::track(const PID &via, struct rmsg *rmsg)
+{
+  unacked u = { via, rmsg, elapsed() + RELIABLE_TIMEOUT };
+  unacked_iterator it = unacks.insert(unacks.end(), u);
+  unackedSeqs.insert(make_pair(make_pair(rmsg->seq, rmsg->msg.to), it));
+}
+
+
+void ReliableProcess::untrack(multimap<pair<int, PID>, unacked_iterator>::iterator it)
+{
+  free(it->second->rmsg);
+  unacks.erase(it->second);
+  unackedSeqs.erase(it);
+}
+
+
+void ReliableProcess::retransmit(double now)
+{
+  // Resend the messages that have gone unacknowledged for too long.
+  // They're at the front, and each one goes to the back again since
+  // it's now the last to be due (the index stays valid).
+  while (!unacks.empty() && unacks.front().timeout <= now) {
+    unacked &u = unacks.front();
+    send(u.via, RELIABLE_MSG, (char *) u.rmsg,
+	 sizeof(struct rmsg) + u.rmsg->msg.len);
+    u.timeout = now + RELIABLE_TIMEOUT;
+    unacks.splice(unacks.end(), unacks, unacks.begin());
   }
 }
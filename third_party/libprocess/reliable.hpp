@@ -4,6 +4,7 @@
 #include <process.hpp>
 
 #include <functional>
+#include <list>
 #include <map>
 
 #define RELIABLE_TIMEOUT 10
@@ -12,14 +13,13 @@
 enum {
   RELIABLE_MSG = PROCESS_MSGID,
   RELIABLE_ACK,
-  RELIABLE_REDIRECT_VIA,
-  RELIABLE_REDIRECT_TO,
+  RELIABLE_REDIRECT_VIA, /* No longer used (kept so that the ids */
+  RELIABLE_REDIRECT_TO,  /* after it stay the same). */
   RELIABLE_MSGID
 };
 
 
 struct rmsg; 
-class ReliableSender;
 
 
 class ReliableProcess : public Process
@@ -79,6 +79,11 @@ protected:
    */
   virtual bool forward(const PID &to, MSGID id, const char *data, size_t length);
 
+  /**
+   * Like forward above, but with a body written in place.
+   */
+  virtual bool forward(const PID &to, MSGID id, const MessageBody &body);
+
   /**
    * Sends a _reliable_ message with data to PID.
    * @param to destination
@@ -89,6 +94,15 @@ protected:
    */
   virtual int rsend(const PID &to, MSGID id, const char *data = NULL, size_t length = 0);
 
+  /**
+   * Sends a _reliable_ message with a body written in place to PID.
+   * @param to destination
+   * @param id message id
+   * @param body payload
+   * @return sequence number of message
+   */
+  virtual int rsend(const PID &to, MSGID id, const MessageBody &body);
+
   /**
    * Sends a _reliable_ message with data via another process (meant
    * to be forwarded).
@@ -101,6 +115,17 @@ protected:
    */
   virtual int rsend(const PID &via, const PID &to, MSGID id, const char *data = NULL, size_t length = 0);
 
+  /**
+   * Sends a _reliable_ message with a body written in place via
+   * another process (meant to be forwarded).
+   * @param via hop
+   * @param to destination
+   * @param id message id
+   * @param body payload
+   * @return sequence number of message
+   */
+  virtual int rsend(const PID &via, const PID &to, MSGID id, const MessageBody &body);
+
   /* Blocks for message at most specified seconds (0 implies forever). */
   virtual MSGID receive(double secs = 0);
 
@@ -117,12 +142,45 @@ protected:
    * @param seq sequence number of message to cancel
    */
   virtual void cancel(int seq);
+
+  /**
+   * @return number of _reliable_ messages sent that have not been
+   * acknowledged (or canceled) yet.
+   */
+  virtual size_t unacknowledged() const;
   
 private:
+  /* A sent message that has not been acknowledged yet. */
+  struct unacked
+  {
+    PID via;
+    struct rmsg *rmsg;
+    double timeout; /* When to retransmit it next. */
+  };
+
+  typedef std::list<unacked>::iterator unacked_iterator;
+
+  /* Resends messages that have timed out. */
+  void retransmit(double now);
+
+  /* Starts tracking a message just sent (via the specified PID). */
+  void track(const PID &via, struct rmsg *rmsg);
+
+  /* Stops tracking a message and frees it. */
+  void untrack(std::multimap<std::pair<int, PID>, unacked_iterator>::iterator it);
+
   struct rmsg *current;
   std::map<PID, int> sentSeqs;
   std::map<std::pair<PID, PID>, int> recvSeqs;
-  std::map<PID, ReliableSender *> senders;
+
+  /*
+   * Unacknowledged messages in the order they are next due to be
+   * retransmitted (every message waits RELIABLE_TIMEOUT, so this is
+   * the order they were last sent in), and an index of them by
+   * sequence number and destination.
+   */
+  std::list<unacked> unacks;
+  std::multimap<std::pair<int, PID>, unacked_iterator> unackedSeqs;
 };
 
 
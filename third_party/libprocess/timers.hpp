@@ -0,0 +1,314 @@
+#ifndef TIMERS_HPP
+#define TIMERS_HPP
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <vector>
+
+
+/*
+ * A hierarchical timer wheel (in the style of the one in the Linux
+ * kernel). Timers are kept in 4 levels of 256 slots each, where a slot
+ * in level 0 covers one tick (the resolution) and a slot in each next
+ * level covers 256 slots of the level below it. Adding and canceling a
+ * timer is O(1); a timer moves down a level each time the ticks catch
+ * up with its slot, until it expires out of level 0. Timers keep their
+ * exact time stamp, and only expire once that time has been reached.
+ *
+ * The wheel is not thread-safe (libprocess guards it with the same
+ * lock as the manual clock).
+ */
+template <typename T>
+class TimerWheel
+{
+  struct Timer
+  {
+    Timer *prev;
+    Timer *next;
+    Timer **slot;
+    double tstamp;
+    uint64_t id;   /* Zero when free. */
+    T t;
+  };
+
+public:
+  /* Identifies an added timer (for canceling it). */
+  class Handle
+  {
+  public:
+    Handle() : timer(NULL), id(0) {}
+
+  private:
+    friend class TimerWheel;
+    Timer *timer;
+    uint64_t id;
+  };
+
+  TimerWheel(double _resolution, double start)
+    : resolution(_resolution), current(ticks(start)), ids(0), size_(0),
+      free(NULL), earliest(0), stale(false)
+  {
+    for (int level = 0; level < LEVELS; level++) {
+      counts[level] = 0;
+      for (int i = 0; i < SLOTS; i++)
+        slots[level][i] = NULL;
+    }
+  }
+
+  ~TimerWheel()
+  {
+    for (size_t i = 0; i < chunks.size(); i++)
+      delete[] chunks[i];
+  }
+
+  /* Adds a timer that expires at the specified time. */
+  Handle add(double tstamp, const T &t)
+  {
+    if (free == NULL)
+      grow();
+
+    Timer *timer = free;
+    free = timer->next;
+
+    timer->tstamp = tstamp;
+    timer->id = ++ids;
+    timer->t = t;
+
+    place(timer);
+
+    /*
+     * Even when stale, earliest is no later than any timer (they have
+     * only been removed since it was looked up), so a timer before it
+     * is the earliest one.
+     */
+    if (size_++ == 0 || tstamp < earliest) {
+      earliest = tstamp;
+      stale = false;
+    }
+
+    Handle handle;
+    handle.timer = timer;
+    handle.id = timer->id;
+    return handle;
+  }
+
+  /*
+   * Cancels a timer, returning false if it has already expired (or
+   * been canceled). Timers are never given back to the system while
+   * the wheel exists, so this is safe to call with any handle.
+   */
+  bool cancel(const Handle &handle)
+  {
+    Timer *timer = handle.timer;
+
+    if (timer == NULL || timer->id != handle.id)
+      return false;
+
+    if (timer->tstamp == earliest)
+      stale = true;
+
+    remove(timer);
+    release(timer);
+    size_--;
+
+    return true;
+  }
+
+  /* Removes the timers that have expired by now (in order of slots). */
+  void expire(double now, std::vector<T> *expired)
+  {
+    uint64_t until = ticks(now);
+
+    for (;;) {
+      Timer **slot = &slots[0][current & MASK];
+      Timer *timer = *slot;
+      while (timer != NULL) {
+        Timer *next = timer->next;
+        if (timer->tstamp <= now) {
+          expired->push_back(timer->t);
+          remove(timer);
+          release(timer);
+          size_--;
+          stale = true;
+        }
+        timer = next;
+      }
+
+      if (current >= until)
+        break;
+
+      /* Skip ahead over the ticks that have nothing to expire. */
+      uint64_t next = current + 1;
+      if (counts[0] == 0) {
+        int level = 1;
+        while (level < LEVELS && counts[level] == 0)
+          level++;
+        if (level == LEVELS)
+          next = until;
+        else
+          next = (current | ((1ULL << (BITS * level)) - 1)) + 1;
+        if (next > until)
+          next = until;
+      }
+
+      current = next;
+
+      /* Move the timers in the next slot of each level down a level. */
+      for (int level = 1; level < LEVELS; level++) {
+        if ((current & ((1ULL << (BITS * level)) - 1)) != 0)
+          break;
+        cascade(level, (current >> (BITS * level)) & MASK);
+      }
+    }
+  }
+
+  /* Returns the time of the earliest timer (false if there are none). */
+  bool next(double *tstamp)
+  {
+    if (size_ == 0)
+      return false;
+
+    if (stale) {
+      earliest = INFINITY;
+      for (int level = 0; level < LEVELS; level++) {
+        if (counts[level] == 0)
+          continue;
+        /*
+         * The first non-empty slot after the current one has this
+         * level's earliest timers (the last slot checked is the
+         * current one again, which in levels above 0 holds timers that
+         * are a whole round of the level away).
+         */
+        uint64_t base = level == 0 ? current : (current >> (BITS * level)) + 1;
+        for (int i = 0; i < SLOTS; i++) {
+          Timer *timer = slots[level][(base + i) & MASK];
+          if (timer != NULL) {
+            for (; timer != NULL; timer = timer->next)
+              if (timer->tstamp < earliest)
+                earliest = timer->tstamp;
+            break;
+          }
+        }
+      }
+      stale = false;
+    }
+
+    *tstamp = earliest;
+    return true;
+  }
+
+  /*
+   * Returns a time no later than that of any timer (false if there are
+   * none) without looking through the timers: the time of the earliest
+   * timer as of the last lookup, or of a timer added since then.
+   */
+  bool bound(double *tstamp) const
+  {
+    if (size_ == 0)
+      return false;
+
+    *tstamp = earliest;
+    return true;
+  }
+
+  size_t size() const { return size_; }
+
+  bool empty() const { return size_ == 0; }
+
+private:
+  enum { LEVELS = 4, BITS = 8, SLOTS = 1 << BITS, MASK = SLOTS - 1 };
+
+  /* Timers allocated at a time. */
+  enum { CHUNK = 1024 };
+
+  uint64_t ticks(double tstamp) const
+  {
+    return tstamp <= 0 ? 0 : (uint64_t) floor(tstamp / resolution);
+  }
+
+  void place(Timer *timer)
+  {
+    uint64_t expires = ticks(timer->tstamp);
+    if (expires < current)
+      expires = current;
+
+    uint64_t delta = expires - current;
+
+    int level = 0;
+    while (level < LEVELS - 1 && delta >= (1ULL << (BITS * (level + 1))))
+      level++;
+
+    /* Timers beyond the last level wait in its farthest slot. */
+    if (level == LEVELS - 1 && delta >= (1ULL << (BITS * LEVELS)))
+      expires = current + (1ULL << (BITS * LEVELS)) - 1;
+
+    Timer **slot = &slots[level][(expires >> (BITS * level)) & MASK];
+    timer->slot = slot;
+    timer->prev = NULL;
+    timer->next = *slot;
+    if (*slot != NULL)
+      (*slot)->prev = timer;
+    *slot = timer;
+    counts[level]++;
+  }
+
+  void remove(Timer *timer)
+  {
+    if (timer->prev != NULL)
+      timer->prev->next = timer->next;
+    else
+      *timer->slot = timer->next;
+    if (timer->next != NULL)
+      timer->next->prev = timer->prev;
+    counts[(timer->slot - &slots[0][0]) / SLOTS]--;
+  }
+
+  void cascade(int level, int index)
+  {
+    Timer *timer = slots[level][index];
+    while (timer != NULL) {
+      Timer *next = timer->next;
+      remove(timer);
+      place(timer);
+      timer = next;
+    }
+  }
+
+  void release(Timer *timer)
+  {
+    timer->id = 0;
+    timer->next = free;
+    free = timer;
+  }
+
+  void grow()
+  {
+    Timer *chunk = new Timer[CHUNK];
+    chunks.push_back(chunk);
+    for (int i = 0; i < CHUNK; i++) {
+      chunk[i].id = 0;
+      chunk[i].next = free;
+      free = &chunk[i];
+    }
+  }
+
+  const double resolution;
+  uint64_t current;            /* Tick the wheel is at. */
+  uint64_t ids;                /* Last timer id handed out. */
+  size_t size_;
+  Timer *slots[LEVELS][SLOTS];
+  size_t counts[LEVELS];       /* Timers in each level. */
+  Timer *free;
+  std::vector<Timer *> chunks;
+  double earliest;             /* Time of the earliest timer ... */
+  bool stale;                  /* ... unless it has to be looked up
+                                  (it's no later than it either way). */
+
+  TimerWheel(const TimerWheel<T> &);
+  TimerWheel<T> & operator = (const TimerWheel<T> &);
+};
+
+#endif /* TIMERS_HPP */
@@ -11,19 +11,38 @@ template <MSGID ID> class tuple;
     tuple(const boost::tuple<IDENTITY types> &t)                        \
       : boost::tuple<IDENTITY types>(t) {}                              \
                                                                         \
+    tuple(const process::tuples::view &data)                            \
+    {                                                                   \
+      process::tuples::deserializer d(data.data, data.length,           \
+                                      data.compact);                    \
+      deserialize(d, *this);                                            \
+    }                                                                   \
+                                                                        \
     tuple(const std::string &data)                                      \
     {                                                                   \
-      std::istringstream is(data);                                      \
-      process::tuples::deserializer d(is);                              \
+      process::tuples::deserializer d(data.data(), data.size());        \
       deserialize(d, *this);                                            \
     }                                                                   \
                                                                         \
-    operator std::string () const                                       \
+    size_t serialized_size(bool compact = false) const                  \
     {                                                                   \
-      std::ostringstream os;                                            \
-      process::tuples::serializer s(os);                                \
+      process::tuples::serializer s(NULL, compact);                     \
       serialize(s, *this);                                              \
-      return os.str();                                                  \
+      return s.size;                                                    \
+    }                                                                   \
+                                                                        \
+    /* Writes serialized_size(compact) bytes to data. */                \
+    void serialize_to(char *data, bool compact = false) const           \
+    {                                                                   \
+      process::tuples::serializer s(data, compact);                     \
+      serialize(s, *this);                                              \
+    }                                                                   \
+                                                                        \
+    operator std::string () const                                       \
+    {                                                                   \
+      std::string data(serialized_size(), '\0');                        \
+      serialize_to(&data[0]);                                           \
+      return data;                                                      \
     }                                                                   \
   }
 
@@ -168,3 +187,18 @@ typename boost::tuples::element<N, tuple<ID> >::type unpack(
 {
   return boost::tuples::get<N>(unpack<ID>(data));
 }
+
+
+template <MSGID ID>
+tuple<ID> unpack(const process::tuples::view &data)
+{
+  return tuple<ID>(data);
+}
+
+
+template <MSGID ID, int N>
+typename boost::tuples::element<N, tuple<ID> >::type unpack(
+  const process::tuples::view &data)
+{
+  return boost::tuples::get<N>(unpack<ID>(data));
+}
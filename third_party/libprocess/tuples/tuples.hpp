@@ -2,10 +2,10 @@
 #define TUPLES_HPP
 
 #include <stdlib.h>
+#include <string.h>
 
 #include <arpa/inet.h>
 
-#include <sstream>
 #include <string>
 #include <utility>
 
@@ -14,26 +14,109 @@
 
 namespace process { namespace tuples {
 
-/* TODO(benh): Check stream errors! Report errors! Ahhhh! */
+/*
+ * Values are serialized in one of two encodings: the original one,
+ * which writes integers (and string lengths) as fixed size big-endian
+ * values, or a compact one, which writes them as varints (7 bits per
+ * byte, least significant first, with the high bit set on all but
+ * the last byte; signed integers are zigzag encoded first so small
+ * negative numbers stay small too) and delimits nested types (see
+ * delimited below) by their length.
+ */
 
+
+/*
+ * Serialized data read in place (e.g., the body of the current
+ * message), which avoids copying it before deserializing.
+ */
+struct view
+{
+  view(const char *_data, size_t _length, bool _compact = false)
+    : data(_data), length(_length), compact(_compact) {}
+
+  const char *data;
+  size_t length;
+  bool compact;
+};
+
+
+/*
+ * Writes serialized values to a buffer. A serializer without a buffer
+ * only counts the bytes that would be written, so that a buffer of
+ * exactly the right size can be allocated up front.
+ */
 struct serializer
 {
-  std::ostringstream& stream;
+  char *data;    /* NULL when just counting. */
+  size_t size;   /* Bytes written (or counted) so far. */
+  bool compact;  /* Use the compact encoding. */
+
+  serializer(char *_data = NULL, bool _compact = false)
+    : data(_data), size(0), compact(_compact) {}
 
-  serializer(std::ostringstream& s) : stream(s) {}
+  void write(const void *bytes, size_t length)
+  {
+    if (data != NULL)
+      memcpy(data + size, bytes, length);
+    size += length;
+  }
+
+  void varint(uint64_t v)
+  {
+    char bytes[10];
+    size_t length = 0;
+    while (v >= 0x80) {
+      bytes[length++] = (char) (v | 0x80);
+      v >>= 7;
+    }
+    bytes[length++] = (char) v;
+    write(bytes, length);
+  }
+
+  /*
+   * Writes a nested value with the specified function, preceded by
+   * its length in the compact encoding, so that a reader can skip
+   * fields appended to it by a newer writer.
+   */
+  template <typename T>
+  void delimited(const T &t, void (*fields)(serializer &, const T &))
+  {
+    if (!compact) {
+      fields(*this, t);
+      return;
+    }
+
+    serializer counter(NULL, true);
+    fields(counter, t);
+    varint(counter.size);
+    if (data != NULL)
+      fields(*this, t);
+    else
+      size += counter.size;
+  }
 
   void operator & (const int32_t & i)
   {
+    if (compact) {
+      varint(((uint32_t) i << 1) ^ (uint32_t) (i >> 31));
+      return;
+    }
+
     uint32_t netInt = htonl((uint32_t) i);
-    stream.write((char *) &netInt, sizeof(netInt));
+    write(&netInt, sizeof(netInt));
   }
 
   void operator & (const int64_t & i)
   {
+    if (compact) {
+      varint(((uint64_t) i << 1) ^ (uint64_t) (i >> 63));
+      return;
+    }
+
     uint32_t hiInt = htonl((uint32_t) (i >> 32));
     uint32_t loInt = htonl((uint32_t) (i & 0xFFFFFFFF));
-    stream.write((char *) &hiInt, sizeof(hiInt));
-    stream.write((char *) &loInt, sizeof(loInt));
+    write(&hiInt, sizeof(hiInt));
+    write(&loInt, sizeof(loInt));
   }
 
 #ifdef __APPLE__
@@ -50,7 +133,9 @@ struct serializer
 
   void operator & (const size_t &i)
   {
-    if (sizeof(size_t) == sizeof(int32_t))
+    if (compact)
+      varint(i);
+    else if (sizeof(size_t) == sizeof(int32_t))
       *this & ((int32_t &) i);
     else if (sizeof(size_t) == sizeof(int64_t))
       *this & ((int64_t &) i);
@@ -61,43 +146,109 @@ struct serializer
   void operator & (const double &d)
   {
     // TODO(*): Deal with endian issues?
-    stream.write((char *) &d, sizeof(d));
+    write(&d, sizeof(d));
   }
 
   void operator & (const std::string &s)
   {
     size_t size = s.size();
     *this & (size);
-    stream.write(s.data(), size);
+    write(s.data(), size);
   }
 
   void operator & (const PID &pid)
   {
     *this & ((int32_t) pid.pipe);
-    *this & ((int32_t) pid.ip);
+    if (compact)
+      write(&pid.ip, sizeof(pid.ip));   /* Rarely small as a varint. */
+    else
+      *this & ((int32_t) pid.ip);
     *this & ((int32_t) pid.port);
   }
 };
 
 
+/*
+ * Reads serialized values from a buffer it doesn't own. Reading past
+ * the end of the buffer gives zeros (and empty strings).
+ */
 struct deserializer
 {
-  std::istringstream &stream;
+  const char *data;
+  size_t length;
+  size_t offset;   /* Bytes read so far. */
+  bool compact;    /* Read the compact encoding. */
+
+  deserializer(const char *_data, size_t _length, bool _compact = false)
+    : data(_data), length(_length), offset(0), compact(_compact) {}
+
+  void read(void *bytes, size_t size)
+  {
+    size_t available = offset < length ? length - offset : 0;
+    if (size <= available) {
+      memcpy(bytes, data + offset, size);
+    } else {
+      memcpy(bytes, data + offset, available);
+      memset((char *) bytes + available, 0, size - available);
+    }
+    offset += size;
+  }
+
+  uint64_t varint()
+  {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64 && offset < length; shift += 7) {
+      unsigned char byte = data[offset++];
+      v |= (uint64_t) (byte & 0x7f) << shift;
+      if (!(byte & 0x80))
+        return v;
+    }
+    return v;
+  }
+
+  /*
+   * Reads a nested value written by serializer::delimited, skipping
+   * any fields after the ones the specified function reads.
+   */
+  template <typename T>
+  void delimited(T &t, void (*fields)(deserializer &, T &))
+  {
+    if (!compact) {
+      fields(*this, t);
+      return;
+    }
 
-  deserializer(std::istringstream &s) : stream(s) {}
+    uint64_t size = varint();
+    size_t available = offset < length ? length - offset : 0;
+    deserializer d(data + offset, size < available ? size : available, true);
+    fields(d, t);
+    offset = size < available ? offset + size : length;
+  }
 
   void operator & (int32_t &i)
   {
+    if (compact) {
+      uint32_t v = (uint32_t) varint();
+      i = (int32_t) ((v >> 1) ^ -(v & 1));
+      return;
+    }
+
     uint32_t netInt;
-    stream.read((char *) &netInt, sizeof(netInt));
+    read(&netInt, sizeof(netInt));
     i = ntohl(netInt);
   }
 
   void operator & (int64_t &i)
   {
+    if (compact) {
+      uint64_t v = varint();
+      i = (int64_t) ((v >> 1) ^ -(v & 1));
+      return;
+    }
+
     uint32_t hiInt, loInt;
-    stream.read((char *) &hiInt, sizeof(hiInt));
-    stream.read((char *) &loInt, sizeof(loInt));
+    read(&hiInt, sizeof(hiInt));
+    read(&loInt, sizeof(loInt));
     int64_t hi64 = ntohl(hiInt);
     int64_t lo64 = ntohl(loInt);
     i = (hi64 << 32) | lo64;
@@ -117,7 +268,9 @@ struct deserializer
 
   void operator & (size_t &i)
   {
-    if (sizeof(size_t) == sizeof(int32_t))
+    if (compact)
+      i = varint();
+    else if (sizeof(size_t) == sizeof(int32_t))
       *this & ((int32_t &) i);
     else if (sizeof(size_t) == sizeof(int64_t))
       *this & ((int64_t &) i);
@@ -128,21 +281,29 @@ struct deserializer
   void operator & (double &d)
   {
     // TODO(*): Deal with endian issues?
-    stream.read((char *) &d, sizeof(d));
+    read(&d, sizeof(d));
   }
 
   void operator & (std::string &s)
   {
     size_t size;
     *this & (size);
-    s.resize(size);
-    stream.read((char *) s.data(), size);
+    if (offset < length && size <= length - offset) {
+      s.assign(data + offset, size);
+      offset += size;
+    } else {
+      s.clear();
+      offset = length;
+    }
   }
 
   void operator & (PID &pid)
   {
     *this & ((int32_t &) pid.pipe);
-    *this & ((int32_t &) pid.ip);
+    if (compact)
+      read(&pid.ip, sizeof(pid.ip));
+    else
+      *this & ((int32_t &) pid.ip);
     *this & ((int32_t &) pid.port);
   }
 };